@@ -0,0 +1,538 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <map>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <SDL_error.h>
+#include <SDL_surface.h>
+#include <stb_image.h>
+#include <fmt/format.h>
+#include <yaml-cpp/yaml.h>
+#include <common/hash.h>
+#include <common/lz4.h>
+#include <common/defer.h>
+#include <common/result.h>
+#include <common/worker_pool.h>
+#include <bank_manager.h>
+#include <tile_sheet.h>
+#include "../ext/ya_getopt-1.0.0/ya_getopt.h"
+
+using namespace mayhem;
+
+// one sheet, font or logo from the manifest and, once processed, the entry
+// built from it.  entries are compressed by the job that builds them, so
+// save only has to copy them into place.
+struct input_t {
+    bank_entry_type_t type = bank_entry_type_t::raw;
+    std::string name{};
+    std::string path{};
+    uint8_t bank = 0;
+    mayhem::size_t tile_size{};
+    uint64_t hash = 0;
+    bool reused = false;
+    std::vector<uint8_t> stored{};
+    bank_codec_t codec = bank_codec_t::none;
+    std::size_t size = 0;
+    common::result result{};
+};
+
+struct manifest_t {
+    std::string output{};
+    bank_codec_t codec = bank_codec_t::lz4;
+    std::vector<input_t> inputs{};
+};
+
+struct options_t {
+    bool force = false;
+    uint32_t jobs = 0;
+    std::string manifest{};
+};
+
+static void print_results(const common::result& r) {
+    auto messages = r.messages();
+    for (std::size_t i = 0; i < messages.size(); i++) {
+        const auto& msg = messages[i];
+        fmt::print(
+            "[{}] {}{}\n",
+            msg.code(),
+            msg.is_error() ? "ERROR: " : "WARNING: ",
+            msg.message());
+        if (!msg.details().empty()) {
+            fmt::print("{}\n", msg.details());
+        }
+    }
+}
+
+static void print_usage() {
+    fmt::print(
+        "usage: mayhem-bankc [options] manifest.yaml\n"
+        "  --force         rebuild every entry, even if its input is unchanged\n"
+        "  --jobs N        process N inputs at once; defaults to one per core\n");
+}
+
+static bool parse_options(int argc, const char** argv, options_t& options) {
+    enum option_t : int {
+        force = 0x100,
+        jobs,
+    };
+    static const struct option long_options[] = {
+        {"force", ya_no_argument, nullptr, option_t::force},
+        {"jobs", ya_required_argument, nullptr, option_t::jobs},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int32_t c;
+    while ((c = ya_getopt_long(argc, (char* const*) argv, "", long_options, nullptr)) != -1) {
+        switch (c) {
+            case option_t::force:
+                options.force = true;
+                break;
+            case option_t::jobs:
+                options.jobs = static_cast<uint32_t>(std::strtoul(ya_optarg, nullptr, 10));
+                break;
+            default:
+                print_usage();
+                return false;
+        }
+    }
+
+    if (ya_optind != argc - 1) {
+        print_usage();
+        return false;
+    }
+    options.manifest = argv[ya_optind];
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static std::string path_directory(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    if (slash == std::string::npos)
+        return ".";
+    return path.substr(0, slash + 1);
+}
+
+static std::string path_resolve(const std::string& directory, const std::string& path) {
+    if (path.empty() || path[0] == '/' || directory == ".")
+        return path;
+    return directory + path;
+}
+
+static bool read_file(common::result& r, const std::string& path, std::vector<uint8_t>& data) {
+    auto file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        r.error("B001", fmt::format("unable to open {}: {}", path, strerror(errno)));
+        return false;
+    }
+    defer(fclose(file));
+
+    data.clear();
+    uint8_t buffer[64 * 1024];
+    for (;;) {
+        const auto n = fread(buffer, 1, sizeof(buffer), file);
+        data.insert(data.end(), buffer, buffer + n);
+        if (n < sizeof(buffer))
+            break;
+    }
+
+    if (ferror(file)) {
+        r.error("B001", fmt::format("unable to read {}", path));
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool manifest_section(
+        common::result& r,
+        const YAML::Node& root,
+        const char* section,
+        bank_entry_type_t type,
+        uint8_t default_bank,
+        const std::string& directory,
+        manifest_t& manifest) {
+    const auto items = root[section];
+    if (!items)
+        return true;
+    if (!items.IsSequence()) {
+        r.error("B005", fmt::format("{} must be a list", section));
+        return false;
+    }
+
+    for (const auto& item : items) {
+        input_t input{};
+        input.type = type;
+        input.name = item["name"].as<std::string>("");
+        input.path = path_resolve(directory, item["path"].as<std::string>(""));
+        input.bank = (uint8_t) item["bank"].as<uint32_t>(default_bank);
+
+        if (input.name.empty() || input.path.empty()) {
+            r.error("B005", fmt::format("every entry in {} needs a name and a path", section));
+            return false;
+        }
+        if (input.name.size() > bank_name_length) {
+            r.error("B005", fmt::format(
+                "{} is longer than {} characters",
+                input.name,
+                bank_name_length));
+            return false;
+        }
+
+        if (type == bank_entry_type_t::tile_sheet) {
+            const auto tile = item["tile"];
+            if (!tile || !tile.IsSequence() || tile.size() != 2) {
+                r.error("B005", fmt::format("sheet {} needs a tile size: [w, h]", input.name));
+                return false;
+            }
+            input.tile_size.w = tile[0].as<int32_t>();
+            input.tile_size.h = tile[1].as<int32_t>();
+        }
+
+        manifest.inputs.push_back(std::move(input));
+    }
+
+    return true;
+}
+
+static bool manifest_load(common::result& r, const std::string& path, manifest_t& manifest) {
+    try {
+        const auto root = YAML::LoadFile(path);
+        const auto directory = path_directory(path);
+
+        manifest.output = path_resolve(directory, root["output"].as<std::string>(""));
+        if (manifest.output.empty()) {
+            r.error("B005", fmt::format("manifest {} has no output", path));
+            return false;
+        }
+
+        const auto codec = root["codec"].as<std::string>("lz4");
+        if (codec == "lz4") {
+            manifest.codec = bank_codec_t::lz4;
+        } else if (codec == "none") {
+            manifest.codec = bank_codec_t::none;
+        } else {
+            r.error("B005", fmt::format("unknown codec: {}", codec));
+            return false;
+        }
+
+        if (!manifest_section(r, root, "sheets", bank_entry_type_t::tile_sheet, 0, directory, manifest)
+        ||  !manifest_section(r, root, "fonts", bank_entry_type_t::font, 1, directory, manifest)
+        ||  !manifest_section(r, root, "logos", bank_entry_type_t::image, 2, directory, manifest)) {
+            return false;
+        }
+    } catch (const YAML::Exception& e) {
+        r.error("B005", fmt::format("unable to read manifest {}: {}", path, e.what()));
+        return false;
+    }
+
+    std::map<std::pair<uint8_t, std::string>, const input_t*> names{};
+    for (const auto& input : manifest.inputs) {
+        const auto key = std::make_pair(input.bank, input.name);
+        if (names.count(key) != 0) {
+            r.error("B005", fmt::format("{} appears twice in bank {}", input.name, input.bank));
+            return false;
+        }
+        names[key] = &input;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// the hash of an input covers its bytes and every setting that changes the
+// entry built from it, so changing a tile size rebuilds the sheet too.
+static uint64_t input_hash(const input_t& input, bank_codec_t codec, const std::vector<uint8_t>& data) {
+    const auto settings = fmt::format(
+        "{}:{}:{}x{}:{}",
+        static_cast<uint32_t>(input.type),
+        input.bank,
+        input.tile_size.w,
+        input.tile_size.h,
+        static_cast<uint32_t>(codec));
+    const auto seed = common::hash64(settings.data(), settings.size());
+    return common::hash64(data.data(), data.size(), seed);
+}
+
+static std::string cache_key(uint8_t bank, const std::string& name) {
+    return fmt::format("{}:{}", bank, name);
+}
+
+// one line per entry of the last build: bank:name and the hash of the
+// input it was built from
+static void cache_load(const std::string& path, std::map<std::string, uint64_t>& cache) {
+    auto file = fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return;
+    defer(fclose(file));
+
+    char key[64];
+    unsigned long long hash;
+    while (fscanf(file, "%63s %llx", key, &hash) == 2)
+        cache[key] = hash;
+}
+
+static bool cache_save(common::result& r, const std::string& path, const manifest_t& manifest) {
+    std::string text{};
+    for (const auto& input : manifest.inputs)
+        text += fmt::format("{} {:016x}\n", cache_key(input.bank, input.name), input.hash);
+
+    auto file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        r.error("B003", fmt::format("unable to write {}: {}", path, strerror(errno)));
+        return false;
+    }
+    const auto written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (fclose(file) != 0 || !written) {
+        r.error("B003", fmt::format("unable to write {}", path));
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool decode_image(
+        common::result& r,
+        const std::string& path,
+        const std::vector<uint8_t>& data,
+        std::vector<uint32_t>& pixels,
+        mayhem::size_t& size) {
+    int32_t channels = 0;
+    auto decoded = stbi_load_from_memory(
+        data.data(),
+        (int) data.size(),
+        &size.w,
+        &size.h,
+        &channels,
+        STBI_rgb_alpha);
+    if (decoded == nullptr) {
+        r.error("V003", fmt::format("unable to decode image {}: {}", path, stbi_failure_reason()));
+        return false;
+    }
+    defer(stbi_image_free(decoded));
+
+    pixels.resize((std::size_t) size.w * size.h);
+    if (SDL_ConvertPixels(
+            size.w,
+            size.h,
+            SDL_PIXELFORMAT_RGBA32,
+            decoded,
+            size.w * 4,
+            SDL_PIXELFORMAT_BGRA32,
+            pixels.data(),
+            size.w * 4) != 0) {
+        r.error("V003", fmt::format("unable to convert image {}: {}", path, SDL_GetError()));
+        return false;
+    }
+    return true;
+}
+
+static bool build_entry(common::result& r, const input_t& input, const std::vector<uint8_t>& data, std::vector<uint8_t>& entry) {
+    switch (input.type) {
+        case bank_entry_type_t::tile_sheet: {
+            std::vector<uint32_t> pixels{};
+            mayhem::size_t sheet_size{};
+            if (!decode_image(r, input.path, data, pixels, sheet_size))
+                return false;
+            return tile_sheet_pack(r, pixels.data(), sheet_size, input.tile_size, entry);
+        }
+        case bank_entry_type_t::image: {
+            std::vector<uint32_t> pixels{};
+            mayhem::size_t image_size{};
+            if (!decode_image(r, input.path, data, pixels, image_size))
+                return false;
+            if (image_size.w > UINT16_MAX || image_size.h > UINT16_MAX) {
+                r.error("V003", fmt::format("image {} is too large", input.path));
+                return false;
+            }
+
+            bank_image_t header{(uint16_t) image_size.w, (uint16_t) image_size.h};
+            entry.resize(sizeof(header) + pixels.size() * sizeof(uint32_t));
+            memcpy(entry.data(), &header, sizeof(header));
+            memcpy(entry.data() + sizeof(header), pixels.data(), pixels.size() * sizeof(uint32_t));
+            return true;
+        }
+        default:
+            entry = data;
+            return true;
+    }
+}
+
+// each worker keeps one compressor table for every input it handles
+static common::lz4_compress_state_t& lz4_state() {
+    static thread_local auto t_state = std::make_unique<common::lz4_compress_state_t>();
+    return *t_state;
+}
+
+// runs on a worker: hashes the input and, unless the previous bank already
+// holds an entry built from the same bytes, decodes, slices and compresses it
+static void process_input(
+        input_t& input,
+        bank_codec_t codec,
+        const std::map<std::string, uint64_t>& cache,
+        bank_file* previous) {
+    std::vector<uint8_t> data{};
+    if (!read_file(input.result, input.path, data))
+        return;
+    input.hash = input_hash(input, codec, data);
+
+    if (previous != nullptr) {
+        auto it = cache.find(cache_key(input.bank, input.name));
+        auto bank = previous->find(input.bank);
+        auto entry = bank != nullptr ? bank->find(input.name) : nullptr;
+        if (it != std::end(cache)
+        &&  it->second == input.hash
+        &&  entry != nullptr
+        &&  entry->type() == static_cast<uint8_t>(input.type)) {
+            input.reused = true;
+            return;
+        }
+    }
+
+    std::vector<uint8_t> entry{};
+    if (!build_entry(input.result, input, data, entry))
+        return;
+
+    input.size = entry.size();
+    input.codec = bank_codec_t::none;
+    if (codec == bank_codec_t::lz4 && !entry.empty()) {
+        std::vector<uint8_t> block(common::lz4_compress_bound(entry.size()));
+        const auto size = common::lz4_compress(
+            lz4_state(),
+            entry.data(),
+            entry.size(),
+            block.data(),
+            block.size());
+        if (size > 0 && size < entry.size()) {
+            block.resize(size);
+            input.stored = std::move(block);
+            input.codec = bank_codec_t::lz4;
+            return;
+        }
+    }
+    input.stored = std::move(entry);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool bankc_run(common::result& r, const options_t& options) {
+    manifest_t manifest{};
+    if (!manifest_load(r, options.manifest, manifest))
+        return false;
+
+    // the previous build, if it is intact, is where unchanged entries are
+    // copied from; its mapping outlives the save, which writes a new file
+    // and renames it over the old one.
+    const auto cache_path = manifest.output + ".hashes";
+    std::map<std::string, uint64_t> cache{};
+    std::unique_ptr<bank_file> previous{};
+    if (!options.force) {
+        common::result previous_result{};
+        previous = std::make_unique<bank_file>(manifest.output);
+        if (previous->map(previous_result))
+            cache_load(cache_path, cache);
+        else
+            previous.reset();
+    }
+
+    const auto threads = options.jobs > 0 ?
+        options.jobs - 1 :
+        common::worker_pool::default_size();
+    common::worker_pool pool(threads);
+    pool.run((uint32_t) manifest.inputs.size(), [&](uint32_t index) {
+        process_input(manifest.inputs[index], manifest.codec, cache, previous.get());
+    });
+
+    auto success = true;
+    std::size_t reused = 0;
+    for (const auto& input : manifest.inputs) {
+        if (!input.result.is_failed()) {
+            reused += input.reused ? 1 : 0;
+            continue;
+        }
+        r.append(input.result);
+        success = false;
+    }
+    if (!success)
+        return false;
+
+    // nothing to write if every entry came from the previous build and the
+    // manifest names exactly the entries it already has
+    if (previous != nullptr && reused == manifest.inputs.size()) {
+        std::size_t entries = 0;
+        for (const auto& bank : previous->banks())
+            entries += bank.size();
+        if (entries == manifest.inputs.size()) {
+            fmt::print("{}: up to date, {} entries\n", manifest.output, entries);
+            return true;
+        }
+    }
+
+    bank_manager banks{};
+    auto file = banks.create(r, manifest.output);
+    if (file == nullptr)
+        return false;
+
+    for (const auto& input : manifest.inputs) {
+        if (input.reused) {
+            const auto entry = previous->find(input.bank)->find(input.name);
+            file->get(input.bank).add(bank_entry(
+                input.name,
+                entry->type(),
+                entry->stored(),
+                entry->stored_size(),
+                entry->codec(),
+                entry->size()));
+            continue;
+        }
+
+        file->get(input.bank).add(bank_entry(
+            input.name,
+            static_cast<uint8_t>(input.type),
+            input.stored.data(),
+            input.stored.size(),
+            input.codec,
+            input.size));
+    }
+
+    if (!banks.save(r, file))
+        return false;
+
+    if (!cache_save(r, cache_path, manifest))
+        return false;
+
+    fmt::print(
+        "{}: {} entries, {} rebuilt, {} unchanged\n",
+        manifest.output,
+        manifest.inputs.size(),
+        manifest.inputs.size() - reused,
+        reused);
+
+    return true;
+}
+
+int main(int argc, const char** argv) {
+    options_t options{};
+    if (!parse_options(argc, argv, options))
+        return 1;
+
+    common::result result{};
+    defer(print_results(result));
+
+    return bankc_run(result, options) ? 0 : 1;
+}
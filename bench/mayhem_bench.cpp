@@ -0,0 +1,857 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <fmt/format.h>
+#include <entt/entity/registry.hpp>
+#include <common/lz4.h>
+#include <common/rune.h>
+#include <common/memory_pool.h>
+#include <common/frame_arena.h>
+#include <common/string_support.h>
+#include <blit.h>
+#include <types.h>
+#include <raster.h>
+#include <window.h>
+#include <palette.h>
+#include <draw_list.h>
+#include <image_cache.h>
+#include <game.h>
+#include <timer.h>
+#include <alloc_tracker.h>
+
+using namespace mayhem;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// each benchmark body is one operation; bytes is what one operation writes
+// or reads, and is zero where a rate would mean nothing.  a run is warmup
+// untimed calls followed by repetitions timed batches of iterations calls,
+// and every batch contributes one per-operation sample.  heap allocations
+// are counted across the timed batches and reported per operation.
+
+struct bench_options_t {
+    uint32_t warmup = 20;
+    uint32_t repetitions = 50;
+    uint32_t iterations = 100;
+    std::string filter{};
+    std::string output{"mayhem-bench.json"};
+    bool force_isa = false;
+    blit_isa_t isa = blit_isa_t::scalar;
+};
+
+struct bench_t {
+    std::string name;
+    uint64_t bytes = 0;
+    std::function<void ()> body;
+    // calls per batch in place of --iterations, for bodies that are a
+    // whole batch on their own
+    uint32_t iterations = 0;
+};
+
+struct bench_result_t {
+    std::string name;
+    uint64_t bytes = 0;
+    double median = 0;
+    double p99 = 0;
+    double min = 0;
+    double bytes_per_second = 0;
+    double allocs = 0;
+};
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    const auto index = std::min<std::size_t>(
+        static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5),
+        sorted.size() - 1);
+    return sorted[index];
+}
+
+static bench_result_t bench_run(const bench_options_t& options, const bench_t& bench) {
+    const auto iterations = bench.iterations != 0 ? bench.iterations : options.iterations;
+    for (uint32_t i = 0; i < options.warmup; i++)
+        bench.body();
+
+    std::vector<double> samples{};
+    samples.reserve(options.repetitions);
+    const auto allocs_before = alloc_tracker_pending().count;
+    for (uint32_t rep = 0; rep < options.repetitions; rep++) {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+            bench.body();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        samples.push_back(
+            std::chrono::duration<double, std::nano>(elapsed).count() / iterations);
+    }
+    const auto allocs = alloc_tracker_pending().count - allocs_before;
+    std::sort(samples.begin(), samples.end());
+
+    bench_result_t result{};
+    result.name = bench.name;
+    result.bytes = bench.bytes;
+    result.median = percentile(samples, 0.5);
+    result.p99 = percentile(samples, 0.99);
+    result.min = samples.front();
+    if (bench.bytes > 0 && result.median > 0)
+        result.bytes_per_second = (double) bench.bytes / result.median * 1e9;
+    result.allocs = (double) allocs / ((double) options.repetitions * iterations);
+    return result;
+}
+
+static bool bench_write_json(
+        const bench_options_t& options,
+        const std::vector<bench_result_t>& results) {
+    auto file = fopen(options.output.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    fmt::print(file, "{{\n");
+    fmt::print(file, "  \"isa\": \"{}\",\n", blit_isa_name(blit_kernels().isa));
+    fmt::print(file, "  \"warmup\": {},\n", options.warmup);
+    fmt::print(file, "  \"repetitions\": {},\n", options.repetitions);
+    fmt::print(file, "  \"iterations\": {},\n", options.iterations);
+    fmt::print(file, "  \"results\": [\n");
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        fmt::print(
+            file,
+            "    {{\"name\": \"{}\", \"bytes\": {}, \"median_ns\": {:.1f}, "
+            "\"p99_ns\": {:.1f}, \"min_ns\": {:.1f}, \"bytes_per_second\": {:.0f}, "
+            "\"allocs_per_op\": {:.2f}}}{}\n",
+            result.name,
+            result.bytes,
+            result.median,
+            result.p99,
+            result.min,
+            result.bytes_per_second,
+            result.allocs,
+            i + 1 < results.size() ? "," : "");
+    }
+    fmt::print(file, "  ]\n}}\n");
+
+    return fclose(file) == 0;
+}
+
+static void print_usage() {
+    fmt::print(
+        "usage: mayhem-bench [options]\n"
+        "  --filter <text>        only run benchmarks whose name contains text\n"
+        "  --output <path>        json results file (default mayhem-bench.json)\n"
+        "  --repetitions <count>  timed batches per benchmark (default 50)\n"
+        "  --iterations <count>   calls per batch (default 100)\n"
+        "  --warmup <count>       untimed calls before the first batch (default 20)\n"
+        "  --isa <name>           time the scalar, sse2, ssse3 or avx2 kernels instead of the best available\n");
+}
+
+static bool parse_options(int argc, const char** argv, bench_options_t& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg(argv[i]);
+        if (arg == "--help")
+            return false;
+        if (i + 1 >= argc) {
+            fmt::print(stderr, "missing value for {}\n", arg);
+            return false;
+        }
+
+        const auto value = argv[++i];
+        if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--output")
+            options.output = value;
+        else if (arg == "--repetitions")
+            options.repetitions = std::max<uint32_t>(std::strtoul(value, nullptr, 10), 1);
+        else if (arg == "--iterations")
+            options.iterations = std::max<uint32_t>(std::strtoul(value, nullptr, 10), 1);
+        else if (arg == "--warmup")
+            options.warmup = std::strtoul(value, nullptr, 10);
+        else if (arg == "--isa") {
+            if (!blit_isa_parse(value, options.isa)) {
+                fmt::print(stderr, "unknown instruction set: {}\n", value);
+                return false;
+            }
+            options.force_isa = true;
+        }
+        else {
+            fmt::print(stderr, "unknown option: {}\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// the same shapes video.cpp hands to blit_draw: tiles are clipped to their
+// own 32x32 cell, sprites to the screen with the 16x16 sprite size.
+
+static constexpr int32_t tile_size = 32;
+static constexpr int32_t sprite_size = 16;
+static constexpr uint32_t sprite_count = 64;
+
+struct bench_position_t {
+    int32_t x = 0;
+    int32_t y = 0;
+};
+
+struct bench_velocity_t {
+    int32_t dx = 0;
+    int32_t dy = 0;
+};
+
+struct bench_particle_t {
+    float x = 0;
+    float y = 0;
+    uint32_t age = 0;
+    uint32_t color = 0;
+};
+
+static const char* s_paragraph =
+    "The mayhem engine draws its backgrounds from tiles, its actors from "
+    "sprites and everything else from a sorted draw list that is composed "
+    "into the frame once the tiles and sprites are down. Text goes through "
+    "the same list, which is why wrapping and decoding it has to stay cheap.";
+
+static const char* s_runes =
+    "mayhem \xc3\xa9\xc3\xa8\xc3\xaa \xe2\x86\x90\xe2\x86\x91\xe2\x86\x92\xe2\x86\x93 "
+    "\xf0\x9f\x8e\xae \xf0\x9f\x91\xbe score 0001234 \xe2\x98\x85\xe2\x98\x85\xe2\x98\x85";
+
+///////////////////////////////////////////////////////////////////////////////
+
+// the byte-at-a-time loops video_draw_hline, video_draw_vline and
+// video_draw_rect used before the raster module, kept as the baseline for
+// the raster cases.  the vline loop here steps by pitch - 4 so it stays
+// inside the surface; the original stepped by pitch + 4 and drifted one
+// pixel right every row.
+
+struct legacy_target_t {
+    uint8_t* pixels = nullptr;
+    int32_t pitch = 0;
+};
+
+static void legacy_hline(const legacy_target_t& t, color_t c, int32_t y, int32_t x, int32_t w) {
+    auto p = t.pixels + (y * t.pitch + (x * 4));
+    for (int32_t i = 0; i < w; i++) {
+        *p++ = c.b;
+        *p++ = c.g;
+        *p++ = c.r;
+        *p++ = c.a;
+    }
+}
+
+static void legacy_vline(const legacy_target_t& t, color_t c, int32_t y, int32_t x, int32_t h) {
+    auto p = t.pixels + (y * t.pitch + (x * 4));
+    for (int32_t i = 0; i < h; i++) {
+        *p++ = c.b;
+        *p++ = c.g;
+        *p++ = c.r;
+        *p++ = c.a;
+        p += t.pitch - 4;
+    }
+}
+
+static void legacy_box(const legacy_target_t& t, color_t c, int32_t y, int32_t x, int32_t w, int32_t h, bool fill) {
+    if (fill) {
+        for (int32_t i = 0; i < h; i++)
+            legacy_hline(t, c, y + i, x, w);
+    } else {
+        legacy_vline(t, c, y, x, h);
+        legacy_vline(t, c, y, x + w, h);
+        legacy_hline(t, c, y, x, w);
+        legacy_hline(t, c, y + h, x, w);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// a kernel that writes something other than the scalar one would be timed
+// doing different work, so before anything runs, every kernel the cpu has
+// is checked against scalar: random premultiplied pixels with clear, opaque
+// and partial alpha, at every count up to a couple of the widest vector's
+// tails.
+
+struct bench_row_kernel_t {
+    const char* name;
+    blit_row_kernel_t blit_kernels_t::* kernel;
+};
+
+struct bench_span_kernel_t {
+    const char* name;
+    raster_span_kernel_t raster_kernels_t::* kernel;
+};
+
+static const bench_row_kernel_t s_row_kernels[] = {
+    {"copy", &blit_kernels_t::copy},
+    {"copy_hflip", &blit_kernels_t::copy_hflip},
+    {"keyed", &blit_kernels_t::keyed},
+    {"keyed_hflip", &blit_kernels_t::keyed_hflip},
+    {"blend", &blit_kernels_t::blend},
+    {"blend_hflip", &blit_kernels_t::blend_hflip},
+};
+
+static const bench_span_kernel_t s_span_kernels[] = {
+    {"fill", &raster_kernels_t::fill},
+    {"blend", &raster_kernels_t::blend},
+};
+
+static bool verify_kernels() {
+    const uint32_t max_count = 67;
+    uint32_t seed = 1;
+    const auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed;
+    };
+    const auto next_pixel = [&](uint32_t i) {
+        const auto value = next();
+        const auto alpha = i % 3 == 0 ? 0u : i % 3 == 1 ? 0xffu : value >> 24;
+        uint32_t pixel = alpha << 24;
+        for (uint32_t shift = 0; shift < 24; shift += 8)
+            pixel |= (((value >> shift) & 0xffu) * alpha / 0xffu) << shift;
+        return pixel;
+    };
+
+    std::vector<uint32_t> src(max_count);
+    std::vector<uint32_t> dst(max_count);
+    std::vector<uint8_t> indices(max_count);
+    for (uint32_t i = 0; i < max_count; i++) {
+        src[i] = next_pixel(i);
+        dst[i] = next_pixel(i + 1);
+        indices[i] = (uint8_t) (next() & 0x0f);
+    }
+    palette_t pal{};
+    for (uint32_t i = 0; i < max_palette_entries; i++)
+        pal.entries[i].value = next_pixel(i);
+    for (uint32_t i = 0; i < 16; i++) {
+        pal.planes[0][i] = pal.entries[i].blue;
+        pal.planes[1][i] = pal.entries[i].green;
+        pal.planes[2][i] = pal.entries[i].red;
+        pal.planes[3][i] = pal.entries[i].alpha;
+    }
+
+    std::vector<uint32_t> expected(max_count);
+    std::vector<uint32_t> actual(max_count);
+    const auto differs = [&](std::string_view isa, std::string_view name, uint32_t count) {
+        if (memcmp(expected.data(), actual.data(), max_count * sizeof(uint32_t)) == 0)
+            return false;
+        fmt::print(stderr, "{} {} differs from scalar at count {}\n", isa, name, count);
+        return true;
+    };
+
+    const auto& scalar = *blit_kernels(blit_isa_t::scalar);
+    const auto& scalar_raster = *raster_kernels(blit_isa_t::scalar);
+    for (auto isa : {blit_isa_t::sse2, blit_isa_t::ssse3, blit_isa_t::avx2}) {
+        const auto kernels = blit_kernels(isa);
+        const auto raster = raster_kernels(isa);
+        if (kernels == nullptr || raster == nullptr)
+            continue;
+
+        const auto name = blit_isa_name(isa);
+        for (uint32_t count = 0; count <= max_count; count++) {
+            for (const auto& row : s_row_kernels) {
+                expected = dst;
+                actual = dst;
+                (scalar.*row.kernel)(expected.data(), src.data(), count);
+                (kernels->*row.kernel)(actual.data(), src.data(), count);
+                if (differs(name, row.name, count))
+                    return false;
+            }
+
+            expected = dst;
+            actual = dst;
+            scalar.expand(expected.data(), indices.data(), count, pal);
+            kernels->expand(actual.data(), indices.data(), count, pal);
+            if (differs(name, "expand", count))
+                return false;
+
+            expected = dst;
+            actual = dst;
+            scalar.expand_nibble(expected.data(), indices.data(), count, pal);
+            kernels->expand_nibble(actual.data(), indices.data(), count, pal);
+            if (differs(name, "expand_nibble", count))
+                return false;
+
+            for (const auto& span : s_span_kernels) {
+                const auto color = src[count % max_count];
+                expected = dst;
+                actual = dst;
+                (scalar_raster.*span.kernel)(expected.data(), count, color);
+                (raster->*span.kernel)(actual.data(), count, color);
+                if (differs(name, span.name, count))
+                    return false;
+            }
+        }
+        fmt::print("{} kernels match scalar\n", name);
+    }
+
+    return true;
+}
+
+int main(int argc, const char** argv) {
+    bench_options_t options{};
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    blit_init();
+    raster_init();
+    if (!verify_kernels())
+        return 1;
+    if (options.force_isa
+    &&  (!blit_select(options.isa) || !raster_select(options.isa))) {
+        fmt::print(stderr, "{} kernels are not available on this cpu\n", blit_isa_name(options.isa));
+        return 1;
+    }
+    alloc_tracker_start(alloc_mode_t::report);
+
+    const int32_t w = screen_width;
+    const int32_t h = screen_height;
+    const uint64_t pixel = sizeof(uint32_t);
+
+    std::vector<uint32_t> pixels(w * h);
+    const blit_target_t screen{pixels.data(), w, 0, 0, w, h};
+    const legacy_target_t legacy{reinterpret_cast<uint8_t*>(pixels.data()), w * 4};
+    const color_t teal{0x20, 0xd6, 0xc7, 0xff};
+    const uint32_t teal_bgra = 0xff20d6c7u;
+
+    palette_t pal{};
+    for (uint32_t i = 0; i < max_palette_entries; i++)
+        pal.entries[i].value = 0xff000000u | (i * 0x010305u);
+    palette_set(0, 0, pal.entries, max_palette_entries);
+    const auto tile_palette = palette(0);
+
+    // 16 colour indexed tile, and a direct colour tile with a transparent
+    // border for the keyed path
+    std::vector<uint8_t> tile_indices(tile_size * tile_size);
+    std::vector<uint32_t> tile_pixels(tile_size * tile_size);
+    for (int32_t y = 0; y < tile_size; y++) {
+        for (int32_t x = 0; x < tile_size; x++) {
+            const auto i = y * tile_size + x;
+            tile_indices[i] = (uint8_t) ((x ^ y) & 0x0f);
+            const auto border = x < 2 || y < 2 || x >= tile_size - 2 || y >= tile_size - 2;
+            tile_pixels[i] = border ? 0 : 0xff000000u | (uint32_t) (x * 8) << 8 | (uint32_t) (y * 8);
+        }
+    }
+
+    blit_source_t indexed_tile{};
+    indexed_tile.indices = tile_indices.data();
+    indexed_tile.palette = tile_palette;
+    indexed_tile.pitch = tile_size;
+    indexed_tile.w = tile_size;
+    indexed_tile.h = tile_size;
+    indexed_tile.nibble = true;
+
+    blit_source_t direct_tile{};
+    direct_tile.pixels = tile_pixels.data();
+    direct_tile.pitch = tile_size;
+    direct_tile.w = tile_size;
+    direct_tile.h = tile_size;
+
+    auto sprite_source = direct_tile;
+    sprite_source.w = sprite_size;
+    sprite_source.h = sprite_size;
+
+    const auto draw_tiles = [&](const blit_source_t& source, uint8_t flags) {
+        for (int32_t ty = 0; ty < h; ty += tile_size) {
+            for (int32_t tx = 0; tx < w; tx += tile_size) {
+                const blit_target_t cell{
+                    pixels.data(),
+                    w,
+                    tx,
+                    ty,
+                    std::min(tx + tile_size, w),
+                    std::min(ty + tile_size, h)};
+                blit_draw(cell, source, tx, ty, flags);
+            }
+        }
+    };
+
+    const auto hflip = (uint8_t) blit_flags_t::hflip;
+    const auto keyed = (uint8_t) blit_flags_t::keyed;
+    const auto blend = (uint8_t) blit_flags_t::blend;
+
+    // scaled images come from the image cache, as video_queue_image does
+    image_bitmap_t image{};
+    image.size = {64, 64};
+    image.pixels.resize(64 * 64);
+    for (uint32_t i = 0; i < image.pixels.size(); i++)
+        image.pixels[i] = (i & 1) ? 0x80402010u : 0xff20d6c7u;
+    image_bitmap_premultiply(image);
+
+    image_cache_t cache{};
+    image_cache_init(cache, 4 * 1024 * 1024);
+    const asset_handle_t image_id{bank_id_t{1, 1}, 1};
+    const mayhem::size_t scaled_size{160, 120};
+
+    const auto blit_image = [&](const image_bitmap_t& bitmap) {
+        blit_source_t source{};
+        source.pixels = bitmap.pixels.data();
+        source.pitch = bitmap.size.w;
+        source.w = bitmap.size.w;
+        source.h = bitmap.size.h;
+        blit_draw(screen, source, 100, 100, blend);
+    };
+
+    draw_list_t draws{};
+    draw_list_init(draws, 4096, 64 * 1024);
+
+    std::string runes(s_runes);
+    std::string paragraph(s_paragraph);
+
+    common::memory_pool<bench_particle_t> pool(1024);
+    common::frame_arena arena(64 * 1024);
+    std::vector<bench_particle_t*> particles(1024);
+
+    // what a timer_start caller typically captures: a pointer and a couple
+    // of values, 24 bytes, past std::function's 16 byte small buffer.  the
+    // registry keeps its storage across reset, so after the warmup starting
+    // timers only writes into it.
+    const uint32_t timer_count = 100'000;
+    uint64_t fired = 0;
+    const auto make_timer_callback = [&fired](uint32_t i) {
+        return [fired = &fired, repeat = i & 3, scale = (uint64_t) i](mayhem::timer_t*, game_t&) {
+            *fired += scale;
+            return repeat != 0;
+        };
+    };
+    auto game = std::make_unique<game_t>();
+    common::result timer_result{};
+    std::vector<mayhem::timer_t::timer_callback_t> inline_callbacks(timer_count);
+    std::vector<std::function<bool (mayhem::timer_t*, game_t&)>> std_callbacks(timer_count);
+
+    entt::registry registry{};
+    for (uint32_t i = 0; i < 10'000; i++) {
+        const auto entity = registry.create();
+        registry.assign<bench_position_t>(entity, (int32_t) i, (int32_t) i);
+        if ((i & 3) != 0)
+            registry.assign<bench_velocity_t>(entity, 1, -1);
+    }
+
+    // a 512x512 sheet of 32x32 direct colour tiles, the kind of payload a
+    // compressed bank entry holds
+    const int32_t sheet_size = 512;
+    std::vector<uint32_t> sheet(sheet_size * sheet_size);
+    for (int32_t y = 0; y < sheet_size; y++) {
+        for (int32_t x = 0; x < sheet_size; x++) {
+            const auto tile = (uint32_t) ((y / tile_size) * (sheet_size / tile_size) + x / tile_size);
+            const auto i = (y % tile_size) * tile_size + (x % tile_size);
+            sheet[y * sheet_size + x] = tile_pixels[i] == 0 ? 0 : tile_pixels[i] ^ (tile * 0x00050301u);
+        }
+    }
+    const auto sheet_bytes = sheet.size() * sizeof(uint32_t);
+    const auto sheet_data = reinterpret_cast<const uint8_t*>(sheet.data());
+
+    auto lz4_state = std::make_unique<common::lz4_compress_state_t>();
+    std::vector<uint8_t> block(common::lz4_compress_bound(sheet_bytes));
+    block.resize(common::lz4_compress(*lz4_state, sheet_data, sheet_bytes, block.data(), block.size()));
+    std::vector<uint8_t> packed(common::lz4_compress_bound(sheet_bytes));
+    std::vector<uint8_t> unpacked(sheet_bytes);
+    if (!common::lz4_decompress(block.data(), block.size(), unpacked.data(), unpacked.size())
+    ||  memcmp(unpacked.data(), sheet_data, sheet_bytes) != 0) {
+        fmt::print(stderr, "lz4 round trip failed\n");
+        return 1;
+    }
+
+    volatile uint64_t sink = 0;
+
+    std::vector<bench_t> benches = {
+        {
+            "video_draw_tile indexed 512x480",
+            pixel * w * h,
+            [&]() { draw_tiles(indexed_tile, 0); },
+        },
+        {
+            "video_draw_tile keyed 512x480",
+            pixel * w * h,
+            [&]() { draw_tiles(direct_tile, keyed); },
+        },
+        {
+            "video_draw_sprite x64",
+            pixel * sprite_size * sprite_size * sprite_count,
+            [&]() {
+                for (uint32_t i = 0; i < sprite_count; i++) {
+                    const auto x = (int32_t) (i * 37) % (w - sprite_size);
+                    const auto y = (int32_t) (i * 53) % (h - sprite_size);
+                    blit_draw(screen, sprite_source, x, y, (uint8_t) (keyed | ((i & 1) ? hflip : 0)));
+                }
+            },
+        },
+        {
+            "raster_hline 500",
+            pixel * 500,
+            [&]() { raster_hline(screen, 3, 200, 500, teal_bgra); },
+        },
+        {
+            "raster_hline 500 legacy",
+            pixel * 500,
+            [&]() { legacy_hline(legacy, teal, 200, 3, 500); },
+        },
+        {
+            "raster_vline 470",
+            pixel * 470,
+            [&]() { raster_vline(screen, 200, 3, 470, teal_bgra); },
+        },
+        {
+            "raster_vline 470 legacy",
+            pixel * 470,
+            [&]() { legacy_vline(legacy, teal, 3, 200, 470); },
+        },
+        {
+            "raster_box fill 256x64",
+            pixel * 256 * 64,
+            [&]() { raster_box(screen, 100, 100, 256, 64, teal_bgra, true); },
+        },
+        {
+            "raster_box fill 256x64 legacy",
+            pixel * 256 * 64,
+            [&]() { legacy_box(legacy, teal, 100, 100, 256, 64, true); },
+        },
+        {
+            "raster_box fill 512x480",
+            pixel * w * h,
+            [&]() { raster_box(screen, 0, 0, w, h, teal_bgra, true); },
+        },
+        {
+            "raster_box fill 512x480 legacy",
+            pixel * w * h,
+            [&]() { legacy_box(legacy, teal, 0, 0, w, h, true); },
+        },
+        {
+            "raster_box outline 256x64",
+            pixel * (256 * 2 + 64 * 2),
+            [&]() { raster_box(screen, 100, 100, 256, 64, teal_bgra); },
+        },
+        {
+            "raster_box outline 256x64 legacy",
+            pixel * (256 * 2 + 64 * 2),
+            [&]() { legacy_box(legacy, teal, 100, 100, 256, 64, false); },
+        },
+        {
+            "raster_box blend 256x64",
+            pixel * 256 * 64,
+            [&]() { raster_box(screen, 100, 100, 256, 64, 0x80102030u, true, true); },
+        },
+        {
+            "raster_clear 512x480",
+            pixel * w * h,
+            [&]() { raster_clear(screen, 0); },
+        },
+        {
+            "image scale 64x64 to 160x120",
+            pixel * scaled_size.w * scaled_size.h,
+            [&]() {
+                image_cache_clear(cache);
+                sink = sink + image_cache_get(cache, image_id, image, scaled_size)->pixels.size();
+            },
+        },
+        {
+            "image blit cached 160x120",
+            pixel * scaled_size.w * scaled_size.h,
+            [&]() {
+                image_cache_begin_frame(cache);
+                blit_image(*image_cache_get(cache, image_id, image, scaled_size));
+            },
+        },
+        {
+            "draw_list text x64",
+            0,
+            [&]() {
+                draw_list_reset(draws);
+                for (uint32_t i = 0; i < 64; i++) {
+                    auto command = draw_list_push(draws, draw_command_type_t::text, 0xff);
+                    draw_list_push_text(draws, command, "SCORE 0001234 HI 0098765");
+                    command->id = bank_id_t{0xff, 0};
+                    command->dest.pos = point_t{2, (int32_t) i * 8};
+                }
+                draw_list_sort(draws);
+            },
+        },
+        {
+            "lz4 compress sheet 1 MiB",
+            sheet_bytes,
+            [&]() {
+                sink = sink + common::lz4_compress(*lz4_state, sheet_data, sheet_bytes, packed.data(), packed.size());
+            },
+        },
+        {
+            "lz4 decompress sheet 1 MiB",
+            sheet_bytes,
+            [&]() {
+                common::lz4_decompress(block.data(), block.size(), unpacked.data(), unpacked.size());
+            },
+        },
+        {
+            "lz4 stream sheet 1 MiB 4k reads",
+            sheet_bytes,
+            [&]() {
+                common::lz4_stream_t stream{};
+                common::lz4_stream_init(stream, unpacked.data(), unpacked.size());
+                for (std::size_t offset = 0; offset < block.size(); offset += 4096) {
+                    const auto n = std::min<std::size_t>(4096, block.size() - offset);
+                    common::lz4_stream_decode(stream, block.data() + offset, n);
+                }
+            },
+        },
+        {
+            "utf8_decode",
+            runes.size(),
+            [&]() {
+                uint64_t total = 0;
+                auto p = runes.data();
+                auto remaining = runes.size();
+                while (remaining > 0) {
+                    const auto cp = common::utf8_decode(p, remaining);
+                    total += cp.value;
+                    p += cp.width;
+                    remaining -= cp.width;
+                }
+                sink = sink + total;
+            },
+        },
+        {
+            "utf8_strlen",
+            runes.size(),
+            [&]() { sink = sink + common::utf8_strlen(runes); },
+        },
+        {
+            "word_wrap 40",
+            paragraph.size(),
+            [&]() { sink = sink + common::word_wrap(paragraph, 40).size(); },
+        },
+        {
+            "memory_pool alloc/free x1024",
+            sizeof(bench_particle_t) * particles.size(),
+            [&]() {
+                for (auto& particle : particles)
+                    particle = pool.alloc();
+                for (auto particle : particles)
+                    pool.free(particle);
+            },
+        },
+        {
+            "frame_arena make x1024 + reset",
+            sizeof(bench_particle_t) * particles.size(),
+            [&]() {
+                for (auto& particle : particles)
+                    particle = arena.make<bench_particle_t>();
+                arena.reset();
+            },
+        },
+        {
+            "fmt::format FPS text x64",
+            64 * 7,
+            [&]() {
+                for (uint32_t i = 0; i < 64; i++)
+                    sink = sink + fmt::format("FPS:{:03}", i).size();
+            },
+        },
+        {
+            "frame_arena format FPS text x64",
+            64 * 7,
+            [&]() {
+                for (uint32_t i = 0; i < 64; i++)
+                    sink = sink + arena.format("FPS:{:03}", i).size();
+                arena.reset();
+            },
+        },
+        {
+            "std::function callback x100k",
+            0,
+            [&]() {
+                for (uint32_t i = 0; i < timer_count; i++)
+                    std_callbacks[i] = make_timer_callback(i);
+            },
+            1,
+        },
+        {
+            "inline_function callback x100k",
+            0,
+            [&]() {
+                for (uint32_t i = 0; i < timer_count; i++)
+                    inline_callbacks[i] = make_timer_callback(i);
+            },
+            1,
+        },
+        {
+            "timer_start x100k + reset",
+            0,
+            [&]() {
+                for (uint32_t i = 0; i < timer_count; i++)
+                    timer_start(timer_result, *game, 10, make_timer_callback(i));
+                game->registry.reset();
+            },
+            1,
+        },
+        {
+            "entt view<position> 10k",
+            sizeof(bench_position_t) * 10'000,
+            [&]() {
+                int64_t total = 0;
+                registry.view<bench_position_t>().each([&](auto entity, auto& position) {
+                    total += position.x + position.y;
+                });
+                sink = sink + total;
+            },
+        },
+        {
+            "entt view<position,velocity> 10k",
+            (sizeof(bench_position_t) + sizeof(bench_velocity_t)) * 7'500,
+            [&]() {
+                registry.view<bench_position_t, bench_velocity_t>().each(
+                    [](auto entity, auto& position, auto& velocity) {
+                        position.x += velocity.dx;
+                        position.y += velocity.dy;
+                    });
+            },
+        },
+    };
+
+    fmt::print(
+        "{:<34} {:>12} {:>12} {:>12} {:>8}  ({})\n",
+        "benchmark",
+        "median",
+        "p99",
+        "bandwidth",
+        "allocs",
+        blit_isa_name(blit_kernels().isa));
+
+    std::vector<bench_result_t> results{};
+    for (const auto& bench : benches) {
+        if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos)
+            continue;
+
+        const auto result = bench_run(options, bench);
+        results.push_back(result);
+
+        const auto bandwidth = result.bytes_per_second > 0
+            ? fmt::format("{:.1f} MB/s", result.bytes_per_second / 1e6)
+            : std::string("-");
+        fmt::print(
+            "{:<34} {:>9.0f} ns {:>9.0f} ns {:>12} {:>8.2f}\n",
+            result.name,
+            result.median,
+            result.p99,
+            bandwidth,
+            result.allocs);
+    }
+
+    if (!bench_write_json(options, results)) {
+        fmt::print(stderr, "unable to write {}\n", options.output);
+        return 1;
+    }
+    fmt::print("results written to {}\n", options.output);
+
+    return 0;
+}
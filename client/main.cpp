@@ -7,8 +7,10 @@
 //
 // ----------------------------------------------------------------------------
 
+#include <cstdlib>
 #include <fmt/format.h>
 #include <mayhem/game.h>
+#include "../ext/ya_getopt-1.0.0/ya_getopt.h"
 
 static void print_results(const mayhem::common::result& r) {
     auto has_messages = !r.messages().empty();
@@ -32,24 +34,116 @@ static void print_results(const mayhem::common::result& r) {
     }
 }
 
+static void print_usage() {
+    fmt::print(
+        "usage: client [options]\n"
+        "  --headless      compose frames without a display and print their hashes\n"
+        "  --frames N      stop after N frames\n"
+        "  --unthrottled   run frames back to back, ignoring the frame rate\n"
+        "  --profiler      show the frame profiler in place of the fps counter\n"
+        "  --render-rate N render and pace frames at N Hz; the simulation stays at 60 Hz\n"
+        "  --threaded      run the simulation on its own thread\n"
+        "  --no-hot-reload do not reload assets when they change on disk\n"
+        "  --track-allocs  log heap allocations per subsystem and frame on exit\n"
+        "  --assert-no-allocs\n"
+        "                  as --track-allocs, and fail on a frame that allocates in a hot section\n"
+        "  --isa NAME      draw with the scalar, sse2, ssse3 or avx2 kernels instead of the best available\n");
+}
+
+static bool parse_options(int argc, const char** argv, mayhem::game_config_t& config) {
+    enum option_t : int {
+        headless = 0x100,
+        frames,
+        unthrottled,
+        profiler,
+        render_rate,
+        threaded,
+        no_hot_reload,
+        track_allocs,
+        assert_no_allocs,
+        isa,
+    };
+    static const struct option options[] = {
+        {"headless", ya_no_argument, nullptr, option_t::headless},
+        {"frames", ya_required_argument, nullptr, option_t::frames},
+        {"unthrottled", ya_no_argument, nullptr, option_t::unthrottled},
+        {"profiler", ya_no_argument, nullptr, option_t::profiler},
+        {"render-rate", ya_required_argument, nullptr, option_t::render_rate},
+        {"threaded", ya_no_argument, nullptr, option_t::threaded},
+        {"no-hot-reload", ya_no_argument, nullptr, option_t::no_hot_reload},
+        {"track-allocs", ya_no_argument, nullptr, option_t::track_allocs},
+        {"assert-no-allocs", ya_no_argument, nullptr, option_t::assert_no_allocs},
+        {"isa", ya_required_argument, nullptr, option_t::isa},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int32_t c;
+    while ((c = ya_getopt_long(argc, (char* const*) argv, "", options, nullptr)) != -1) {
+        switch (c) {
+            case option_t::headless:
+                config.headless = true;
+                break;
+            case option_t::frames:
+                config.frame_limit = static_cast<uint32_t>(std::strtoul(ya_optarg, nullptr, 10));
+                break;
+            case option_t::unthrottled:
+                config.unthrottled = true;
+                break;
+            case option_t::profiler:
+                config.show_profiler = true;
+                break;
+            case option_t::render_rate:
+                config.render_rate = static_cast<uint32_t>(std::strtoul(ya_optarg, nullptr, 10));
+                break;
+            case option_t::threaded:
+                config.threaded = true;
+                break;
+            case option_t::no_hot_reload:
+                config.hot_reload = false;
+                break;
+            case option_t::track_allocs:
+                config.alloc_mode = mayhem::alloc_mode_t::report;
+                break;
+            case option_t::assert_no_allocs:
+                config.alloc_mode = mayhem::alloc_mode_t::assert_hot;
+                break;
+            case option_t::isa:
+                if (!mayhem::blit_isa_parse(ya_optarg, config.isa)) {
+                    fmt::print("unknown instruction set: {}\n", ya_optarg);
+                    print_usage();
+                    return false;
+                }
+                config.force_isa = true;
+                break;
+            default:
+                print_usage();
+                return false;
+        }
+    }
+
+    return true;
+}
 
 int main(int argc, const char** argv) {
     mayhem::game_t game{};
     mayhem::common::result result{};
 
+    if (!parse_options(argc, argv, game.config))
+        return 1;
+
     defer(print_results(result));
 
     if (!mayhem::game_init(result, game)) {
         return 1;
     }
 
-    if (!mayhem::game_run(result, game)) {
-        return 1;
-    }
+    // shut down after a failed run too, so the loader and render threads
+    // are joined before game goes away
+    const auto ran = mayhem::game_run(result, game);
 
     if (!mayhem::game_shutdown(result, game)) {
         return 1;
     }
 
-    return 0;
+    return ran ? 0 : 1;
 }
\ No newline at end of file
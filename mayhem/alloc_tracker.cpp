@@ -0,0 +1,259 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+#include <fmt/format.h>
+#include "log.h"
+#include "alloc_tracker.h"
+
+namespace mayhem {
+
+    static alloc_tracker_t s_tracker{};
+
+    static thread_local alloc_tag_t t_tag = alloc_tag_t::untagged;
+
+    static thread_local bool t_hot = false;
+
+    static constexpr std::string_view s_tag_names[] = {
+        "untagged",
+        "assets",
+        "input",
+        "sound",
+        "timers",
+        "state",
+        "draw",
+        "video",
+    };
+
+    static_assert(sizeof(s_tag_names) / sizeof(s_tag_names[0]) == alloc_tag_count);
+
+    // runs inside operator new, so it must not allocate
+    static void alloc_tracker_record(std::size_t size) {
+        const auto mode = s_tracker.mode.load(std::memory_order_relaxed);
+        if (mode == alloc_mode_t::off)
+            return;
+
+        const auto tag = static_cast<uint32_t>(t_tag);
+        s_tracker.current_count[tag].fetch_add(1, std::memory_order_relaxed);
+        s_tracker.current_bytes[tag].fetch_add(size, std::memory_order_relaxed);
+
+        if (t_hot && mode == alloc_mode_t::assert_hot) {
+            if (s_tracker.hot_violations.fetch_add(1, std::memory_order_relaxed) == 0) {
+                s_tracker.first_violation_size.store(size, std::memory_order_relaxed);
+                s_tracker.first_violation_tag.store(t_tag, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static void* alloc_tracker_allocate(std::size_t size) {
+        alloc_tracker_record(size);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    static void* alloc_tracker_allocate_aligned(std::size_t size, std::size_t align) {
+        alloc_tracker_record(size);
+        void* data = nullptr;
+        if (posix_memalign(&data, std::max(align, sizeof(void*)), size == 0 ? 1 : size) != 0)
+            return nullptr;
+        return data;
+    }
+
+    static double per_frame(uint64_t value, uint64_t frames) {
+        return frames == 0 ? 0.0 : static_cast<double>(value) / static_cast<double>(frames);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    alloc_scope_t::alloc_scope_t(alloc_tag_t tag, bool hot) : previous_tag(t_tag),
+                                                              previous_hot(t_hot) {
+        t_tag = tag;
+        t_hot = hot;
+    }
+
+    alloc_scope_t::~alloc_scope_t() {
+        t_tag = previous_tag;
+        t_hot = previous_hot;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    alloc_tracker_t& alloc_tracker() {
+        return s_tracker;
+    }
+
+    void alloc_tracker_start(alloc_mode_t mode) {
+        for (uint32_t i = 0; i < alloc_tag_count; i++) {
+            s_tracker.current_count[i].store(0, std::memory_order_relaxed);
+            s_tracker.current_bytes[i].store(0, std::memory_order_relaxed);
+            s_tracker.stats[i] = alloc_tag_stats_t{};
+        }
+        s_tracker.hot_violations.store(0, std::memory_order_relaxed);
+        s_tracker.frames = 0;
+        s_tracker.mode.store(mode, std::memory_order_release);
+    }
+
+    bool alloc_tracker_end_frame(common::result& r) {
+        const auto mode = s_tracker.mode.load(std::memory_order_relaxed);
+        if (mode == alloc_mode_t::off)
+            return true;
+
+        for (uint32_t i = 0; i < alloc_tag_count; i++) {
+            auto& stats = s_tracker.stats[i];
+            stats.last_frame.count = s_tracker.current_count[i].exchange(0, std::memory_order_relaxed);
+            stats.last_frame.bytes = s_tracker.current_bytes[i].exchange(0, std::memory_order_relaxed);
+            stats.total.count += stats.last_frame.count;
+            stats.total.bytes += stats.last_frame.bytes;
+            stats.max_frame.count = std::max(stats.max_frame.count, stats.last_frame.count);
+            stats.max_frame.bytes = std::max(stats.max_frame.bytes, stats.last_frame.bytes);
+        }
+        s_tracker.frames++;
+
+        const auto violations = s_tracker.hot_violations.exchange(0, std::memory_order_relaxed);
+        if (violations == 0)
+            return true;
+
+        r.error("G600", fmt::format(
+            "frame {}: {} allocations in hot sections, the first {} bytes in {}",
+            s_tracker.frames - 1,
+            violations,
+            s_tracker.first_violation_size.load(std::memory_order_relaxed),
+            alloc_tag_name(s_tracker.first_violation_tag.load(std::memory_order_relaxed))));
+        return false;
+    }
+
+    alloc_counts_t alloc_tracker_pending() {
+        alloc_counts_t pending{};
+        for (uint32_t i = 0; i < alloc_tag_count; i++) {
+            pending.count += s_tracker.current_count[i].load(std::memory_order_relaxed);
+            pending.bytes += s_tracker.current_bytes[i].load(std::memory_order_relaxed);
+        }
+        return pending;
+    }
+
+    std::string_view alloc_tag_name(alloc_tag_t tag) {
+        return s_tag_names[static_cast<uint32_t>(tag)];
+    }
+
+    void alloc_tracker_log_report() {
+        if (s_tracker.mode.load(std::memory_order_relaxed) == alloc_mode_t::off)
+            return;
+
+        const auto frames = s_tracker.frames;
+        log_message(log_category_t::app, "allocations over {} frames:", frames);
+        for (uint32_t i = 0; i < alloc_tag_count; i++) {
+            const auto& stats = s_tracker.stats[i];
+            if (stats.total.count == 0)
+                continue;
+            log_message(
+                log_category_t::app,
+                "  {:<8} {:>9.1f} allocs {:>11.1f} bytes per frame; worst {} allocs {} bytes; total {} allocs {} bytes",
+                alloc_tag_name(static_cast<alloc_tag_t>(i)),
+                per_frame(stats.total.count, frames),
+                per_frame(stats.total.bytes, frames),
+                stats.max_frame.count,
+                stats.max_frame.bytes,
+                stats.total.count,
+                stats.total.bytes);
+        }
+    }
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// the replaceable global allocation functions.  the array, nothrow and
+// aligned forms all come through here as well, so nothing escapes the count.
+
+void* operator new(std::size_t size) {
+    auto data = mayhem::alloc_tracker_allocate(size);
+    if (data == nullptr)
+        throw std::bad_alloc();
+    return data;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return mayhem::alloc_tracker_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return mayhem::alloc_tracker_allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    auto data = mayhem::alloc_tracker_allocate_aligned(size, static_cast<std::size_t>(align));
+    if (data == nullptr)
+        throw std::bad_alloc();
+    return data;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return mayhem::alloc_tracker_allocate_aligned(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return mayhem::alloc_tracker_allocate_aligned(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* data) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, std::size_t) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, std::size_t) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, const std::nothrow_t&) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, const std::nothrow_t&) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, std::align_val_t) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, std::align_val_t) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, std::size_t, std::align_val_t) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, std::size_t, std::align_val_t) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(data);
+}
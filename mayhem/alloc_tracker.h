@@ -0,0 +1,96 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <common/result.h>
+
+namespace mayhem {
+
+    // the subsystem an allocation is charged to; set per thread by
+    // alloc_scope_t, so work handed to other threads is untagged.
+    enum class alloc_tag_t : uint8_t {
+        untagged,
+        assets,
+        input,
+        sound,
+        timers,
+        state,
+        draw,
+        video,
+        count
+    };
+
+    static constexpr uint32_t alloc_tag_count = static_cast<uint32_t>(alloc_tag_t::count);
+
+    enum class alloc_mode_t : uint8_t {
+        off,
+        report,
+        // as report, and an allocation inside a hot scope fails the frame
+        assert_hot
+    };
+
+    struct alloc_counts_t {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+
+    struct alloc_tag_stats_t {
+        alloc_counts_t total{};
+        alloc_counts_t last_frame{};
+        alloc_counts_t max_frame{};
+    };
+
+    // every operator new in the process goes through the tracker; while the
+    // mode is off that costs one relaxed load.  counts accumulate from any
+    // thread during a frame and are folded into the stats by
+    // alloc_tracker_end_frame.
+    struct alloc_tracker_t {
+        std::atomic<alloc_mode_t> mode{alloc_mode_t::off};
+        std::atomic<uint64_t> current_count[alloc_tag_count]{};
+        std::atomic<uint64_t> current_bytes[alloc_tag_count]{};
+        std::atomic<uint64_t> hot_violations{0};
+        std::atomic<uint64_t> first_violation_size{0};
+        std::atomic<alloc_tag_t> first_violation_tag{alloc_tag_t::untagged};
+        uint64_t frames = 0;
+        alloc_tag_stats_t stats[alloc_tag_count]{};
+    };
+
+    // charges allocations on this thread to tag until it goes out of scope.
+    // a hot scope marks a section that must not allocate at all.
+    struct alloc_scope_t {
+        explicit alloc_scope_t(alloc_tag_t tag, bool hot = false);
+
+        ~alloc_scope_t();
+
+        alloc_tag_t previous_tag;
+        bool previous_hot;
+    };
+
+    alloc_tracker_t& alloc_tracker();
+
+    void alloc_tracker_start(alloc_mode_t mode);
+
+    // folds the frame's counts into the stats; in assert_hot mode, false
+    // with the first hot allocation in r if any happened this frame.
+    bool alloc_tracker_end_frame(common::result& r);
+
+    // everything counted since the last end_frame, across all tags
+    alloc_counts_t alloc_tracker_pending();
+
+    std::string_view alloc_tag_name(alloc_tag_t tag);
+
+    // one line per tag with allocations: per-frame average, worst frame
+    // and totals
+    void alloc_tracker_log_report();
+
+}
@@ -0,0 +1,280 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "game.h"
+#include "bitmap_font.h"
+#include "asset_loader.h"
+
+namespace mayhem {
+
+    static bool asset_loader_decode(asset_load_t& load) {
+        switch (load.kind) {
+            case asset_kind_t::image:
+                return image_decode(load.result, load.path, load.format, load.image);
+            case asset_kind_t::font:
+                return bitmap_font_load(
+                    load.result,
+                    load.path,
+                    load.font.size,
+                    load.font.style,
+                    load.font.font);
+        }
+        return false;
+    }
+
+    static void asset_loader_worker(asset_loader_t& loader) {
+        std::unique_lock<std::mutex> lock(loader.mutex);
+        for (;;) {
+            loader.wake.wait(lock, [&]() { return loader.quit || !loader.queue.empty(); });
+            if (loader.quit)
+                return;
+
+            auto load = loader.queue.front();
+            loader.queue.pop_front();
+            load->state.store(asset_load_state_t::decoding, std::memory_order_relaxed);
+            lock.unlock();
+
+            const auto decoded = asset_loader_decode(*load);
+
+            lock.lock();
+            load->state.store(
+                decoded ? asset_load_state_t::decoded : asset_load_state_t::failed,
+                std::memory_order_relaxed);
+            loader.completed.push_back(load);
+            loader.done.notify_all();
+        }
+    }
+
+    template <typename F>
+    static asset_load_handle_t asset_loader_push(asset_loader_t& loader, F&& setup) {
+        asset_load_handle_t handle;
+        {
+            std::lock_guard<std::mutex> lock(loader.mutex);
+            handle = (asset_load_handle_t) loader.loads.size();
+            auto& load = loader.loads.emplace_back();
+            setup(load);
+            loader.queue.push_back(&load);
+            loader.total.fetch_add(1, std::memory_order_release);
+        }
+        loader.wake.notify_one();
+        return handle;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    void asset_loader_init(asset_loader_t& loader, uint32_t threads) {
+        threads = std::max<uint32_t>(threads, 1);
+        loader.threads.reserve(threads);
+        for (uint32_t i = 0; i < threads; i++)
+            loader.threads.emplace_back([&loader]() { asset_loader_worker(loader); });
+    }
+
+    void asset_loader_shutdown(asset_loader_t& loader) {
+        {
+            std::lock_guard<std::mutex> lock(loader.mutex);
+            loader.quit = true;
+        }
+        loader.wake.notify_all();
+        for (auto& thread : loader.threads)
+            thread.join();
+        loader.threads.clear();
+
+        for (auto load : loader.completed) {
+            if (load->kind == asset_kind_t::image)
+                image_free(load->image);
+        }
+        loader.completed.clear();
+        loader.queue.clear();
+        loader.reloads.clear();
+    }
+
+    asset_load_handle_t asset_loader_queue_image(
+            asset_loader_t& loader,
+            const std::string& path,
+            int32_t format,
+            bank_id_t id) {
+        return asset_loader_push(loader, [&](asset_load_t& load) {
+            load.kind = asset_kind_t::image;
+            load.path = path;
+            load.format = format;
+            load.id = id;
+        });
+    }
+
+    asset_load_handle_t asset_loader_queue_font(
+            asset_loader_t& loader,
+            const std::string& path,
+            uint32_t size,
+            uint8_t style,
+            color_t color,
+            bank_id_t id) {
+        return asset_loader_push(loader, [&](asset_load_t& load) {
+            load.kind = asset_kind_t::font;
+            load.path = path;
+            load.font.size = size;
+            load.font.style = style;
+            load.font.color = color;
+            load.id = id;
+        });
+    }
+
+    bool asset_loader_update(common::result& r, asset_loader_t& loader) {
+        std::vector<asset_load_t*> completed{};
+        {
+            std::lock_guard<std::mutex> lock(loader.mutex);
+            if (loader.completed.empty())
+                return true;
+            completed.swap(loader.completed);
+        }
+
+        std::unique_lock<std::mutex> store_lock{};
+        if (loader.store_mutex != nullptr)
+            store_lock = std::unique_lock<std::mutex>(*loader.store_mutex);
+
+        auto success = true;
+        for (auto load : completed) {
+            auto stored = load->state.load(std::memory_order_relaxed) == asset_load_state_t::decoded;
+            if (stored) {
+                switch (load->kind) {
+                    case asset_kind_t::image:
+                        stored = image_store(load->result, load->id, load->image);
+                        break;
+                    case asset_kind_t::font:
+                        font_store(load->id, load->font);
+                        break;
+                }
+            }
+
+            if (!stored) {
+                load->state.store(asset_load_state_t::failed, std::memory_order_release);
+                loader.failed.fetch_add(1, std::memory_order_release);
+                if (load->reload) {
+                    for (const auto& message : load->result.messages())
+                        log_warn(log_category_t::app, "reload {}: {}", load->path, message.message());
+                    continue;
+                }
+                r.append(load->result);
+                success = false;
+                continue;
+            }
+
+            load->state.store(asset_load_state_t::ready, std::memory_order_release);
+            loader.ready.fetch_add(1, std::memory_order_release);
+        }
+
+        // nothing hands out a handle to a reload, so it is done with here
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.reloads.remove_if([&](const asset_load_t& load) {
+            return std::find(completed.begin(), completed.end(), &load) != completed.end();
+        });
+
+        return success;
+    }
+
+    bool asset_loader_wait(common::result& r, asset_loader_t& loader, asset_load_handle_t handle) {
+        for (;;) {
+            if (!asset_loader_update(r, loader))
+                return false;
+
+            const auto state = asset_loader_state(loader, handle);
+            if (state == asset_load_state_t::ready)
+                return true;
+            if (state == asset_load_state_t::failed)
+                return false;
+
+            std::unique_lock<std::mutex> lock(loader.mutex);
+            loader.done.wait(lock, [&]() { return !loader.completed.empty(); });
+        }
+    }
+
+    bool asset_loader_wait(common::result& r, asset_loader_t& loader) {
+        for (;;) {
+            if (!asset_loader_update(r, loader))
+                return false;
+
+            const auto progress = asset_loader_progress(loader);
+            if (progress.ready + progress.failed == progress.total)
+                return true;
+
+            std::unique_lock<std::mutex> lock(loader.mutex);
+            loader.done.wait(lock, [&]() { return !loader.completed.empty(); });
+        }
+    }
+
+    bool asset_loader_watch(common::result& r, asset_loader_t& loader, file_watch_t& watch) {
+        std::vector<std::string> paths{};
+        {
+            std::lock_guard<std::mutex> lock(loader.mutex);
+            for (; loader.watched < loader.loads.size(); loader.watched++)
+                paths.push_back(loader.loads[loader.watched].path);
+        }
+
+        for (const auto& path : paths) {
+            if (!file_watch_add(r, watch, path))
+                return false;
+        }
+        return true;
+    }
+
+    uint32_t asset_loader_reload(asset_loader_t& loader, const std::string& path) {
+        // the newest load of each id wins, since that is what is stored
+        std::vector<const asset_load_t*> originals{};
+        {
+            std::lock_guard<std::mutex> lock(loader.mutex);
+            for (auto it = loader.loads.rbegin(); it != loader.loads.rend(); ++it) {
+                if (it->path != path)
+                    continue;
+
+                const auto seen = std::any_of(
+                    originals.begin(),
+                    originals.end(),
+                    [&](const asset_load_t* original) {
+                        return original->id.bank == it->id.bank
+                            && original->id.index == it->id.index;
+                    });
+                if (!seen)
+                    originals.push_back(&*it);
+            }
+
+            for (auto original : originals) {
+                auto& load = loader.reloads.emplace_back();
+                load.kind = original->kind;
+                load.path = path;
+                load.id = original->id;
+                load.format = original->format;
+                load.font.size = original->font.size;
+                load.font.style = original->font.style;
+                load.font.color = original->font.color;
+                load.reload = true;
+                loader.queue.push_back(&load);
+                loader.total.fetch_add(1, std::memory_order_release);
+            }
+        }
+        loader.wake.notify_all();
+
+        return (uint32_t) originals.size();
+    }
+
+    asset_load_state_t asset_loader_state(asset_loader_t& loader, asset_load_handle_t handle) {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        if (handle >= loader.loads.size())
+            return asset_load_state_t::failed;
+        return loader.loads[handle].state.load(std::memory_order_acquire);
+    }
+
+    asset_loader_progress_t asset_loader_progress(const asset_loader_t& loader) {
+        asset_loader_progress_t progress{};
+        progress.ready = loader.ready.load(std::memory_order_acquire);
+        progress.failed = loader.failed.load(std::memory_order_acquire);
+        progress.total = loader.total.load(std::memory_order_acquire);
+        return progress;
+    }
+
+}
@@ -0,0 +1,134 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <common/result.h>
+#include "video.h"
+#include "file_watch.h"
+
+namespace mayhem {
+
+    enum class asset_kind_t : uint8_t {
+        image,
+        font
+    };
+
+    // queued -> decoding -> decoded on a loader thread, then ready or failed
+    // once asset_loader_update has run the main thread half on the main
+    // thread.  a load that fails to decode goes straight to failed.
+    enum class asset_load_state_t : uint8_t {
+        queued,
+        decoding,
+        decoded,
+        ready,
+        failed
+    };
+
+    struct asset_load_t {
+        asset_kind_t kind = asset_kind_t::image;
+        std::string path{};
+        bank_id_t id{};
+        int32_t format = 0;
+        bool reload = false;
+        image_t image{};
+        font_data_t font{};
+        common::result result{};
+        std::atomic<asset_load_state_t> state{asset_load_state_t::queued};
+    };
+
+    using asset_load_handle_t = uint32_t;
+
+    struct asset_loader_progress_t {
+        uint32_t total = 0;
+        uint32_t ready = 0;
+        uint32_t failed = 0;
+    };
+
+    // loads are decoded by a fixed set of threads that sleep while the queue
+    // is empty; the steps that touch the asset tables, or SDL, are handed
+    // back through completed and run by asset_loader_update on the main
+    // thread, between rendered frames.  the simulation thread reads the same
+    // tables, so when store_mutex is set the stores are made holding it and
+    // a simulated frame never sees an asset change either.  loads lives in a
+    // deque so each load keeps its address while more are queued; reloads
+    // are kept apart, in a list, and dropped once they are stored or fail.
+    struct asset_loader_t {
+        std::mutex mutex{};
+        bool quit = false;
+        std::deque<asset_load_t> loads{};
+        std::list<asset_load_t> reloads{};
+        std::deque<asset_load_t*> queue{};
+        std::vector<asset_load_t*> completed{};
+        std::size_t watched = 0;
+        std::condition_variable wake{};
+        std::condition_variable done{};
+        std::vector<std::thread> threads{};
+        std::mutex* store_mutex = nullptr;
+        std::atomic<uint32_t> total{0};
+        std::atomic<uint32_t> ready{0};
+        std::atomic<uint32_t> failed{0};
+    };
+
+    void asset_loader_init(asset_loader_t& loader, uint32_t threads);
+
+    // waits for loads being decoded, drops the rest and frees anything
+    // decoded but not yet stored
+    void asset_loader_shutdown(asset_loader_t& loader);
+
+    asset_load_handle_t asset_loader_queue_image(
+        asset_loader_t& loader,
+        const std::string& path,
+        int32_t format,
+        bank_id_t id);
+
+    asset_load_handle_t asset_loader_queue_font(
+        asset_loader_t& loader,
+        const std::string& path,
+        uint32_t size,
+        uint8_t style,
+        color_t color,
+        bank_id_t id);
+
+    // main thread only: stores every load decoded since the last call.
+    // false, with the load's messages in r, if any of them failed other
+    // than a reload.
+    bool asset_loader_update(common::result& r, asset_loader_t& loader);
+
+    // main thread only: runs asset_loader_update until handle is ready or
+    // failed
+    bool asset_loader_wait(common::result& r, asset_loader_t& loader, asset_load_handle_t handle);
+
+    // main thread only: runs asset_loader_update until nothing is queued
+    bool asset_loader_wait(common::result& r, asset_loader_t& loader);
+
+    // main thread only: adds the paths of loads queued since the last call
+    bool asset_loader_watch(common::result& r, asset_loader_t& loader, file_watch_t& watch);
+
+    // queues every asset last loaded from path again, to be stored over the
+    // old one by asset_loader_update; returns how many were queued.  a
+    // reload that fails is logged and leaves the old asset in place.
+    uint32_t asset_loader_reload(asset_loader_t& loader, const std::string& path);
+
+    asset_load_state_t asset_loader_state(asset_loader_t& loader, asset_load_handle_t handle);
+
+    // safe from any thread; a load counts towards ready only once it has
+    // been stored, so ready + failed == total means every asset is usable
+    asset_loader_progress_t asset_loader_progress(const asset_loader_t& loader);
+
+}
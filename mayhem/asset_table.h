@@ -0,0 +1,145 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include "types.h"
+
+namespace mayhem {
+
+    static constexpr uint32_t asset_bank_count = 256;
+
+    // generation is the one the slot had when the handle was taken; storing
+    // or releasing the asset again bumps it, so old handles stop resolving.
+    // generation zero never names an asset.
+    struct asset_handle_t {
+        bank_id_t id{};
+        uint32_t generation = 0;
+    };
+
+    template <typename T>
+    struct asset_slot_t {
+        uint32_t generation = 0;
+        bool used = false;
+        T value{};
+    };
+
+    // a dense two-level table: bank_id_t::bank picks one of 256 banks and
+    // bank_id_t::index the slot within it.  banks are created on first use
+    // and grow to their highest index; a deque never moves its elements
+    // when it grows, so pointers to stored assets stay valid until the slot
+    // is released or stored again.
+    template <typename T>
+    struct asset_table_t {
+        std::unique_ptr<std::deque<asset_slot_t<T>>> banks[asset_bank_count]{};
+    };
+
+    template <typename T>
+    asset_slot_t<T>* asset_slot(asset_table_t<T>& table, bank_id_t id) {
+        const auto& bank = table.banks[id.bank];
+        if (bank == nullptr || id.index >= bank->size())
+            return nullptr;
+        return &(*bank)[id.index];
+    }
+
+    template <typename T>
+    const asset_slot_t<T>* asset_slot(const asset_table_t<T>& table, bank_id_t id) {
+        const auto& bank = table.banks[id.bank];
+        if (bank == nullptr || id.index >= bank->size())
+            return nullptr;
+        return &(*bank)[id.index];
+    }
+
+    template <typename T>
+    T* asset_find(asset_table_t<T>& table, bank_id_t id) {
+        auto slot = asset_slot(table, id);
+        if (slot == nullptr || !slot->used)
+            return nullptr;
+        return &slot->value;
+    }
+
+    // replaces whatever was stored at id with a default T
+    template <typename T>
+    T& asset_store(asset_table_t<T>& table, bank_id_t id) {
+        auto& bank = table.banks[id.bank];
+        if (bank == nullptr)
+            bank = std::make_unique<std::deque<asset_slot_t<T>>>();
+        if (id.index >= bank->size())
+            bank->resize(id.index + 1);
+
+        auto& slot = (*bank)[id.index];
+        ++slot.generation;
+        slot.used = true;
+        slot.value = T{};
+        return slot.value;
+    }
+
+    template <typename T>
+    void asset_release(asset_table_t<T>& table, bank_id_t id) {
+        auto slot = asset_slot(table, id);
+        if (slot == nullptr || !slot->used)
+            return;
+        ++slot->generation;
+        slot->used = false;
+        slot->value = T{};
+    }
+
+    template <typename T>
+    asset_handle_t asset_handle(const asset_table_t<T>& table, bank_id_t id) {
+        auto slot = asset_slot(table, id);
+        if (slot == nullptr || !slot->used)
+            return asset_handle_t{id, 0};
+        return asset_handle_t{id, slot->generation};
+    }
+
+    // nullptr when the handle is stale
+    template <typename T>
+    T* asset_resolve(asset_table_t<T>& table, asset_handle_t handle) {
+        auto slot = asset_slot(table, handle.id);
+        if (slot == nullptr || !slot->used || slot->generation != handle.generation)
+            return nullptr;
+        return &slot->value;
+    }
+
+    // visits f(id, value) for every stored asset
+    template <typename T, typename F>
+    void asset_for_each(asset_table_t<T>& table, F&& f) {
+        for (uint32_t b = 0; b < asset_bank_count; b++) {
+            auto& bank = table.banks[b];
+            if (bank == nullptr)
+                continue;
+            for (std::size_t i = 0; i < bank->size(); i++) {
+                auto& slot = (*bank)[i];
+                if (slot.used)
+                    f(bank_id_t{(uint8_t) b, (uint16_t) i}, slot.value);
+            }
+        }
+    }
+
+    // releases every slot but keeps the banks, so handles taken before the
+    // clear stay stale after the ids are stored again
+    template <typename T>
+    void asset_clear(asset_table_t<T>& table) {
+        for (auto& bank : table.banks) {
+            if (bank == nullptr)
+                continue;
+            for (auto& slot : *bank) {
+                if (!slot.used)
+                    continue;
+                ++slot.generation;
+                slot.used = false;
+                slot.value = T{};
+            }
+        }
+    }
+
+}
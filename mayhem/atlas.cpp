@@ -0,0 +1,382 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <fmt/format.h>
+#include <common/bytes.h>
+#include "log.h"
+#include "atlas.h"
+
+namespace mayhem {
+
+    static constexpr uint32_t alpha_mask = 0xff000000;
+
+    static constexpr uint16_t unpacked_page = 0xffff;
+
+    static uint32_t make_frame_key(bank_id_t id) {
+        return ((uint32_t) id.bank << 16) | id.index;
+    }
+
+    // the smallest rectangle of the cell holding a pixel with non-zero alpha
+    static rect_t trim_cell(const uint32_t* cell, int32_t pitch, size_t size) {
+        int32_t left = size.w;
+        int32_t top = size.h;
+        int32_t right = 0;
+        int32_t bottom = 0;
+        for (int32_t y = 0; y < size.h; y++) {
+            const auto row = cell + y * pitch;
+            for (int32_t x = 0; x < size.w; x++) {
+                if ((row[x] & alpha_mask) == 0)
+                    continue;
+                left = std::min(left, x);
+                right = std::max(right, x + 1);
+                top = std::min(top, y);
+                bottom = std::max(bottom, y + 1);
+            }
+        }
+        if (left >= right)
+            return rect_t{};
+        return rect_t{{left, top}, {right - left, bottom - top}};
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    // bottom-left skyline: the lowest resting place for a w x h rectangle,
+    // ties broken by the narrower segment.  false when it does not fit.
+    static bool skyline_find(
+            const atlas_page_t& page,
+            int32_t w,
+            int32_t h,
+            uint32_t& best_index,
+            point_t& best_pos) {
+        auto best_bottom = page.size.h + 1;
+        auto best_width = page.size.w + 1;
+        bool found = false;
+
+        for (uint32_t i = 0; i < page.skyline.size(); i++) {
+            const auto x = page.skyline[i].x;
+            if (x + w > page.size.w)
+                break;
+
+            // the rectangle rests on the highest segment it spans
+            int32_t y = 0;
+            int32_t remaining = w;
+            for (auto j = i; j < page.skyline.size() && remaining > 0; j++) {
+                y = std::max(y, page.skyline[j].y);
+                remaining -= page.skyline[j].w;
+            }
+            if (y + h > page.size.h)
+                continue;
+
+            if (y + h < best_bottom
+            || (y + h == best_bottom && page.skyline[i].w < best_width)) {
+                found = true;
+                best_index = i;
+                best_pos = point_t{x, y};
+                best_bottom = y + h;
+                best_width = page.skyline[i].w;
+            }
+        }
+
+        return found;
+    }
+
+    static void skyline_insert(atlas_page_t& page, uint32_t index, const rect_t& rect) {
+        auto& skyline = page.skyline;
+        skyline.insert(
+            skyline.begin() + index,
+            atlas_skyline_t{rect.pos.x, rect.pos.y + rect.size.h, rect.size.w});
+
+        // segments now under the new one are shortened or removed
+        const auto right = rect.pos.x + rect.size.w;
+        auto i = index + 1;
+        while (i < skyline.size() && skyline[i].x < right) {
+            const auto shrink = right - skyline[i].x;
+            if (shrink < skyline[i].w) {
+                skyline[i].x += shrink;
+                skyline[i].w -= shrink;
+                break;
+            }
+            skyline.erase(skyline.begin() + i);
+        }
+
+        for (i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].w += skyline[i + 1].w;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    static bool page_released(const atlas_page_t& page) {
+        return page.size.w == 0;
+    }
+
+    // a released slot is reused before the page list grows
+    static uint32_t page_open(atlas_t& atlas) {
+        auto it = std::find_if(atlas.pages.begin(), atlas.pages.end(), page_released);
+        const auto index = (uint32_t) (it - atlas.pages.begin());
+        if (it == atlas.pages.end())
+            atlas.pages.emplace_back();
+
+        auto& page = atlas.pages[index];
+        page.size = size_t{atlas.page_size, atlas.page_size};
+        page.pixels.assign(atlas.page_size * atlas.page_size, 0);
+        page.skyline.assign(1, atlas_skyline_t{0, 0, atlas.page_size});
+        return index;
+    }
+
+    // drops the unused right and bottom of a page, keeping power-of-two sides
+    static void page_shrink(atlas_page_t& page) {
+        int32_t used_w = 0;
+        int32_t used_h = 0;
+        for (const auto& segment : page.skyline) {
+            if (segment.y == 0)
+                continue;
+            used_w = std::max(used_w, segment.x + segment.w);
+            used_h = std::max(used_h, segment.y);
+        }
+
+        const auto w = std::min((int32_t) common::next_power_of_two((uint32_t) std::max(used_w, 1)), page.size.w);
+        const auto h = std::min((int32_t) common::next_power_of_two((uint32_t) std::max(used_h, 1)), page.size.h);
+        if (w == page.size.w && h == page.size.h)
+            return;
+
+        std::vector<uint32_t> pixels(w * h);
+        for (int32_t y = 0; y < h; y++)
+            memcpy(&pixels[y * w], &page.pixels[y * page.size.w], w * sizeof(uint32_t));
+        page.pixels = std::move(pixels);
+        page.size = size_t{w, h};
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    void atlas_init(atlas_t& atlas, int32_t page_size) {
+        atlas.page_size = (int32_t) common::next_power_of_two((uint32_t) std::max(page_size, 1));
+        atlas.pages.clear();
+        atlas.frames.clear();
+        atlas.staged.clear();
+        atlas.staged_offsets.clear();
+        atlas.lookup.clear();
+    }
+
+    bool atlas_add_sheet(
+            common::result& r,
+            atlas_t& atlas,
+            const uint32_t* pixels,
+            size_t sheet_size,
+            size_t frame_size,
+            bank_id_t first_id,
+            uint32_t& count) {
+        count = 0;
+        if (frame_size.w <= 0
+        ||  frame_size.h <= 0
+        ||  frame_size.w > sheet_size.w
+        ||  frame_size.h > sheet_size.h) {
+            r.error("V007", fmt::format(
+                "invalid atlas frame size {}x{} for sheet {}x{}",
+                frame_size.w,
+                frame_size.h,
+                sheet_size.w,
+                sheet_size.h));
+            return false;
+        }
+
+        const auto columns = sheet_size.w / frame_size.w;
+        const auto rows = sheet_size.h / frame_size.h;
+        if (first_id.index + columns * rows > 0x10000) {
+            r.error("V007", fmt::format(
+                "atlas sheet needs {} frames from {}:{}",
+                columns * rows,
+                first_id.bank,
+                first_id.index));
+            return false;
+        }
+
+        for (int32_t i = 0; i < columns * rows; i++) {
+            const auto id = bank_id_t{first_id.bank, (uint16_t) (first_id.index + i)};
+            if (atlas.lookup.count(make_frame_key(id)) != 0) {
+                r.error("V007", fmt::format("duplicate atlas frame: {}:{}", id.bank, id.index));
+                return false;
+            }
+        }
+
+        for (int32_t row = 0; row < rows; row++) {
+            for (int32_t column = 0; column < columns; column++) {
+                const auto cell = pixels
+                    + row * frame_size.h * sheet_size.w
+                    + column * frame_size.w;
+                const auto trim = trim_cell(cell, sheet_size.w, frame_size);
+
+                atlas_frame_t frame{};
+                frame.id = bank_id_t{first_id.bank, (uint16_t) (first_id.index + count)};
+                frame.page = unpacked_page;
+                frame.rect.size = trim.size;
+                frame.trim = trim.pos;
+                frame.size = frame_size;
+
+                atlas.lookup[make_frame_key(frame.id)] = (uint32_t) atlas.frames.size();
+                atlas.frames.push_back(frame);
+                atlas.staged_offsets.push_back((uint32_t) atlas.staged.size());
+                for (int32_t y = 0; y < trim.size.h; y++) {
+                    const auto src = cell + (trim.pos.y + y) * sheet_size.w + trim.pos.x;
+                    atlas.staged.insert(atlas.staged.end(), src, src + trim.size.w);
+                }
+                count++;
+            }
+        }
+
+        return true;
+    }
+
+    bool atlas_build(common::result& r, atlas_t& atlas) {
+        // the pages opened by this build, in the order they were opened
+        std::vector<uint32_t> opened{};
+
+        // staged_offsets only covers frames added since the last build
+        const auto first_frame = (uint32_t) (atlas.frames.size() - atlas.staged_offsets.size());
+        std::vector<uint32_t> order(atlas.staged_offsets.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+            const auto& a = atlas.frames[first_frame + lhs].rect.size;
+            const auto& b = atlas.frames[first_frame + rhs].rect.size;
+            return a.h != b.h ? a.h > b.h : a.w > b.w;
+        });
+
+        for (auto staged_index : order) {
+            auto& frame = atlas.frames[first_frame + staged_index];
+            const auto w = frame.rect.size.w;
+            const auto h = frame.rect.size.h;
+            if (w == 0 || h == 0) {
+                frame.page = 0;
+                continue;
+            }
+            if (w > atlas.page_size || h > atlas.page_size) {
+                r.error("V007", fmt::format(
+                    "atlas frame {}:{} is larger than a {} page",
+                    frame.id.bank,
+                    frame.id.index,
+                    atlas.page_size));
+                return false;
+            }
+
+            uint32_t skyline_index = 0;
+            point_t pos{};
+            uint32_t page_index = 0;
+            for (uint32_t i = 0;; i++) {
+                if (i == opened.size())
+                    opened.push_back(page_open(atlas));
+                page_index = opened[i];
+                if (skyline_find(atlas.pages[page_index], w, h, skyline_index, pos))
+                    break;
+            }
+
+            auto& page = atlas.pages[page_index];
+            frame.page = (uint16_t) page_index;
+            frame.rect.pos = pos;
+            skyline_insert(page, skyline_index, frame.rect);
+
+            const auto src = atlas.staged.data() + atlas.staged_offsets[staged_index];
+            for (int32_t y = 0; y < h; y++) {
+                memcpy(
+                    &page.pixels[(pos.y + y) * page.size.w + pos.x],
+                    src + y * w,
+                    w * sizeof(uint32_t));
+            }
+        }
+
+        for (auto page_index : opened) {
+            auto& page = atlas.pages[page_index];
+            page_shrink(page);
+            page.skyline.clear();
+            page.skyline.shrink_to_fit();
+        }
+
+        log_message(
+            log_category_t::video,
+            "atlas: packed {} frames into {} new pages",
+            order.size(),
+            opened.size());
+
+        atlas.staged.clear();
+        atlas.staged.shrink_to_fit();
+        atlas.staged_offsets.clear();
+
+        return true;
+    }
+
+    const atlas_frame_t* atlas_find(const atlas_t& atlas, bank_id_t id) {
+        auto it = atlas.lookup.find(make_frame_key(id));
+        if (it == std::end(atlas.lookup))
+            return nullptr;
+        const auto& frame = atlas.frames[it->second];
+        if (frame.page == unpacked_page)
+            return nullptr;
+        return &frame;
+    }
+
+    // frames still staged are removed along with their staged_offsets entry;
+    // their staged pixels are dropped by the next build.
+    void atlas_remove_frames(atlas_t& atlas, bank_id_t first_id, uint32_t count) {
+        const auto removed = [&](const atlas_frame_t& frame) {
+            return frame.id.bank == first_id.bank
+                && frame.id.index >= first_id.index
+                && (uint32_t) (frame.id.index - first_id.index) < count;
+        };
+
+        const auto first_staged = atlas.frames.size() - atlas.staged_offsets.size();
+        uint32_t kept = 0;
+        uint32_t kept_staged = 0;
+        for (uint32_t i = 0; i < atlas.frames.size(); i++) {
+            if (removed(atlas.frames[i]))
+                continue;
+            if (i >= first_staged)
+                atlas.staged_offsets[kept_staged++] = atlas.staged_offsets[i - first_staged];
+            atlas.frames[kept++] = atlas.frames[i];
+        }
+        if (kept == atlas.frames.size())
+            return;
+
+        atlas.frames.resize(kept);
+        atlas.staged_offsets.resize(kept_staged);
+        atlas.lookup.clear();
+        for (uint32_t i = 0; i < atlas.frames.size(); i++)
+            atlas.lookup[make_frame_key(atlas.frames[i].id)] = i;
+    }
+
+    uint32_t atlas_release_pages(atlas_t& atlas) {
+        std::vector<bool> used(atlas.pages.size(), false);
+        for (const auto& frame : atlas.frames) {
+            if (frame.page == unpacked_page || frame.rect.size.w == 0 || frame.rect.size.h == 0)
+                continue;
+            used[frame.page] = true;
+        }
+
+        uint32_t released = 0;
+        for (uint32_t i = 0; i < atlas.pages.size(); i++) {
+            auto& page = atlas.pages[i];
+            if (used[i] || page_released(page))
+                continue;
+            page.size = size_t{};
+            page.pixels = std::vector<uint32_t>{};
+            page.skyline = std::vector<atlas_skyline_t>{};
+            released++;
+        }
+
+        while (!atlas.pages.empty() && page_released(atlas.pages.back()))
+            atlas.pages.pop_back();
+
+        return released;
+    }
+
+}
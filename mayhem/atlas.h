@@ -0,0 +1,87 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <common/result.h>
+#include "types.h"
+
+namespace mayhem {
+
+    // rect is the trimmed frame inside its page; trim is where that rect sits
+    // inside the untrimmed cell of the given size.  fully transparent frames
+    // keep their slot with an empty rect.
+    struct atlas_frame_t {
+        bank_id_t id{};
+        uint16_t page = 0;
+        rect_t rect{};
+        point_t trim{};
+        size_t size{};
+    };
+
+    // one segment of a page's packed outline: [x, x + w) is filled up to y
+    struct atlas_skyline_t {
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t w = 0;
+    };
+
+    // a released page keeps its slot, with no pixels and an empty size, so
+    // the indices of the others stay valid; the next build reuses it.
+    struct atlas_page_t {
+        size_t size{};
+        std::vector<uint32_t> pixels{};
+        std::vector<atlas_skyline_t> skyline{};
+    };
+
+    // frames are sliced and trimmed by atlas_add_sheet and only copied into
+    // pages by atlas_build.  each build packs into fresh pages, then shrinks
+    // them to the smallest power of two that holds what was packed; pages
+    // from earlier builds never move, so pointers into them stay valid
+    // until atlas_release_pages frees the ones no frame is left in.
+    struct atlas_t {
+        int32_t page_size = 1024;
+        std::vector<atlas_page_t> pages{};
+        std::vector<atlas_frame_t> frames{};
+        std::vector<uint32_t> staged{};
+        std::vector<uint32_t> staged_offsets{};
+        std::unordered_map<uint32_t, uint32_t> lookup{};
+    };
+
+    void atlas_init(atlas_t& atlas, int32_t page_size);
+
+    // pixels is a BGRA32 sheet of sheet_size, cut left-to-right, top-to-bottom
+    // into cells of frame_size; the cells take ids first_id, first_id + 1, ...
+    bool atlas_add_sheet(
+        common::result& r,
+        atlas_t& atlas,
+        const uint32_t* pixels,
+        size_t sheet_size,
+        size_t frame_size,
+        bank_id_t first_id,
+        uint32_t& count);
+
+    bool atlas_build(common::result& r, atlas_t& atlas);
+
+    const atlas_frame_t* atlas_find(const atlas_t& atlas, bank_id_t id);
+
+    // removes count frames from first_id so a sheet can be added again under
+    // the same ids.  their pixels stay in their pages until those are
+    // released.
+    void atlas_remove_frames(atlas_t& atlas, bank_id_t first_id, uint32_t count);
+
+    // frees the pixels of every page no frame is packed into any more and
+    // returns how many were freed; pointers into those pages are left
+    // dangling, so call it once the frames that replaced them are stored.
+    uint32_t atlas_release_pages(atlas_t& atlas);
+
+}
@@ -7,23 +7,79 @@
 //
 // ----------------------------------------------------------------------------
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <fmt/format.h>
+#include <common/lz4.h>
+#include <common/defer.h>
+#include <common/worker_pool.h>
+#include "log.h"
 #include "bank_manager.h"
- #include <utility>
+
 namespace mayhem {
 
+    // what is actually on disk ahead of the index
+    struct bank_header_t {
+        char magic[4];
+        uint16_t size;
+        uint16_t used_count;
+    };
+
+    static_assert(sizeof(bank_header_t) == 8);
+
+    static std::size_t page_align(std::size_t value) {
+        return (value + bank_page_size - 1) & ~(std::size_t) (bank_page_size - 1);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
     bank_entry::bank_entry(
         std::string name,
         uint8_t type,
-        size_t size) : _name(std::move(name)),
-                       _type(type),
-                       _size(size) {
+        std::size_t size,
+        bank_codec_t codec) : _size(size),
+                              _type(type),
+                              _name(std::move(name)),
+                              _codec(codec) {
     }
 
-    uint8_t* bank_entry::data() {
-        return _data.release();
+    bank_entry::bank_entry(
+        std::string name,
+        uint8_t type,
+        const uint8_t* mapped,
+        std::size_t stored_size,
+        bank_codec_t codec,
+        std::size_t size) : _size(size),
+                            _type(type),
+                            _name(std::move(name)),
+                            _codec(codec),
+                            _stored_size(stored_size),
+                            _mapped(mapped) {
     }
 
-    size_t bank_entry::size() const {
+    const uint8_t* bank_entry::data() const {
+        if (compressed()) {
+            common::result r;
+            if (!decompress(r)) {
+                log_error(
+                    log_category_t::system,
+                    "bank entry {}: {}",
+                    _name,
+                    r.messages().front().message());
+                return nullptr;
+            }
+        }
+        if (_data != nullptr)
+            return _data.get();
+        return _mapped;
+    }
+
+    std::size_t bank_entry::size() const {
         return _size;
     }
 
@@ -35,12 +91,50 @@ namespace mayhem {
         return std::string_view(_name);
     }
 
-    uint8_t* bank_entry::allocate_data(size_t size) {
+    bank_codec_t bank_entry::codec() const {
+        return _codec;
+    }
+
+    bool bank_entry::compressed() const {
+        return _data == nullptr
+            && _mapped != nullptr
+            && _codec != bank_codec_t::none;
+    }
+
+    const uint8_t* bank_entry::stored() const {
+        return _mapped;
+    }
+
+    std::size_t bank_entry::stored_size() const {
+        return _stored_size;
+    }
+
+    bool bank_entry::decompress(common::result& r) const {
+        if (!compressed())
+            return true;
+
+        std::unique_ptr<uint8_t[]> data(new uint8_t[_size]);
+        if (!common::lz4_decompress(_mapped, _stored_size, data.get(), _size)) {
+            r.error("B004", fmt::format(
+                "bank entry {} does not decode to {} bytes",
+                _name,
+                _size));
+            return false;
+        }
+        _data = std::move(data);
+        return true;
+    }
+
+    uint8_t* bank_entry::allocate_data(std::size_t size) {
         _data.reset(new uint8_t[size]);
+        _mapped = nullptr;
+        _stored_size = 0;
         _size = size;
-        return _data.release();
+        return _data.get();
     }
 
+    ///////////////////////////////////////////////////////////////////////////
+
     bank_entry* bank::find(const std::string& name) {
         auto it = _entries.find(name);
         if (it == std::end(_entries))
@@ -48,13 +142,18 @@ namespace mayhem {
         return &it->second;
     }
 
-    ///////////////////////////////////////////////////////////////////////////
+    bank_entry* bank::add(bank_entry entry) {
+        auto name = std::string(entry.name());
+        _entries.erase(name);
+        auto result = _entries.insert(std::make_pair(name, std::move(entry)));
+        return &result.first->second;
+    }
 
     bool bank::empty() const {
         return _entries.empty();
     }
 
-    size_t bank::size() const {
+    std::size_t bank::size() const {
         return _entries.size();
     }
 
@@ -63,11 +162,15 @@ namespace mayhem {
     bank_file::bank_file(std::string path) : _path(std::move(path)) {
     }
 
+    bank_file::~bank_file() {
+        unmap();
+    }
+
     bool bank_file::empty() const {
         return _banks.empty();
     }
 
-    size_t bank_file::size() const {
+    std::size_t bank_file::size() const {
         return _banks.size();
     }
 
@@ -75,32 +178,402 @@ namespace mayhem {
         return std::string_view(_path);
     }
 
+    bank* bank_file::find(uint8_t number) {
+        if (number >= _banks.size())
+            return nullptr;
+        return &_banks[number];
+    }
+
+    bank& bank_file::get(uint8_t number) {
+        if (number >= _banks.size())
+            _banks.resize(number + 1);
+        return _banks[number];
+    }
+
+    const bank_list_t& bank_file::banks() const {
+        return _banks;
+    }
+
+    // maps the whole file read-only and builds entries that point into it.
+    // only the header and index pages are touched here.
+    bool bank_file::map(common::result& r) {
+        unmap();
+        _banks.clear();
+
+        auto fd = open(_path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            r.error("B001", fmt::format("unable to open bank {}: {}", _path, strerror(errno)));
+            return false;
+        }
+        defer(close(fd));
+
+        struct stat info{};
+        if (fstat(fd, &info) == -1) {
+            r.error("B001", fmt::format("unable to stat bank {}: {}", _path, strerror(errno)));
+            return false;
+        }
+
+        const auto file_size = (std::size_t) info.st_size;
+        if (file_size < sizeof(bank_header_t)) {
+            r.error("B002", fmt::format("bank {} is too small for a header", _path));
+            return false;
+        }
+
+        auto mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            r.error("B001", fmt::format("unable to map bank {}: {}", _path, strerror(errno)));
+            return false;
+        }
+        _mapping = static_cast<uint8_t*>(mapping);
+        _mapping_size = file_size;
+
+        // the kernel only reads what is touched or prefetched
+        madvise(_mapping, _mapping_size, MADV_RANDOM);
+
+        bank_header_t header{};
+        memcpy(&header, _mapping, sizeof(header));
+        if (memcmp(header.magic, bank_magic, sizeof(bank_magic)) != 0) {
+            r.error("B002", fmt::format("{} is not a bank file", _path));
+            unmap();
+            return false;
+        }
+
+        const auto index_end = sizeof(bank_header_t)
+            + (std::size_t) header.size * sizeof(bank_index_entry_t);
+        if (header.used_count > header.size || index_end > file_size) {
+            r.error("B002", fmt::format(
+                "bank {} index of {} entries does not fit the file",
+                _path,
+                header.size));
+            unmap();
+            return false;
+        }
+
+        memcpy(_header.magic, header.magic, sizeof(header.magic));
+        _header.head_index.size = header.size;
+        _header.head_index.used_count = header.used_count;
+        _header.head_index.entries = reinterpret_cast<bank_index_entry_t*>(
+            _mapping + sizeof(bank_header_t));
+
+        for (uint16_t i = 0; i < header.used_count; i++) {
+            const auto& index = _header.head_index.entries[i];
+            const auto end = (std::size_t) index.offset + index.size;
+            if (index.offset % bank_page_size != 0 || index.offset < index_end || end > file_size) {
+                r.error("B002", fmt::format(
+                    "bank {} entry {} lies outside the file",
+                    _path,
+                    i));
+                unmap();
+                _banks.clear();
+                return false;
+            }
+
+            const auto codec = static_cast<bank_codec_t>(index.codec);
+            if (index.codec > static_cast<uint8_t>(bank_codec_t::lz4)
+            ||  (codec == bank_codec_t::none && index.size != index.uncompressed_size)) {
+                r.error("B002", fmt::format(
+                    "bank {} entry {} has an unknown codec or size",
+                    _path,
+                    i));
+                unmap();
+                _banks.clear();
+                return false;
+            }
+
+            std::string name(index.name, strnlen(index.name, bank_name_length));
+            get(index.bank).add(bank_entry(
+                std::move(name),
+                index.type,
+                _mapping + index.offset,
+                index.size,
+                codec,
+                index.uncompressed_size));
+        }
+
+        return true;
+    }
+
+    bool bank_file::prefetch(uint8_t number, const std::string& name) {
+        auto found = find(number);
+        if (found == nullptr)
+            return false;
+
+        auto entry = found->find(name);
+        if (entry == nullptr)
+            return false;
+
+        const auto stored = entry->stored();
+        if (_mapping == nullptr
+        ||  stored < _mapping
+        ||  stored >= _mapping + _mapping_size
+        ||  entry->stored_size() == 0) {
+            return true;
+        }
+
+        madvise(const_cast<uint8_t*>(stored), page_align(entry->stored_size()), MADV_WILLNEED);
+        return true;
+    }
+
+    bool bank_file::decompress(common::result& r, common::worker_pool* pool) {
+        std::vector<const bank_entry*> pending{};
+        for (const auto& bank : _banks) {
+            bank.for_each([&](const bank_entry& entry) {
+                if (entry.compressed())
+                    pending.push_back(&entry);
+            });
+        }
+
+        if (pool == nullptr) {
+            for (auto entry : pending) {
+                if (!entry->decompress(r))
+                    return false;
+            }
+            return true;
+        }
+
+        // each task owns one entry, and its own result
+        std::vector<common::result> results(pending.size());
+        pool->run((uint32_t) pending.size(), [&](uint32_t index) {
+            pending[index]->decompress(results[index]);
+        });
+
+        for (const auto& result : results)
+            r.append(result);
+        return !r.is_failed();
+    }
+
+    void bank_file::unmap() {
+        if (_mapping == nullptr)
+            return;
+        munmap(_mapping, _mapping_size);
+        _mapping = nullptr;
+        _mapping_size = 0;
+        _header = {};
+    }
+
     ///////////////////////////////////////////////////////////////////////////
 
     bank_manager::~bank_manager() {
     }
 
     bool bank_manager::empty() const {
+        std::lock_guard<std::mutex> lock(_mutex);
         return _files.empty();
     }
 
     bool bank_manager::exists(const std::string& path) {
+        std::lock_guard<std::mutex> lock(_mutex);
         return _files.count(path) > 0;
     }
 
     bank_file* bank_manager::find(const std::string& path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return find_locked(path);
+    }
+
+    bank_file* bank_manager::find_locked(const std::string& path) {
         auto it = _files.find(path);
         if (it == std::end(_files))
             return nullptr;
-        return &it->second;
+        return it->second.get();
     }
 
+    // entries are written in index order, each padded out to a page.  the
+    // file is written beside the original and renamed over it, so a mapping
+    // of the old file stays valid until it is unmapped.
     bool bank_manager::save(common::result& r, bank_file* file) {
-        return false;
+        if (file == nullptr) {
+            r.error("B003", "no bank file to save");
+            return false;
+        }
+
+        std::vector<bank_index_entry_t> index{};
+        std::vector<const uint8_t*> payloads{};
+        std::vector<std::vector<uint8_t>> compressed{};
+        std::unique_ptr<common::lz4_compress_state_t> lz4_state{};
+        const auto& banks = file->banks();
+        for (std::size_t number = 0; number < banks.size(); number++) {
+            banks[number].for_each([&](const bank_entry& entry) {
+                bank_index_entry_t item{};
+                item.bank = (uint8_t) number;
+                item.type = entry.type();
+                const auto name = entry.name();
+                memcpy(item.name, name.data(), std::min<std::size_t>(name.size(), bank_name_length));
+                item.uncompressed_size = (uint32_t) entry.size();
+
+                // entries still compressed are copied across as they are
+                if (entry.compressed()) {
+                    item.codec = static_cast<uint8_t>(entry.codec());
+                    item.size = (uint32_t) entry.stored_size();
+                    index.push_back(item);
+                    payloads.push_back(entry.stored());
+                    return;
+                }
+
+                const auto data = entry.data();
+                item.codec = static_cast<uint8_t>(bank_codec_t::none);
+                item.size = item.uncompressed_size;
+                if (entry.codec() == bank_codec_t::lz4 && entry.size() > 0) {
+                    if (lz4_state == nullptr)
+                        lz4_state = std::make_unique<common::lz4_compress_state_t>();
+                    std::vector<uint8_t> block(common::lz4_compress_bound(entry.size()));
+                    const auto size = common::lz4_compress(
+                        *lz4_state,
+                        data,
+                        entry.size(),
+                        block.data(),
+                        block.size());
+
+                    // incompressible entries are stored as they are
+                    if (size > 0 && size < entry.size()) {
+                        block.resize(size);
+                        item.codec = static_cast<uint8_t>(bank_codec_t::lz4);
+                        item.size = (uint32_t) size;
+                        compressed.push_back(std::move(block));
+                        index.push_back(item);
+                        payloads.push_back(compressed.back().data());
+                        return;
+                    }
+                }
+                index.push_back(item);
+                payloads.push_back(data);
+            });
+        }
+
+        if (index.size() > UINT16_MAX) {
+            r.error("B003", fmt::format("bank {} has too many entries: {}", file->path(), index.size()));
+            return false;
+        }
+
+        auto offset = page_align(sizeof(bank_header_t) + index.size() * sizeof(bank_index_entry_t));
+        for (auto& item : index) {
+            if (offset + item.size > UINT32_MAX) {
+                r.error("B003", fmt::format("bank {} is larger than 4 GiB", file->path()));
+                return false;
+            }
+            item.offset = (uint32_t) offset;
+            offset = page_align(offset + item.size);
+        }
+
+        bank_header_t header{};
+        memcpy(header.magic, bank_magic, sizeof(bank_magic));
+        header.size = (uint16_t) index.size();
+        header.used_count = (uint16_t) index.size();
+
+        const auto path = std::string(file->path());
+        const auto temp_path = path + ".tmp";
+        auto out = fopen(temp_path.c_str(), "wb");
+        if (out == nullptr) {
+            r.error("B003", fmt::format("unable to write bank {}: {}", temp_path, strerror(errno)));
+            return false;
+        }
+
+        auto written = fwrite(&header, sizeof(header), 1, out) == 1;
+        if (!index.empty())
+            written = written && fwrite(index.data(), sizeof(bank_index_entry_t), index.size(), out) == index.size();
+        for (std::size_t i = 0; written && i < index.size(); i++) {
+            written = fseek(out, index[i].offset, SEEK_SET) == 0;
+            if (written && index[i].size > 0)
+                written = payloads[i] != nullptr && fwrite(payloads[i], index[i].size, 1, out) == 1;
+        }
+
+        // pad the last entry out to a whole page
+        if (written && offset > (std::size_t) ftell(out)) {
+            written = fseek(out, (long) offset - 1, SEEK_SET) == 0
+                && fputc(0, out) != EOF;
+        }
+
+        if (fclose(out) != 0 || !written) {
+            r.error("B003", fmt::format("unable to write bank {}", temp_path));
+            remove(temp_path.c_str());
+            return false;
+        }
+
+        if (rename(temp_path.c_str(), path.c_str()) != 0) {
+            r.error("B003", fmt::format("unable to replace bank {}: {}", path, strerror(errno)));
+            remove(temp_path.c_str());
+            return false;
+        }
+
+        return true;
     }
 
     bank_file* bank_manager::load(common::result& r, const std::string& path) {
-        return nullptr;
+        std::lock_guard<std::mutex> lock(_mutex);
+        return load_locked(r, path);
+    }
+
+    bank_file* bank_manager::load_locked(common::result& r, const std::string& path) {
+        auto existing = find_locked(path);
+        if (existing != nullptr)
+            return existing;
+
+        auto file = std::make_unique<bank_file>(path);
+        if (!file->map(r))
+            return nullptr;
+
+        log_message(
+            log_category_t::system,
+            "bank {}: {} banks mapped",
+            path,
+            file->size());
+
+        auto result = _files.insert(std::make_pair(path, std::move(file)));
+        return result.first->second.get();
+    }
+
+    bool bank_manager::reload(common::result& r, const std::string& path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _files.find(path);
+        if (it == std::end(_files)) {
+            r.error("B001", fmt::format("bank {} is not open", path));
+            return false;
+        }
+
+        auto file = std::make_unique<bank_file>(path);
+        if (!file->map(r))
+            return false;
+
+        log_message(
+            log_category_t::system,
+            "bank {}: {} banks remapped",
+            path,
+            file->size());
+
+        it->second = std::move(file);
+        return true;
+    }
+
+    bank_file* bank_manager::create(common::result& r, const std::string& path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_files.count(path) > 0) {
+            r.error("B003", fmt::format("bank {} is already open", path));
+            return nullptr;
+        }
+
+        auto result = _files.insert(std::make_pair(path, std::make_unique<bank_file>(path)));
+        return result.first->second.get();
+    }
+
+    // the lock is held throughout, so a reload cannot free a file between
+    // loading it and prefetching from it
+    bool bank_manager::prefetch(common::result& r, const bank_request_list_t& requests) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& request : requests) {
+            auto file = load_locked(r, request.path);
+            if (file == nullptr)
+                return false;
+
+            if (!file->prefetch(request.bank, request.name)) {
+                log_warn(
+                    log_category_t::system,
+                    "bank {}: no entry {} in bank {}",
+                    request.path,
+                    request.name,
+                    request.bank);
+            }
+        }
+        return true;
     }
 
-}
\ No newline at end of file
+}
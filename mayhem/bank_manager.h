@@ -10,23 +10,68 @@
 #pragma once
 
 #include <map>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <memory>
 #include <cstdint>
+#include <string_view>
 #include <unordered_map>
 #include <common/result.h>
 
 namespace mayhem {
 
+    namespace common {
+        class worker_pool;
+    }
+
+    // a bank file starts with its magic and the head index, followed by the
+    // index entries.  each entry's data starts on its own bank_page_size
+    // boundary, so entries map, fault in and can be prefetched
+    // independently of one another.
+    static constexpr char bank_magic[4] = {'M', 'H', 'B', '1'};
+
+    static constexpr uint32_t bank_page_size = 4096;
+
+    static constexpr uint32_t bank_name_length = 24;
+
+    enum class bank_codec_t : uint8_t {
+        none,
+        lz4
+    };
+
+    // what an entry holds, stored in bank_index_entry_t::type.  tile sheets
+    // are laid out as described in tile_sheet.h; images are a bank_image_t
+    // followed by their BGRA32 pixels; fonts are the font file as it is.
+    enum class bank_entry_type_t : uint8_t {
+        raw,
+        tile_sheet,
+        image,
+        font
+    };
+
+    struct bank_image_t {
+        uint16_t w;
+        uint16_t h;
+    };
+
+    // size is what the entry occupies in the file; uncompressed_size is
+    // what it decodes to, and equals size when codec is none.
     struct bank_index_entry_t {
         uint8_t bank;
         uint8_t type;
-        char name[22];
+        uint8_t codec;
+        uint8_t reserved;
+        char name[bank_name_length];
         uint32_t offset;
         uint32_t size;
+        uint32_t uncompressed_size;
     };
 
+    static_assert(sizeof(bank_index_entry_t) == 40);
+
+    // on disk only size and used_count are stored; entries points at the
+    // index inside the mapping once the file is open.
     struct bank_index_t {
         uint16_t size;
         uint16_t used_count;
@@ -40,28 +85,63 @@ namespace mayhem {
 
     ///////////////////////////////////////////////////////////////////////////
 
+    // entries read from a bank file point into its mapping; nothing is copied
+    // and pages are read from disk the first time they are touched.  entries
+    // built for saving own their data through allocate_data.
+    //
+    // a compressed entry is decoded into its own buffer the first time data()
+    // is called, or ahead of time by decompress.  data() is not safe to call
+    // from several threads for the same entry before it has been decoded.
     class bank_entry {
     public:
         bank_entry(
             std::string name,
             uint8_t type,
-            size_t size);
+            std::size_t size,
+            bank_codec_t codec = bank_codec_t::none);
 
-        uint8_t* data();
+        bank_entry(
+            std::string name,
+            uint8_t type,
+            const uint8_t* mapped,
+            std::size_t stored_size,
+            bank_codec_t codec,
+            std::size_t size);
 
-        size_t size() const;
+        // nullptr if a compressed entry fails to decode
+        const uint8_t* data() const;
+
+        // the uncompressed size
+        std::size_t size() const;
 
         uint8_t type() const;
 
         std::string_view name() const;
 
-        uint8_t* allocate_data(size_t size);
+        // for entries being saved, the codec save uses; for entries read from
+        // a file, the codec they were stored with
+        bank_codec_t codec() const;
+
+        // true while data() would still have to decode the entry
+        bool compressed() const;
+
+        // the bytes as they are in the file, and how many there are
+        const uint8_t* stored() const;
+
+        std::size_t stored_size() const;
+
+        bool decompress(common::result& r) const;
+
+        uint8_t* allocate_data(std::size_t size);
 
     private:
-        size_t _size;
+        std::size_t _size;
         uint8_t _type;
         std::string _name;
-        std::unique_ptr<uint8_t> _data;
+        bank_codec_t _codec;
+        std::size_t _stored_size = 0;
+        const uint8_t* _mapped = nullptr;
+        mutable std::unique_ptr<uint8_t[]> _data;
     };
 
     ///////////////////////////////////////////////////////////////////////////
@@ -72,10 +152,19 @@ namespace mayhem {
 
         bool empty() const;
 
-        size_t size() const;
+        std::size_t size() const;
 
         bank_entry* find(const std::string& name);
 
+        // replaces any entry with the same name
+        bank_entry* add(bank_entry entry);
+
+        template <typename F>
+        void for_each(F&& f) const {
+            for (const auto& kvp : _entries)
+                f(kvp.second);
+        }
+
     private:
         std::map<std::string, bank_entry> _entries{};
     };
@@ -84,23 +173,62 @@ namespace mayhem {
 
     ///////////////////////////////////////////////////////////////////////////
 
+    // owns the read-only mapping of a loaded file; banks are indexed by
+    // bank_index_entry_t::bank.
     class bank_file {
     public:
         explicit bank_file(std::string path);
 
+        bank_file(const bank_file&) = delete;
+
+        ~bank_file();
+
         bool empty() const;
 
-        size_t size() const;
+        std::size_t size() const;
 
         std::string_view path() const;
 
+        bank* find(uint8_t number);
+
+        bank& get(uint8_t number);
+
+        const bank_list_t& banks() const;
+
+        bool map(common::result& r);
+
+        // asks the kernel to start reading the named entry of a bank
+        bool prefetch(uint8_t number, const std::string& name);
+
+        // decodes every compressed entry now rather than on first touch;
+        // with a pool, entries are decoded in parallel, one per task.
+        bool decompress(common::result& r, common::worker_pool* pool = nullptr);
+
+    private:
+        void unmap();
+
     private:
         bank_list_t _banks{};
         std::string _path;
+        uint8_t* _mapping = nullptr;
+        std::size_t _mapping_size = 0;
+        bank_file_t _header{};
     };
 
     ///////////////////////////////////////////////////////////////////////////
 
+    // the entries a state needs once it is entered; see state::assets
+    struct bank_request_t {
+        std::string path;
+        uint8_t bank = 0;
+        std::string name;
+    };
+
+    using bank_request_list_t = std::vector<bank_request_t>;
+
+    // safe to use from several threads; in threaded mode the simulation
+    // thread prefetches while the main thread watches and reloads files.
+    // a bank_file handed out stays valid until its path is reloaded.
     class bank_manager {
     public:
         bank_manager() = default;
@@ -117,9 +245,34 @@ namespace mayhem {
 
         bank_file* load(common::result& r, const std::string& path);
 
+        // maps the file at path again; entries taken from the old mapping
+        // are invalid afterwards.  the old mapping is kept if the new file
+        // does not validate.
+        bool reload(common::result& r, const std::string& path);
+
+        // f runs with the manager locked and must not call back into it
+        template <typename F>
+        void for_each(F&& f) const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto& kvp : _files)
+                f(*kvp.second);
+        }
+
+        // an empty file to fill and save; nothing is written until save
+        bank_file* create(common::result& r, const std::string& path);
+
+        // loads any files not yet open and starts reading the requested
+        // entries in the background; unknown entries are only logged.
+        bool prefetch(common::result& r, const bank_request_list_t& requests);
+
     private:
-        std::unordered_map<std::string, bank_file> _files{};
+        bank_file* find_locked(const std::string& path);
+
+        bank_file* load_locked(common::result& r, const std::string& path);
+
+    private:
+        mutable std::mutex _mutex{};
+        std::unordered_map<std::string, std::unique_ptr<bank_file>> _files{};
     };
 
 }
-
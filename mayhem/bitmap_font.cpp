@@ -0,0 +1,269 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <numeric>
+#include <algorithm>
+#include <fmt/format.h>
+#include <common/rune.h>
+#include <common/bytes.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_SYNTHESIS_H
+#include "bitmap_font.h"
+
+namespace mayhem {
+
+    static constexpr int32_t atlas_width = 256;
+
+    static constexpr int32_t glyph_padding = 1;
+
+    static constexpr uint32_t fallback_codepoint = '?';
+
+    struct glyph_raster_t {
+        uint32_t codepoint = 0;
+        bitmap_glyph_t glyph{};
+        std::vector<uint8_t> coverage{};
+    };
+
+    template <typename F>
+    static void utf8_for_each(std::string_view text, F&& f) {
+        auto p = const_cast<char*>(text.data());
+        auto remaining = text.size();
+        while (remaining > 0) {
+            const auto cp = common::utf8_decode(p, remaining);
+            const auto width = std::min<std::size_t>(std::max<std::size_t>(cp.width, 1), remaining);
+            f((uint32_t) cp.value);
+            p += width;
+            remaining -= width;
+        }
+    }
+
+    // false when the face has no glyph for codepoint
+    static bool glyph_rasterize(
+            FT_Face face,
+            uint32_t codepoint,
+            uint8_t style,
+            glyph_raster_t& raster) {
+        const auto index = FT_Get_Char_Index(face, codepoint);
+        if (index == 0)
+            return false;
+
+        if (FT_Load_Glyph(face, index, FT_LOAD_DEFAULT) != 0)
+            return false;
+
+        auto slot = face->glyph;
+        if ((style & (uint8_t) font_style_t::bold) != 0)
+            FT_GlyphSlot_Embolden(slot);
+        if ((style & (uint8_t) font_style_t::italic) != 0)
+            FT_GlyphSlot_Oblique(slot);
+
+        if (FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) != 0)
+            return false;
+
+        const auto& bitmap = slot->bitmap;
+        const auto w = (int32_t) bitmap.width;
+        const auto h = (int32_t) bitmap.rows;
+
+        raster.codepoint = codepoint;
+        raster.glyph.rect.size = size_t{w, h};
+        raster.glyph.bearing = point_t{slot->bitmap_left, -slot->bitmap_top};
+        raster.glyph.advance = (int32_t) ((slot->advance.x + 32) >> 6);
+        raster.coverage.resize(w * h);
+
+        for (int32_t y = 0; y < h; y++) {
+            const auto src = bitmap.buffer + y * bitmap.pitch;
+            const auto dst = raster.coverage.data() + y * w;
+            if (bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+                for (int32_t x = 0; x < w; x++)
+                    dst[x] = (src[x >> 3] & (0x80 >> (x & 7))) != 0 ? 0xff : 0;
+            } else {
+                std::copy(src, src + w, dst);
+            }
+        }
+
+        return true;
+    }
+
+    // shelf packing, tallest glyphs first; the atlas height is rounded up to
+    // a power of two like the tile atlas pages.
+    static void atlas_pack(std::vector<glyph_raster_t>& rasters, bitmap_font_t& font) {
+        std::vector<uint32_t> order(rasters.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return rasters[a].glyph.rect.size.h > rasters[b].glyph.rect.size.h;
+        });
+
+        int32_t width = atlas_width;
+        for (const auto& raster : rasters)
+            width = std::max(width, raster.glyph.rect.size.w + glyph_padding);
+
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t shelf = 0;
+        for (auto i : order) {
+            auto& rect = rasters[i].glyph.rect;
+            if (x + rect.size.w > width) {
+                x = 0;
+                y += shelf + glyph_padding;
+                shelf = 0;
+            }
+            rect.pos = point_t{x, y};
+            x += rect.size.w + glyph_padding;
+            shelf = std::max(shelf, rect.size.h);
+        }
+
+        const auto height = (int32_t) common::next_power_of_two((uint32_t) std::max(y + shelf, 1));
+        font.atlas_size = size_t{width, height};
+        font.atlas.assign(width * height, 0);
+
+        for (const auto& raster : rasters) {
+            const auto& rect = raster.glyph.rect;
+            for (int32_t row = 0; row < rect.size.h; row++) {
+                const auto src = raster.coverage.data() + row * rect.size.w;
+                std::copy(
+                    src,
+                    src + rect.size.w,
+                    font.atlas.data() + (rect.pos.y + row) * width + rect.pos.x);
+            }
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    bool bitmap_font_load(
+            common::result& r,
+            const std::string& path,
+            uint32_t size,
+            uint8_t style,
+            bitmap_font_t& font) {
+        FT_Library library = nullptr;
+        if (FT_Init_FreeType(&library) != 0) {
+            r.error("V008", "unable to initialize freetype.");
+            return false;
+        }
+
+        FT_Face face = nullptr;
+        if (FT_New_Face(library, path.c_str(), 0, &face) != 0) {
+            FT_Done_FreeType(library);
+            r.error("V008", fmt::format("unable to open font face: {}", path));
+            return false;
+        }
+
+        // same scaling as SDL_ttf: points at 72 dpi, so one point per pixel
+        if (FT_Set_Char_Size(face, 0, size * 64, 0, 0) != 0) {
+            FT_Done_Face(face);
+            FT_Done_FreeType(library);
+            r.error("V008", fmt::format("font {} has no {} pixel size", path, size));
+            return false;
+        }
+
+        const auto& metrics = face->size->metrics;
+        font.ascent = (int32_t) ((metrics.ascender + 63) >> 6);
+        font.descent = (int32_t) (metrics.descender >> 6);
+        font.line_height = font.ascent - font.descent;
+
+        std::vector<glyph_raster_t> rasters{};
+        const auto add_range = [&](uint32_t first, uint32_t last) {
+            for (auto codepoint = first; codepoint <= last; codepoint++) {
+                glyph_raster_t raster{};
+                if (glyph_rasterize(face, codepoint, style, raster))
+                    rasters.push_back(std::move(raster));
+            }
+        };
+        add_range(0x20, 0x7e);
+        add_range(0xa0, 0xff);
+
+        FT_Done_Face(face);
+        FT_Done_FreeType(library);
+
+        if (rasters.empty()) {
+            r.error("V008", fmt::format("font {} has no ascii or latin-1 glyphs", path));
+            return false;
+        }
+
+        atlas_pack(rasters, font);
+
+        font.glyphs.clear();
+        for (const auto& raster : rasters)
+            font.glyphs[raster.codepoint] = raster.glyph;
+
+        auto it = font.glyphs.find(fallback_codepoint);
+        font.fallback = it != std::end(font.glyphs) ? it->second : rasters.front().glyph;
+
+        return true;
+    }
+
+    const bitmap_glyph_t& bitmap_font_glyph(const bitmap_font_t& font, uint32_t codepoint) {
+        auto it = font.glyphs.find(codepoint);
+        if (it == std::end(font.glyphs))
+            return font.fallback;
+        return it->second;
+    }
+
+    size_t bitmap_font_measure(const bitmap_font_t& font, std::string_view text) {
+        int32_t pen = 0;
+        int32_t right = 0;
+        utf8_for_each(text, [&](uint32_t codepoint) {
+            const auto& glyph = bitmap_font_glyph(font, codepoint);
+            right = std::max(right, pen + glyph.bearing.x + glyph.rect.size.w);
+            pen += glyph.advance;
+        });
+        return size_t{std::max(pen, right), font.line_height};
+    }
+
+    void bitmap_font_render(
+            const bitmap_font_t& font,
+            color_t color,
+            std::string_view text,
+            image_bitmap_t& bitmap) {
+        bitmap.size = bitmap_font_measure(font, text);
+        bitmap.opaque = false;
+
+        const auto w = bitmap.size.w;
+        const auto h = bitmap.size.h;
+        std::vector<uint8_t> coverage(w * h, 0);
+
+        // glyphs that overlap keep the stronger coverage; the whole run is
+        // one color, so that is the same as drawing one over the other
+        int32_t pen = 0;
+        utf8_for_each(text, [&](uint32_t codepoint) {
+            const auto& glyph = bitmap_font_glyph(font, codepoint);
+            const auto left = pen + glyph.bearing.x;
+            const auto top = font.ascent + glyph.bearing.y;
+            pen += glyph.advance;
+
+            const auto x0 = std::max(left, 0);
+            const auto x1 = std::min(left + glyph.rect.size.w, w);
+            const auto y0 = std::max(top, 0);
+            const auto y1 = std::min(top + glyph.rect.size.h, h);
+            for (auto y = y0; y < y1; y++) {
+                const auto src = font.atlas.data()
+                    + (glyph.rect.pos.y + y - top) * font.atlas_size.w
+                    + glyph.rect.pos.x;
+                const auto dst = coverage.data() + y * w;
+                for (auto x = x0; x < x1; x++)
+                    dst[x] = std::max(dst[x], src[x - left]);
+            }
+        });
+
+        uint32_t shades[256];
+        for (uint32_t c = 0; c < 256; c++) {
+            const auto alpha = (c * color.a + 127) / 255;
+            shades[c] = (alpha << 24)
+                | (((color.r * alpha + 127) / 255) << 16)
+                | (((color.g * alpha + 127) / 255) << 8)
+                | ((color.b * alpha + 127) / 255);
+        }
+
+        bitmap.pixels.resize(w * h);
+        for (std::size_t i = 0; i < coverage.size(); i++)
+            bitmap.pixels[i] = shades[coverage[i]];
+    }
+
+}
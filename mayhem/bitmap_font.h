@@ -0,0 +1,70 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <common/result.h>
+#include "types.h"
+#include "image_cache.h"
+
+namespace mayhem {
+
+    enum class font_style_t : uint8_t {
+        normal      = 0b00000000,
+        bold        = 0b00000001,
+        italic      = 0b00000010,
+    };
+
+    // rect is where the glyph's coverage sits in the atlas; bearing is the
+    // offset of its top-left corner from the pen position on the baseline.
+    struct bitmap_glyph_t {
+        rect_t rect{};
+        point_t bearing{};
+        int32_t advance = 0;
+    };
+
+    // every glyph is rasterized once, at load, into a single 8-bit coverage
+    // atlas.  codepoints without a glyph in the face draw as fallback.
+    struct bitmap_font_t {
+        int32_t ascent = 0;
+        int32_t descent = 0;
+        int32_t line_height = 0;
+        size_t atlas_size{};
+        std::vector<uint8_t> atlas{};
+        bitmap_glyph_t fallback{};
+        std::unordered_map<uint32_t, bitmap_glyph_t> glyphs{};
+    };
+
+    // rasterizes ascii and latin-1 from the ttf at path, at size pixels
+    bool bitmap_font_load(
+        common::result& r,
+        const std::string& path,
+        uint32_t size,
+        uint8_t style,
+        bitmap_font_t& font);
+
+    const bitmap_glyph_t& bitmap_font_glyph(const bitmap_font_t& font, uint32_t codepoint);
+
+    // the width is the sum of advances; the height is always line_height
+    size_t bitmap_font_measure(const bitmap_font_t& font, std::string_view text);
+
+    // lays out a single line of utf-8 text and rasterizes it in color into a
+    // premultiplied BGRA32 bitmap, ready for the blend kernels.
+    void bitmap_font_render(
+        const bitmap_font_t& font,
+        color_t color,
+        std::string_view text,
+        image_bitmap_t& bitmap);
+
+}
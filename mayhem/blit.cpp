@@ -0,0 +1,576 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <algorithm>
+#include <SDL_cpuinfo.h>
+#include "log.h"
+#include "blit.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MAYHEM_BLIT_X86
+#include <immintrin.h>
+#endif
+
+namespace mayhem {
+
+    static constexpr uint32_t alpha_mask = 0xff000000;
+
+    static constexpr uint32_t max_expand_span = 512;
+
+    static void copy_row_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        memcpy(dst, src, count * sizeof(uint32_t));
+    }
+
+    static void copy_row_hflip_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++)
+            dst[i] = src[count - 1 - i];
+    }
+
+    static void keyed_row_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            const auto pixel = src[i];
+            if ((pixel & alpha_mask) != 0)
+                dst[i] = pixel;
+        }
+    }
+
+    static void keyed_row_hflip_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            const auto pixel = src[count - 1 - i];
+            if ((pixel & alpha_mask) != 0)
+                dst[i] = pixel;
+        }
+    }
+
+    // premultiplied source over dst: d = s + d * (255 - sa) / 255, rounded.
+    // two channels are scaled per 32-bit multiply; lanes cannot carry.
+    static uint32_t blend_pixel(uint32_t d, uint32_t s) {
+        const auto alpha = s >> 24;
+        if (alpha == 0xff)
+            return s;
+        if (alpha == 0)
+            return d;
+
+        const auto inv = 255 - alpha;
+        auto br = (d & 0x00ff00ffu) * inv + 0x00800080u;
+        auto ga = ((d >> 8) & 0x00ff00ffu) * inv + 0x00800080u;
+        br = ((br + ((br >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+        ga = ((ga + ((ga >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+        const auto scaled = br | (ga << 8);
+
+        // s <= sa per channel keeps the sum in range for valid input, but
+        // saturate per byte so a bad source cannot bleed between channels.
+        uint32_t result = 0;
+        for (uint32_t c = 0; c < 32; c += 8) {
+            const auto sum = ((scaled >> c) & 0xff) + ((s >> c) & 0xff);
+            result |= std::min<uint32_t>(sum, 0xff) << c;
+        }
+        return result;
+    }
+
+    static void blend_row_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++)
+            dst[i] = blend_pixel(dst[i], src[i]);
+    }
+
+    static void blend_row_hflip_scalar(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++)
+            dst[i] = blend_pixel(dst[i], src[count - 1 - i]);
+    }
+
+    static void expand_row_scalar(
+            uint32_t* dst,
+            const uint8_t* src,
+            uint32_t count,
+            const palette_t& pal) {
+        for (uint32_t i = 0; i < count; i++)
+            dst[i] = pal.entries[src[i]].value;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+#ifdef MAYHEM_BLIT_X86
+    __attribute__((target("sse2")))
+    static void copy_row_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        copy_row_scalar(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("sse2")))
+    static void copy_row_hflip_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + count - i - 4));
+            v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        copy_row_hflip_scalar(dst + i, src, count - i);
+    }
+
+    __attribute__((target("sse2")))
+    static inline __m128i keyed_blend_sse2(__m128i d, __m128i s) {
+        const auto transparent = _mm_cmpeq_epi32(
+            _mm_and_si128(s, _mm_set1_epi32((int32_t) alpha_mask)),
+            _mm_setzero_si128());
+        return _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+    }
+
+    __attribute__((target("sse2")))
+    static void keyed_row_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), keyed_blend_sse2(d, s));
+        }
+        keyed_row_scalar(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("sse2")))
+    static void keyed_row_hflip_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + count - i - 4));
+            s = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3));
+            const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), keyed_blend_sse2(d, s));
+        }
+        keyed_row_hflip_scalar(dst + i, src, count - i);
+    }
+
+    // d16 holds two pixels as 16-bit channels; every channel is scaled by
+    // 255 minus its pixel's alpha.
+    __attribute__((target("sse2")))
+    static inline __m128i blend_scale_sse2(__m128i d16, __m128i s16) {
+        auto alpha = _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+        const auto inv = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+        const auto v = _mm_add_epi16(_mm_mullo_epi16(d16, inv), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+    }
+
+    __attribute__((target("sse2")))
+    static inline __m128i blend_over_sse2(__m128i d, __m128i s) {
+        const auto zero = _mm_setzero_si128();
+        const auto lo = blend_scale_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+        const auto hi = blend_scale_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+        return _mm_adds_epu8(_mm_packus_epi16(lo, hi), s);
+    }
+
+    // runs of fully opaque or fully transparent pixels skip the arithmetic
+    __attribute__((target("sse2")))
+    static inline void blend_store_sse2(uint32_t* dst, __m128i s) {
+        const auto alpha = _mm_and_si128(s, _mm_set1_epi32((int32_t) alpha_mask));
+        const auto opaque = _mm_movemask_epi8(
+            _mm_cmpeq_epi32(alpha, _mm_set1_epi32((int32_t) alpha_mask)));
+        if (opaque == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), s);
+            return;
+        }
+        const auto clear = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128()));
+        if (clear == 0xffff)
+            return;
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), blend_over_sse2(d, s));
+    }
+
+    __attribute__((target("sse2")))
+    static void blend_row_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4)
+            blend_store_sse2(dst + i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        blend_row_scalar(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("sse2")))
+    static void blend_row_hflip_sse2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + count - i - 4));
+            blend_store_sse2(dst + i, _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3)));
+        }
+        blend_row_hflip_scalar(dst + i, src, count - i);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    // each of the four byte planes is looked up with one pshufb, then the
+    // planes are interleaved back into sixteen BGRA pixels.
+    __attribute__((target("ssse3")))
+    static void expand_row_nibble_ssse3(
+            uint32_t* dst,
+            const uint8_t* src,
+            uint32_t count,
+            const palette_t& pal) {
+        const auto blue = _mm_load_si128(reinterpret_cast<const __m128i*>(pal.planes[0]));
+        const auto green = _mm_load_si128(reinterpret_cast<const __m128i*>(pal.planes[1]));
+        const auto red = _mm_load_si128(reinterpret_cast<const __m128i*>(pal.planes[2]));
+        const auto alpha = _mm_load_si128(reinterpret_cast<const __m128i*>(pal.planes[3]));
+
+        uint32_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const auto index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const auto b = _mm_shuffle_epi8(blue, index);
+            const auto g = _mm_shuffle_epi8(green, index);
+            const auto r = _mm_shuffle_epi8(red, index);
+            const auto a = _mm_shuffle_epi8(alpha, index);
+
+            const auto bg_lo = _mm_unpacklo_epi8(b, g);
+            const auto bg_hi = _mm_unpackhi_epi8(b, g);
+            const auto ra_lo = _mm_unpacklo_epi8(r, a);
+            const auto ra_hi = _mm_unpackhi_epi8(r, a);
+
+            auto out = reinterpret_cast<__m128i*>(dst + i);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bg_lo, ra_lo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+        }
+        expand_row_scalar(dst + i, src + i, count - i, pal);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    __attribute__((target("avx2")))
+    static void expand_row_avx2(
+            uint32_t* dst,
+            const uint8_t* src,
+            uint32_t count,
+            const palette_t& pal) {
+        const auto entries = reinterpret_cast<const int*>(pal.entries);
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const auto index = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+            const auto v = _mm256_i32gather_epi32(entries, index, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        }
+        expand_row_scalar(dst + i, src + i, count - i, pal);
+    }
+
+    __attribute__((target("avx2")))
+    static void copy_row_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        }
+        copy_row_sse2(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void copy_row_hflip_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        const auto reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + count - i - 8));
+            v = _mm256_permutevar8x32_epi32(v, reverse);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        }
+        copy_row_hflip_sse2(dst + i, src, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void keyed_row_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        const auto alpha = _mm256_set1_epi32((int32_t) alpha_mask);
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const auto opaque = _mm256_xor_si256(
+                _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), _mm256_setzero_si256()),
+                _mm256_set1_epi32(-1));
+            _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), opaque, s);
+        }
+        keyed_row_sse2(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void keyed_row_hflip_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        const auto alpha = _mm256_set1_epi32((int32_t) alpha_mask);
+        const auto reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + count - i - 8));
+            s = _mm256_permutevar8x32_epi32(s, reverse);
+            const auto opaque = _mm256_xor_si256(
+                _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), _mm256_setzero_si256()),
+                _mm256_set1_epi32(-1));
+            _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), opaque, s);
+        }
+        keyed_row_hflip_sse2(dst + i, src, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256i blend_scale_avx2(__m256i d16, __m256i s16) {
+        auto alpha = _mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+        const auto inv = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+        const auto v = _mm256_add_epi16(_mm256_mullo_epi16(d16, inv), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+    }
+
+    __attribute__((target("avx2")))
+    static inline void blend_store_avx2(uint32_t* dst, __m256i s) {
+        const auto alpha = _mm256_and_si256(s, _mm256_set1_epi32((int32_t) alpha_mask));
+        const auto opaque = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi32(alpha, _mm256_set1_epi32((int32_t) alpha_mask)));
+        if (opaque == -1) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), s);
+            return;
+        }
+        const auto clear = _mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, _mm256_setzero_si256()));
+        if (clear == -1)
+            return;
+
+        // unpack and pack stay within 128-bit lanes, so pixel order survives
+        const auto zero = _mm256_setzero_si256();
+        const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+        const auto lo = blend_scale_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+        const auto hi = blend_scale_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(dst),
+            _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s));
+    }
+
+    __attribute__((target("avx2")))
+    static void blend_row_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            blend_store_avx2(dst + i, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+        blend_row_sse2(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void blend_row_hflip_avx2(uint32_t* dst, const uint32_t* src, uint32_t count) {
+        const auto reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + count - i - 8));
+            blend_store_avx2(dst + i, _mm256_permutevar8x32_epi32(s, reverse));
+        }
+        blend_row_hflip_sse2(dst + i, src, count - i);
+    }
+#endif
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    static const blit_kernels_t s_scalar_kernels = {
+        blit_isa_t::scalar,
+        copy_row_scalar,
+        copy_row_hflip_scalar,
+        keyed_row_scalar,
+        keyed_row_hflip_scalar,
+        blend_row_scalar,
+        blend_row_hflip_scalar,
+        expand_row_scalar,
+        expand_row_scalar,
+    };
+
+#ifdef MAYHEM_BLIT_X86
+    static const blit_kernels_t s_sse2_kernels = {
+        blit_isa_t::sse2,
+        copy_row_sse2,
+        copy_row_hflip_sse2,
+        keyed_row_sse2,
+        keyed_row_hflip_sse2,
+        blend_row_sse2,
+        blend_row_hflip_sse2,
+        expand_row_scalar,
+        expand_row_scalar,
+    };
+
+    static const blit_kernels_t s_ssse3_kernels = {
+        blit_isa_t::ssse3,
+        copy_row_sse2,
+        copy_row_hflip_sse2,
+        keyed_row_sse2,
+        keyed_row_hflip_sse2,
+        blend_row_sse2,
+        blend_row_hflip_sse2,
+        expand_row_scalar,
+        expand_row_nibble_ssse3,
+    };
+
+    static const blit_kernels_t s_avx2_kernels = {
+        blit_isa_t::avx2,
+        copy_row_avx2,
+        copy_row_hflip_avx2,
+        keyed_row_avx2,
+        keyed_row_hflip_avx2,
+        blend_row_avx2,
+        blend_row_hflip_avx2,
+        expand_row_avx2,
+        expand_row_nibble_ssse3,
+    };
+#endif
+
+    static const blit_kernels_t* s_kernels = &s_scalar_kernels;
+
+    // SDL 2.0.9 has no SSSE3 query; every SSE4.1 part also has SSSE3.
+    static bool has_ssse3() {
+        return SDL_HasSSE41() == SDL_TRUE;
+    }
+
+    void blit_init() {
+        blit_isa_t isa = blit_isa_t::scalar;
+        if (SDL_HasAVX2())
+            isa = blit_isa_t::avx2;
+        else if (has_ssse3())
+            isa = blit_isa_t::ssse3;
+        else if (SDL_HasSSE2())
+            isa = blit_isa_t::sse2;
+
+        if (!blit_select(isa))
+            blit_select(blit_isa_t::scalar);
+
+        log_message(
+            log_category_t::video,
+            "blit kernels: {}",
+            blit_isa_name(s_kernels->isa));
+    }
+
+    bool blit_select(blit_isa_t isa) {
+        auto kernels = blit_kernels(isa);
+        if (kernels == nullptr)
+            return false;
+        s_kernels = kernels;
+        return true;
+    }
+
+    std::string_view blit_isa_name(blit_isa_t isa) {
+        switch (isa) {
+            case blit_isa_t::scalar:    return "scalar";
+            case blit_isa_t::sse2:      return "sse2";
+            case blit_isa_t::ssse3:     return "ssse3";
+            case blit_isa_t::avx2:      return "avx2";
+        }
+        return "unknown";
+    }
+
+    bool blit_isa_parse(std::string_view name, blit_isa_t& isa) {
+        for (auto candidate : {blit_isa_t::scalar, blit_isa_t::sse2, blit_isa_t::ssse3, blit_isa_t::avx2}) {
+            if (blit_isa_name(candidate) == name) {
+                isa = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const blit_kernels_t& blit_kernels() {
+        return *s_kernels;
+    }
+
+    const blit_kernels_t* blit_kernels(blit_isa_t isa) {
+        switch (isa) {
+            case blit_isa_t::scalar:
+                return &s_scalar_kernels;
+#ifdef MAYHEM_BLIT_X86
+            case blit_isa_t::sse2:
+                return SDL_HasSSE2() ? &s_sse2_kernels : nullptr;
+            case blit_isa_t::ssse3:
+                return has_ssse3() ? &s_ssse3_kernels : nullptr;
+            case blit_isa_t::avx2:
+                return SDL_HasAVX2() ? &s_avx2_kernels : nullptr;
+#endif
+            default:
+                return nullptr;
+        }
+    }
+
+    bool blit_prepare(
+            const blit_target_t& target,
+            const blit_source_t& source,
+            int32_t x,
+            int32_t y,
+            uint8_t flags,
+            blit_span_t& span) {
+        const auto left = std::max(x, target.clip_left);
+        const auto top = std::max(y, target.clip_top);
+        const auto right = std::min(x + source.w, target.clip_right);
+        const auto bottom = std::min(y + source.h, target.clip_bottom);
+        if (left >= right || top >= bottom)
+            return false;
+
+        const bool keyed = (flags & (uint8_t) blit_flags_t::keyed) != 0;
+        const bool blend = (flags & (uint8_t) blit_flags_t::blend) != 0;
+        const bool hflip = (flags & (uint8_t) blit_flags_t::hflip) != 0;
+        const bool vflip = (flags & (uint8_t) blit_flags_t::vflip) != 0;
+
+        if (blend)
+            span.kernel = hflip ? s_kernels->blend_hflip : s_kernels->blend;
+        else if (keyed)
+            span.kernel = hflip ? s_kernels->keyed_hflip : s_kernels->keyed;
+        else
+            span.kernel = hflip ? s_kernels->copy_hflip : s_kernels->copy;
+        span.expand = source.nibble ? s_kernels->expand_nibble : s_kernels->expand;
+
+        // destination columns [left, right) map to source columns starting at
+        // left - x; flipped, the same span is read from the mirrored end.
+        span.source = source;
+        span.y = y;
+        span.top = top;
+        span.left = left;
+        span.bottom = bottom;
+        span.hflip = hflip;
+        span.vflip = vflip;
+        span.count = static_cast<uint32_t>(right - left);
+        span.src_x = hflip ? x + source.w - right : left - x;
+
+        return true;
+    }
+
+    void blit_draw_row(const blit_span_t& span, uint32_t* row, int32_t dy) {
+        const auto& source = span.source;
+        const auto src_row = dy - span.y;
+        const auto src_y = span.vflip ? source.h - 1 - src_row : src_row;
+        const auto dst = row + span.left;
+
+        if (source.indices == nullptr) {
+            span.kernel(dst, source.pixels + src_y * source.pitch + span.src_x, span.count);
+            return;
+        }
+
+        // indexed sources are expanded left-to-right into a scratch span and
+        // then go through the same copy/keyed/flip kernels as BGRA sources.
+        alignas(32) uint32_t scratch[max_expand_span];
+        const auto indices = source.indices + src_y * source.pitch + span.src_x;
+        for (uint32_t i = 0; i < span.count; i += max_expand_span) {
+            const auto length = std::min(max_expand_span, span.count - i);
+            const auto offset = span.hflip ? span.count - i - length : i;
+            span.expand(scratch, indices + offset, length, *source.palette);
+            span.kernel(dst + i, scratch, length);
+        }
+    }
+
+    bool blit_draw(
+            const blit_target_t& target,
+            const blit_source_t& source,
+            int32_t x,
+            int32_t y,
+            uint8_t flags) {
+        blit_span_t span{};
+        if (!blit_prepare(target, source, x, y, flags, span))
+            return false;
+
+        auto row = target.pixels + span.top * target.pitch;
+        for (auto dy = span.top; dy < span.bottom; dy++) {
+            blit_draw_row(span, row, dy);
+            row += target.pitch;
+        }
+
+        return true;
+    }
+
+}
@@ -0,0 +1,132 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include "palette.h"
+
+namespace mayhem {
+
+    // hflip and vflip share their bit positions with tile_flags_t and
+    // sprite_flags_t so callers can mask flags straight through.  blend
+    // wins over keyed and expects premultiplied BGRA32 sources.
+    enum class blit_flags_t : uint8_t {
+        none        = 0b00000000,
+        keyed       = 0b00000001,
+        blend       = 0b00000010,
+        hflip       = 0b00000100,
+        vflip       = 0b00001000,
+    };
+
+    enum class blit_isa_t : uint8_t {
+        scalar,
+        sse2,
+        ssse3,
+        avx2,
+    };
+
+    // row kernels copy count BGRA32 pixels from src to dst.  the hflip
+    // variants read src right-to-left, starting at src[count - 1].  the keyed
+    // variants leave dst untouched where the source alpha is zero; the blend
+    // variants draw premultiplied source pixels over dst.
+    using blit_row_kernel_t = void (*)(uint32_t* dst, const uint32_t* src, uint32_t count);
+
+    // expansion kernels turn count 8bpp palette indices into BGRA32 pixels.
+    // expand_nibble is only valid when every index is below 16.
+    using blit_expand_kernel_t = void (*)(
+        uint32_t* dst,
+        const uint8_t* src,
+        uint32_t count,
+        const palette_t& pal);
+
+    struct blit_kernels_t {
+        blit_isa_t isa = blit_isa_t::scalar;
+        blit_row_kernel_t copy = nullptr;
+        blit_row_kernel_t copy_hflip = nullptr;
+        blit_row_kernel_t keyed = nullptr;
+        blit_row_kernel_t keyed_hflip = nullptr;
+        blit_row_kernel_t blend = nullptr;
+        blit_row_kernel_t blend_hflip = nullptr;
+        blit_expand_kernel_t expand = nullptr;
+        blit_expand_kernel_t expand_nibble = nullptr;
+    };
+
+    struct blit_target_t {
+        uint32_t* pixels = nullptr;
+        int32_t pitch = 0;
+        int32_t clip_left = 0;
+        int32_t clip_top = 0;
+        int32_t clip_right = 0;
+        int32_t clip_bottom = 0;
+    };
+
+    // either pixels (BGRA32) or indices plus a palette is set.  nibble marks
+    // indexed bitmaps that only use the first 16 palette entries.
+    struct blit_source_t {
+        const uint32_t* pixels = nullptr;
+        int32_t pitch = 0;
+        int32_t w = 0;
+        int32_t h = 0;
+        const uint8_t* indices = nullptr;
+        const palette_t* palette = nullptr;
+        bool nibble = false;
+    };
+
+    // a source clipped against a target, with its kernels chosen; rows in
+    // [top, bottom) of the target can then be drawn in any order.
+    struct blit_span_t {
+        int32_t y = 0;
+        int32_t top = 0;
+        int32_t left = 0;
+        int32_t bottom = 0;
+        int32_t src_x = 0;
+        uint32_t count = 0;
+        bool hflip = false;
+        bool vflip = false;
+        blit_source_t source{};
+        blit_row_kernel_t kernel = nullptr;
+        blit_expand_kernel_t expand = nullptr;
+    };
+
+    void blit_init();
+
+    bool blit_select(blit_isa_t isa);
+
+    std::string_view blit_isa_name(blit_isa_t isa);
+
+    // the reverse of blit_isa_name; false for a name it never returns
+    bool blit_isa_parse(std::string_view name, blit_isa_t& isa);
+
+    const blit_kernels_t& blit_kernels();
+
+    const blit_kernels_t* blit_kernels(blit_isa_t isa);
+
+    bool blit_prepare(
+        const blit_target_t& target,
+        const blit_source_t& source,
+        int32_t x,
+        int32_t y,
+        uint8_t flags,
+        blit_span_t& span);
+
+    // row points at the first pixel of target line dy
+    void blit_draw_row(const blit_span_t& span, uint32_t* row, int32_t dy);
+
+    // pitches are in pixels.  the source is clipped once against the target's
+    // clip rectangle, then drawn row by row with the selected kernels.
+    bool blit_draw(
+        const blit_target_t& target,
+        const blit_source_t& source,
+        int32_t x,
+        int32_t y,
+        uint8_t flags);
+
+}
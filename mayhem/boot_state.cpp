@@ -7,6 +7,7 @@
 //
 // ----------------------------------------------------------------------------
 
+#include <algorithm>
 #include "game.h"
 #include "boot_state.h"
 
@@ -16,9 +17,48 @@ namespace mayhem {
     }
 
     bool boot_state::update(common::result& r, game_t& game) {
+        return true;
+    }
+
+    // the logos are drawn once every queued asset has been stored; until
+    // then a bar tracks the loader, with a marker sweeping the unfilled part
+    // so the screen keeps moving while a large asset decodes.
+    bool boot_state::draw(common::result& r, game_t& game, float alpha) {
+        const auto progress = asset_loader_progress(game.assets);
+        if (progress.ready + progress.failed < progress.total)
+            return draw_progress(r, game, progress);
+
         video_queue_image(r, game, bank_id_t{0xff, 2}, 100, 135);
         video_queue_image(r, game, bank_id_t{0xff, 1}, 400, 175);
         return true;
     }
 
+    bool boot_state::draw_progress(
+            common::result& r,
+            game_t& game,
+            const asset_loader_progress_t& progress) {
+        const color_t white = {.r = 0xff, .g = 0xff, .b = 0xff, .a = 0xff};
+        const color_t grey = {.r = 0x60, .g = 0x60, .b = 0x60, .a = 0xff};
+        const int32_t bar_width = 256;
+        const int32_t bar_height = 8;
+        const int32_t x = (screen_width - bar_width) / 2;
+        const int32_t y = screen_height / 2;
+
+        const auto fill = (int32_t) (bar_width * progress.ready / std::max<uint32_t>(progress.total, 1));
+        if (!video_queue_box(r, game, grey, y, x, bar_width, bar_height))
+            return false;
+        if (fill > 0 && !video_queue_box(r, game, white, y, x, fill, bar_height, true))
+            return false;
+
+        const auto remaining = bar_width - fill;
+        const auto marker = std::min(remaining, 16);
+        if (remaining > marker) {
+            const auto offset = (int32_t) ((game.ticks / 4) % (remaining - marker));
+            if (!video_queue_box(r, game, grey, y, x + fill + offset, marker, bar_height, true))
+                return false;
+        }
+
+        return true;
+    }
+
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include "asset_loader.h"
 #include "state_machine.h"
 
 namespace mayhem {
@@ -27,7 +28,13 @@ namespace mayhem {
 
         bool update(common::result& r, game_t& game) override;
 
+        bool draw(common::result& r, game_t& game, float alpha) override;
+
     private:
+        bool draw_progress(
+            common::result& r,
+            game_t& game,
+            const asset_loader_progress_t& progress);
     };
 
 }
@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "dirty_map.h"
+
+namespace mayhem::common {
+
+    dirty_map::dirty_map(uint32_t width, uint32_t height) {
+        resize(width, height);
+    }
+
+    void dirty_map::clear() {
+        std::fill(std::begin(_rows), std::end(_rows), 0);
+        std::fill(std::begin(_cells), std::end(_cells), 0);
+    }
+
+    bool dirty_map::empty() const {
+        for (auto word : _rows)
+            if (word != 0)
+                return false;
+        return true;
+    }
+
+    void dirty_map::mark_all() {
+        mark_rect(0, 0, _width, _height);
+    }
+
+    uint32_t dirty_map::width() const {
+        return _width;
+    }
+
+    uint32_t dirty_map::height() const {
+        return _height;
+    }
+
+    uint32_t dirty_map::count() const {
+        uint32_t total = 0;
+        for (auto word : _cells)
+            total += static_cast<uint32_t>(__builtin_popcountll(word));
+        return total;
+    }
+
+    void dirty_map::mark(uint32_t x, uint32_t y) {
+        if (x >= _width || y >= _height)
+            return;
+        _cells[y * _words_per_row + (x >> 6)] |= (uint64_t) 1 << (x & 63);
+        _rows[y >> 6] |= (uint64_t) 1 << (y & 63);
+    }
+
+    bool dirty_map::is_marked(uint32_t x, uint32_t y) const {
+        if (x >= _width || y >= _height)
+            return false;
+        return (_cells[y * _words_per_row + (x >> 6)] & ((uint64_t) 1 << (x & 63))) != 0;
+    }
+
+    void dirty_map::resize(uint32_t width, uint32_t height) {
+        _width = width;
+        _height = height;
+        _words_per_row = (width + 63) / 64;
+        _rows.assign((height + 63) / 64, 0);
+        _cells.assign(_words_per_row * height, 0);
+    }
+
+    void dirty_map::mark_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+        if (x >= _width || y >= _height)
+            return;
+        const auto right = std::min(x + w, _width);
+        const auto bottom = std::min(y + h, _height);
+        for (auto row = y; row < bottom; row++) {
+            for (auto col = x; col < right; col++)
+                mark(col, row);
+        }
+    }
+
+}
@@ -0,0 +1,118 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+namespace mayhem::common {
+
+    // one bit per cell in a width x height grid, plus a summary bit per row
+    // so that clean rows are skipped without touching their cell words.
+    class dirty_map {
+    public:
+        dirty_map() = default;
+
+        dirty_map(uint32_t width, uint32_t height);
+
+        void clear();
+
+        bool empty() const;
+
+        void mark_all();
+
+        uint32_t width() const;
+
+        uint32_t height() const;
+
+        uint32_t count() const;
+
+        void mark(uint32_t x, uint32_t y);
+
+        bool is_marked(uint32_t x, uint32_t y) const;
+
+        void resize(uint32_t width, uint32_t height);
+
+        void mark_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+        // visits every marked cell, row by row, as f(x, y)
+        template <typename F>
+        void for_each(F&& f) const {
+            for_each_row([&](uint32_t y) {
+                const auto row = _cells.data() + y * _words_per_row;
+                for (uint32_t w = 0; w < _words_per_row; w++) {
+                    auto word = row[w];
+                    while (word != 0) {
+                        const auto bit = static_cast<uint32_t>(__builtin_ctzll(word));
+                        f(w * 64 + bit, y);
+                        word &= word - 1;
+                    }
+                }
+            });
+        }
+
+        // visits each run of adjacent marked cells in a row as f(x, y, length)
+        template <typename F>
+        void for_each_span(F&& f) const {
+            for_each_row([&](uint32_t y) {
+                row_spans(y, f);
+            });
+        }
+
+        // as above, limited to rows [first_row, last_row)
+        template <typename F>
+        void for_each_span(uint32_t first_row, uint32_t last_row, F&& f) const {
+            last_row = last_row < _height ? last_row : _height;
+            for (auto y = first_row; y < last_row; y++) {
+                if ((_rows[y >> 6] & ((uint64_t) 1 << (y & 63))) != 0)
+                    row_spans(y, f);
+            }
+        }
+
+    private:
+        template <typename F>
+        void row_spans(uint32_t y, F&& f) const {
+            uint32_t start = 0;
+            uint32_t length = 0;
+            for (uint32_t x = 0; x < _width; x++) {
+                if (is_marked(x, y)) {
+                    if (length == 0)
+                        start = x;
+                    ++length;
+                } else if (length > 0) {
+                    f(start, y, length);
+                    length = 0;
+                }
+            }
+            if (length > 0)
+                f(start, y, length);
+        }
+
+        template <typename F>
+        void for_each_row(F&& f) const {
+            for (uint32_t w = 0; w < _rows.size(); w++) {
+                auto word = _rows[w];
+                while (word != 0) {
+                    const auto bit = static_cast<uint32_t>(__builtin_ctzll(word));
+                    f(w * 64 + bit);
+                    word &= word - 1;
+                }
+            }
+        }
+
+    private:
+        uint32_t _width = 0;
+        uint32_t _height = 0;
+        uint32_t _words_per_row = 0;
+        std::vector<uint64_t> _rows{};
+        std::vector<uint64_t> _cells{};
+    };
+
+}
@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include "frame_arena.h"
+
+namespace mayhem::common {
+
+    frame_arena::frame_arena(std::size_t block_size) : _block_size(std::max<std::size_t>(block_size, 64)) {
+        add_block(_block_size);
+    }
+
+    void* frame_arena::allocate(std::size_t size, std::size_t align) {
+        for (;;) {
+            auto& block = _blocks[_current];
+            const auto base = reinterpret_cast<std::uintptr_t>(block.data.get());
+            const auto start = (base + _offset + align - 1) & ~(std::uintptr_t) (align - 1);
+            const auto end = start - base + size;
+            if (end <= block.size) {
+                _used += end - _offset;
+                _high_water = std::max(_high_water, _used);
+                _offset = end;
+                return reinterpret_cast<void*>(start);
+            }
+
+            // the rest of this block goes unused until the next reset
+            _used += block.size - _offset;
+            _offset = 0;
+            if (++_current == _blocks.size())
+                add_block(std::max(_block_size, size + align));
+        }
+    }
+
+    void frame_arena::reset() {
+        if (_blocks.size() > 1) {
+            std::size_t total = 0;
+            for (const auto& block : _blocks)
+                total += block.size;
+            _blocks.clear();
+            add_block(total);
+        }
+        _current = 0;
+        _offset = 0;
+        _used = 0;
+    }
+
+    frame_arena_stats_t frame_arena::stats() const {
+        frame_arena_stats_t stats{};
+        stats.used = _used;
+        stats.high_water = _high_water;
+        stats.blocks = _blocks.size();
+        for (const auto& block : _blocks)
+            stats.capacity += block.size;
+        return stats;
+    }
+
+    void frame_arena::add_block(std::size_t size) {
+        block_t block{};
+        block.data = std::make_unique<uint8_t[]>(size);
+        block.size = size;
+        _blocks.push_back(std::move(block));
+    }
+
+}
@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <new>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+#include <fmt/format.h>
+
+namespace mayhem::common {
+
+    struct frame_arena_stats_t {
+        std::size_t used = 0;
+        std::size_t capacity = 0;
+        std::size_t high_water = 0;
+        std::size_t blocks = 0;
+    };
+
+    // a bump allocator for data that lives until the end of the frame.
+    // nothing is freed on its own: reset() takes everything back at once.
+    // when a frame outgrows the first block, more are chained on, and the
+    // next reset() replaces them all with a single block big enough for
+    // that frame, so a steady frame allocates nothing from the heap.
+    //
+    // not thread-safe; each arena belongs to the thread that runs the frame.
+    class frame_arena {
+    public:
+        explicit frame_arena(std::size_t block_size);
+
+        frame_arena(const frame_arena&) = delete;
+
+        void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t));
+
+        // destructors never run, so only trivially destructible types
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            static_assert(std::is_trivially_destructible_v<T>);
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        T* make_array(std::size_t count) {
+            static_assert(std::is_trivially_destructible_v<T>);
+            auto data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+            for (std::size_t i = 0; i < count; i++)
+                new (data + i) T();
+            return data;
+        }
+
+        // formats into a stack buffer and copies the text into the arena, in
+        // place of a std::string per call; the view is valid until reset
+        template <typename... Args>
+        std::string_view format(fmt::string_view format_string, const Args&... args) {
+            fmt::memory_buffer buffer;
+            fmt::format_to(buffer, format_string, args...);
+            auto data = static_cast<char*>(allocate(buffer.size(), 1));
+            std::copy(buffer.begin(), buffer.end(), data);
+            return std::string_view(data, buffer.size());
+        }
+
+        void reset();
+
+        frame_arena_stats_t stats() const;
+
+    private:
+        struct block_t {
+            std::unique_ptr<uint8_t[]> data;
+            std::size_t size = 0;
+        };
+
+        void add_block(std::size_t size);
+
+    private:
+        std::size_t _block_size;
+        std::vector<block_t> _blocks{};
+        std::size_t _current = 0;
+        std::size_t _offset = 0;
+        std::size_t _used = 0;
+        std::size_t _high_water = 0;
+    };
+
+}
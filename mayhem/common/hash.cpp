@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include "hash.h"
+#include "bytes.h"
+
+namespace mayhem::common {
+
+    static constexpr uint64_t prime_1 = 0x9e3779b185ebca87ull;
+    static constexpr uint64_t prime_2 = 0xc2b2ae3d27d4eb4full;
+    static constexpr uint64_t prime_3 = 0x165667b19e3779f9ull;
+    static constexpr uint64_t prime_4 = 0x85ebca77c2b2ae63ull;
+    static constexpr uint64_t prime_5 = 0x27d4eb2f165667c5ull;
+
+    static inline uint64_t read64(const uint8_t* p) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t read32(const uint8_t* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * prime_2;
+        acc = rotl(acc, 31);
+        return acc * prime_1;
+    }
+
+    static inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * prime_1 + prime_4;
+    }
+
+    uint64_t hash64(const void* data, std::size_t size, uint64_t seed) {
+        auto p = static_cast<const uint8_t*>(data);
+        const auto end = p + size;
+        uint64_t h;
+
+        if (size >= 32) {
+            // four independent lanes keep the multiplier pipelines full
+            auto v1 = seed + prime_1 + prime_2;
+            auto v2 = seed + prime_2;
+            auto v3 = seed;
+            auto v4 = seed - prime_1;
+            const auto limit = end - 32;
+            do {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge_round(h, v1);
+            h = merge_round(h, v2);
+            h = merge_round(h, v3);
+            h = merge_round(h, v4);
+        } else {
+            h = seed + prime_5;
+        }
+
+        h += static_cast<uint64_t>(size);
+
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime_1 + prime_4;
+        }
+        if (p + 4 <= end) {
+            h ^= static_cast<uint64_t>(read32(p)) * prime_1;
+            h = rotl(h, 23) * prime_2 + prime_3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= static_cast<uint64_t>(*p) * prime_5;
+            h = rotl(h, 11) * prime_1;
+        }
+
+        h ^= h >> 33;
+        h *= prime_2;
+        h ^= h >> 29;
+        h *= prime_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+}
@@ -0,0 +1,21 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mayhem::common {
+
+    // xxh64: fast, well mixed and stable across runs and platforms of the
+    // same endianness.  not a cryptographic hash.
+    uint64_t hash64(const void* data, std::size_t size, uint64_t seed = 0);
+
+}
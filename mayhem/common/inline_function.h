@@ -0,0 +1,186 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+namespace mayhem::common {
+
+    template <typename Signature, std::size_t Capacity = 32>
+    class inline_function;
+
+    // a move-only std::function that keeps the callable in capacity bytes
+    // of its own storage and never touches the heap; a callable that does
+    // not fit is a compile error, not a hidden allocation.  plain function
+    // pointers and function pointer plus context pairs are stored as is.
+    // callables that are trivially copyable and destructible, which covers
+    // those two and most small lambdas, are moved with a memcpy and need no
+    // destructor call.
+    //
+    // calling an empty inline_function is undefined; test it with
+    // operator bool first where it may be empty.
+    template <typename R, typename... Args, std::size_t Capacity>
+    class inline_function<R (Args...), Capacity> {
+    public:
+        using function_t = R (*)(Args...);
+
+        using context_function_t = R (*)(void*, Args...);
+
+        inline_function() = default;
+
+        inline_function(std::nullptr_t) {
+        }
+
+        inline_function(function_t function) {
+            if (function != nullptr)
+                emplace<function_t>(function, &invoke_callable<function_t>);
+        }
+
+        inline_function(context_function_t function, void* context) {
+            if (function != nullptr)
+                emplace<bound_t>(bound_t{function, context}, &invoke_bound);
+        }
+
+        template <
+            typename F,
+            typename Callable = std::decay_t<F>,
+            typename = std::enable_if_t<
+                !std::is_same_v<Callable, inline_function>
+                && std::is_invocable_r_v<R, Callable&, Args...>>>
+        inline_function(F&& callable) {
+            static_assert(
+                sizeof(Callable) <= Capacity,
+                "callable does not fit inline_function's storage; raise Capacity or capture less");
+            static_assert(
+                alignof(Callable) <= alignof(std::max_align_t),
+                "callable is over-aligned for inline_function's storage");
+            emplace<Callable>(std::forward<F>(callable), &invoke_callable<Callable>);
+        }
+
+        inline_function(const inline_function&) = delete;
+
+        inline_function(inline_function&& other) noexcept {
+            move_from(other);
+        }
+
+        ~inline_function() {
+            reset();
+        }
+
+        inline_function& operator=(const inline_function&) = delete;
+
+        inline_function& operator=(inline_function&& other) noexcept {
+            if (this != &other) {
+                reset();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        inline_function& operator=(std::nullptr_t) {
+            reset();
+            return *this;
+        }
+
+        explicit operator bool() const {
+            return _invoke != nullptr;
+        }
+
+        R operator()(Args... args) {
+            return _invoke(&_storage, std::forward<Args>(args)...);
+        }
+
+    private:
+        enum class operation_t {
+            move,
+            destroy
+        };
+
+        using invoke_t = R (*)(void*, Args&&...);
+
+        // moves src into dst and destroys src, or destroys dst
+        using manage_t = void (*)(operation_t, void* dst, void* src);
+
+        struct bound_t {
+            context_function_t function;
+            void* context;
+        };
+
+        template <typename Callable>
+        static constexpr bool is_trivial_v = std::is_trivially_copyable_v<Callable>
+            && std::is_trivially_destructible_v<Callable>;
+
+        static R invoke_bound(void* storage, Args&&... args) {
+            auto bound = static_cast<bound_t*>(storage);
+            return bound->function(bound->context, std::forward<Args>(args)...);
+        }
+
+        template <typename Callable>
+        static R invoke_callable(void* storage, Args&&... args) {
+            return (*static_cast<Callable*>(storage))(std::forward<Args>(args)...);
+        }
+
+        template <typename Callable>
+        static void manage_callable(operation_t operation, void* dst, void* src) {
+            switch (operation) {
+                case operation_t::move: {
+                    auto source = static_cast<Callable*>(src);
+                    new (dst) Callable(std::move(*source));
+                    source->~Callable();
+                    break;
+                }
+                case operation_t::destroy: {
+                    static_cast<Callable*>(dst)->~Callable();
+                    break;
+                }
+            }
+        }
+
+        template <typename Callable, typename F>
+        void emplace(F&& callable, invoke_t invoke) {
+            new (&_storage) Callable(std::forward<F>(callable));
+            _invoke = invoke;
+            if constexpr (!is_trivial_v<Callable>)
+                _manage = &manage_callable<Callable>;
+        }
+
+        void move_from(inline_function& other) {
+            if (other._invoke == nullptr)
+                return;
+            if (other._manage != nullptr)
+                other._manage(operation_t::move, &_storage, &other._storage);
+            else
+                std::memcpy(&_storage, &other._storage, Capacity);
+            _invoke = other._invoke;
+            _manage = other._manage;
+            other._invoke = nullptr;
+            other._manage = nullptr;
+        }
+
+        void reset() {
+            if (_manage != nullptr)
+                _manage(operation_t::destroy, &_storage, nullptr);
+            _invoke = nullptr;
+            _manage = nullptr;
+        }
+
+    private:
+        static_assert(Capacity >= sizeof(bound_t), "inline_function needs room for a function and context");
+
+        invoke_t _invoke = nullptr;
+        manage_t _manage = nullptr;
+        std::aligned_storage_t<Capacity, alignof(std::max_align_t)> _storage;
+    };
+
+}
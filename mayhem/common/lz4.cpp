@@ -0,0 +1,348 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <algorithm>
+#include "lz4.h"
+
+namespace mayhem::common {
+
+    static constexpr std::size_t min_match = 4;
+
+    // the format requires the last five bytes to be literals and the last
+    // match to start at least twelve bytes before the end of the block
+    static constexpr std::size_t last_literals = 5;
+
+    static constexpr std::size_t match_limit = 12;
+
+    static constexpr std::size_t max_offset = 65535;
+
+    static constexpr uint8_t run_mask = 15;
+
+    enum stream_state_t : uint8_t {
+        state_token,
+        state_literal_length,
+        state_literals,
+        state_offset_low,
+        state_offset_high,
+        state_match_length,
+        state_match,
+        state_done,
+        state_error
+    };
+
+    static inline uint32_t read32(const uint8_t* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t hash_sequence(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - lz4_compress_state_t::hash_log);
+    }
+
+    static inline uint8_t* write_length(uint8_t* op, std::size_t length) {
+        for (; length >= 255; length -= 255)
+            *op++ = 255;
+        *op++ = (uint8_t) length;
+        return op;
+    }
+
+    static inline bool read_length(const uint8_t*& ip, const uint8_t* end, std::size_t& length) {
+        for (;;) {
+            if (ip == end)
+                return false;
+            const auto b = *ip++;
+            length += b;
+            if (b != 255)
+                return true;
+        }
+    }
+
+    // copies a match that may overlap its own output.  a source period
+    // shorter than the match is widened by whole periods each step, so a
+    // run of one repeated byte takes log2(length) copies instead of length.
+    static inline void match_copy(uint8_t* op, std::size_t offset, std::size_t length) {
+        const auto match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            return;
+        }
+
+        std::size_t copied = 0;
+        std::size_t distance = offset;
+        while (copied < length) {
+            const auto n = std::min(distance, length - copied);
+            memcpy(op + copied, op + copied - distance, n);
+            copied += n;
+            distance = offset * ((copied + offset) / offset);
+        }
+    }
+
+    static uint8_t* write_sequence(
+            uint8_t* op,
+            const uint8_t* literals,
+            std::size_t literal_length,
+            std::size_t offset,
+            std::size_t match_length) {
+        auto token = op++;
+        *token = (uint8_t) (std::min<std::size_t>(literal_length, run_mask) << 4);
+        if (literal_length >= run_mask)
+            op = write_length(op, literal_length - run_mask);
+        memcpy(op, literals, literal_length);
+        op += literal_length;
+
+        if (match_length == 0)
+            return op;
+
+        *op++ = (uint8_t) (offset & 0xff);
+        *op++ = (uint8_t) (offset >> 8);
+
+        const auto length = match_length - min_match;
+        *token |= (uint8_t) std::min<std::size_t>(length, run_mask);
+        if (length >= run_mask)
+            op = write_length(op, length - run_mask);
+        return op;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    std::size_t lz4_compress_bound(std::size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    // greedy single pass over the state's hash table, skipping faster
+    // through data that does not compress.  the table is only cleared when
+    // base would run past what 32 bits can hold.
+    std::size_t lz4_compress(
+            lz4_compress_state_t& state,
+            const uint8_t* src,
+            std::size_t src_size,
+            uint8_t* dst,
+            std::size_t dst_capacity) {
+        if (dst_capacity < lz4_compress_bound(src_size))
+            return 0;
+
+        auto op = dst;
+        std::size_t anchor = 0;
+
+        if (src_size > match_limit) {
+            if (src_size > UINT32_MAX - state.base) {
+                memset(state.table, 0, sizeof(state.table));
+                state.base = 1;
+            }
+            const auto base = state.base;
+            state.base += (uint32_t) src_size;
+
+            auto table = state.table;
+            const auto limit = src_size - match_limit;
+            const auto match_end = src_size - last_literals;
+
+            std::size_t ip = 0;
+            while (ip <= limit) {
+                const auto sequence = read32(src + ip);
+                const auto h = hash_sequence(sequence);
+                const auto entry = table[h];
+                table[h] = base + (uint32_t) ip;
+
+                std::size_t ref = entry - base;
+                if (entry < base
+                ||  ref >= ip
+                ||  ip - ref > max_offset
+                ||  read32(src + ref) != sequence) {
+                    ip += 1 + ((ip - anchor) >> 6);
+                    continue;
+                }
+
+                while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                    --ip;
+                    --ref;
+                }
+
+                auto length = min_match;
+                while (ip + length < match_end && src[ip + length] == src[ref + length])
+                    ++length;
+
+                op = write_sequence(op, src + anchor, ip - anchor, ip - ref, length);
+                ip += length;
+                anchor = ip;
+            }
+        }
+
+        op = write_sequence(op, src + anchor, src_size - anchor, 0, 0);
+        return (std::size_t) (op - dst);
+    }
+
+    // every copy is bounds checked against both buffers; when there is room
+    // past the end of a copy, short literals and far matches are copied in
+    // whole 16 byte chunks instead of exactly.
+    bool lz4_decompress(
+            const uint8_t* src,
+            std::size_t src_size,
+            uint8_t* dst,
+            std::size_t dst_size) {
+        auto ip = src;
+        const auto iend = src + src_size;
+        auto op = dst;
+        const auto oend = dst + dst_size;
+
+        for (;;) {
+            if (ip == iend)
+                return false;
+
+            const auto token = *ip++;
+            std::size_t literal_length = token >> 4;
+            if (literal_length == run_mask && !read_length(ip, iend, literal_length))
+                return false;
+
+            if (literal_length > (std::size_t) (iend - ip)
+            ||  literal_length > (std::size_t) (oend - op)) {
+                return false;
+            }
+
+            if (literal_length <= 16 && iend - ip >= 16 && oend - op >= 16)
+                memcpy(op, ip, 16);
+            else
+                memcpy(op, ip, literal_length);
+            op += literal_length;
+            ip += literal_length;
+
+            if (ip == iend)
+                return op == oend;
+
+            if (iend - ip < 2)
+                return false;
+            const std::size_t offset = ip[0] | ((std::size_t) ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (std::size_t) (op - dst))
+                return false;
+
+            std::size_t match_length = token & run_mask;
+            if (match_length == run_mask && !read_length(ip, iend, match_length))
+                return false;
+            match_length += min_match;
+            if (match_length > (std::size_t) (oend - op))
+                return false;
+
+            if (offset >= 16 && (std::size_t) (oend - op) >= match_length + 15) {
+                const auto match = op - offset;
+                for (std::size_t i = 0; i < match_length; i += 16)
+                    memcpy(op + i, match + i, 16);
+            } else {
+                match_copy(op, offset, match_length);
+            }
+            op += match_length;
+        }
+    }
+
+    void lz4_stream_init(lz4_stream_t& stream, uint8_t* dst, std::size_t dst_size) {
+        stream = lz4_stream_t{};
+        stream.dst = dst;
+        stream.dst_size = dst_size;
+        stream.state = state_token;
+    }
+
+    // the block ends with its last literals, so the stream is done once
+    // literals fill the output.
+    lz4_status_t lz4_stream_decode(
+            lz4_stream_t& stream,
+            const uint8_t* src,
+            std::size_t size) {
+        auto ip = src;
+        const auto end = src + size;
+
+        for (;;) {
+            switch (stream.state) {
+                case state_token: {
+                    if (ip == end)
+                        return lz4_status_t::more;
+                    stream.token = *ip++;
+                    stream.length = stream.token >> 4;
+                    stream.state = stream.length == run_mask ?
+                        state_literal_length :
+                        state_literals;
+                    break;
+                }
+                case state_literal_length: {
+                    if (ip == end)
+                        return lz4_status_t::more;
+                    const auto b = *ip++;
+                    stream.length += b;
+                    if (b != 255)
+                        stream.state = state_literals;
+                    break;
+                }
+                case state_literals: {
+                    if (stream.length > stream.dst_size - stream.written) {
+                        stream.state = state_error;
+                        break;
+                    }
+                    const auto n = std::min<std::size_t>(stream.length, end - ip);
+                    if (n > 0)
+                        memcpy(stream.dst + stream.written, ip, n);
+                    stream.written += n;
+                    stream.length -= n;
+                    ip += n;
+                    if (stream.length > 0)
+                        return lz4_status_t::more;
+                    stream.state = stream.written == stream.dst_size ?
+                        state_done :
+                        state_offset_low;
+                    break;
+                }
+                case state_offset_low: {
+                    if (ip == end)
+                        return lz4_status_t::more;
+                    stream.offset = *ip++;
+                    stream.state = state_offset_high;
+                    break;
+                }
+                case state_offset_high: {
+                    if (ip == end)
+                        return lz4_status_t::more;
+                    stream.offset |= (uint32_t) *ip++ << 8;
+                    if (stream.offset == 0 || stream.offset > stream.written) {
+                        stream.state = state_error;
+                        break;
+                    }
+                    stream.length = stream.token & run_mask;
+                    stream.state = stream.length == run_mask ?
+                        state_match_length :
+                        state_match;
+                    break;
+                }
+                case state_match_length: {
+                    if (ip == end)
+                        return lz4_status_t::more;
+                    const auto b = *ip++;
+                    stream.length += b;
+                    if (b != 255)
+                        stream.state = state_match;
+                    break;
+                }
+                case state_match: {
+                    const auto length = stream.length + min_match;
+                    if (length > stream.dst_size - stream.written) {
+                        stream.state = state_error;
+                        break;
+                    }
+                    match_copy(stream.dst + stream.written, stream.offset, length);
+                    stream.written += length;
+                    stream.state = state_token;
+                    break;
+                }
+                case state_done:
+                    return lz4_status_t::done;
+                default:
+                    return lz4_status_t::error;
+            }
+        }
+    }
+
+}
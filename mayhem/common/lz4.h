@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mayhem::common {
+
+    // the lz4 block format: a token byte holds the literal and match lengths
+    // as nybbles, extended by runs of 255 bytes, followed by the literals and
+    // a little-endian 16-bit match offset.  the last sequence is literals
+    // only.  blocks are byte oriented, so decoding is a series of copies.
+
+    enum class lz4_status_t : uint8_t {
+        more,
+        done,
+        error
+    };
+
+    // decodes a block fed to it in pieces of any size.  the whole
+    // uncompressed output is the match window, so dst must have room for
+    // all of it and must not move until the stream is done.
+    struct lz4_stream_t {
+        uint8_t* dst = nullptr;
+        std::size_t dst_size = 0;
+        std::size_t written = 0;
+        uint8_t state = 0;
+        uint8_t token = 0;
+        std::size_t length = 0;
+        uint32_t offset = 0;
+    };
+
+    // the compressor's hash table of where each four byte sequence was last
+    // seen, kept by the caller so that repeated calls neither allocate nor
+    // clear it.  positions are stored past base, which each call moves on
+    // by the size of its input, so entries from earlier calls, and the
+    // zeroes of a new table, read as stale and the output does not depend
+    // on what the state compressed before.  it is 256 KB, too large for
+    // most stacks; a new one must be value-initialized.
+    struct lz4_compress_state_t {
+        static constexpr uint32_t hash_log = 16;
+
+        uint32_t base = 1;
+        uint32_t table[1u << hash_log];
+    };
+
+    // the largest block lz4_compress can produce for size bytes of input
+    std::size_t lz4_compress_bound(std::size_t size);
+
+    // returns the size of the block written to dst, or zero when dst is
+    // smaller than lz4_compress_bound(src_size)
+    std::size_t lz4_compress(
+        lz4_compress_state_t& state,
+        const uint8_t* src,
+        std::size_t src_size,
+        uint8_t* dst,
+        std::size_t dst_capacity);
+
+    // decodes a whole block; false unless it is well formed and decodes to
+    // exactly dst_size bytes
+    bool lz4_decompress(
+        const uint8_t* src,
+        std::size_t src_size,
+        uint8_t* dst,
+        std::size_t dst_size);
+
+    void lz4_stream_init(lz4_stream_t& stream, uint8_t* dst, std::size_t dst_size);
+
+    lz4_status_t lz4_stream_decode(
+        lz4_stream_t& stream,
+        const uint8_t* src,
+        std::size_t size);
+
+}
@@ -7,9 +7,77 @@
 //
 // ----------------------------------------------------------------------------
 
+#include <functional>
 #include "memory_pool.h"
 
 namespace mayhem::common {
 
+    struct memory_pool_entry_t {
+        void* pool;
+        memory_pool_drain_t drain;
+    };
 
-}
\ No newline at end of file
+    // slots past the highest ever handed out are free; below it, only
+    // those in s_free_slots
+    static std::mutex s_mutex{};
+    static uint32_t s_next_slot = 0;
+    static std::vector<uint32_t> s_free_slots{};
+    static std::vector<memory_pool_entry_t> s_pools{};
+
+    // anything a thread_local destructor frees after this one has run goes
+    // through the pools' shared cache instead
+    static constexpr uint32_t exited_slot = UINT32_MAX - 1;
+
+    static void memory_pool_release_slot(uint32_t slot) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (const auto& entry : s_pools)
+            entry.drain(entry.pool, slot);
+        s_free_slots.push_back(slot);
+        std::push_heap(s_free_slots.begin(), s_free_slots.end(), std::greater<>());
+    }
+
+    struct memory_pool_slot_guard_t {
+        ~memory_pool_slot_guard_t() {
+            if (slot == UINT32_MAX)
+                return;
+            memory_pool_release_slot(slot);
+            t_memory_pool_slot = exited_slot;
+        }
+
+        uint32_t slot = UINT32_MAX;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    // the guard is only touched here, so the inline fast path keeps reading
+    // a trivially destructible thread_local
+    uint32_t memory_pool_next_slot() {
+        static thread_local memory_pool_slot_guard_t t_guard{};
+
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (s_free_slots.empty()) {
+            t_guard.slot = s_next_slot++;
+        } else {
+            std::pop_heap(s_free_slots.begin(), s_free_slots.end(), std::greater<>());
+            t_guard.slot = s_free_slots.back();
+            s_free_slots.pop_back();
+        }
+        return t_guard.slot;
+    }
+
+    void memory_pool_register(void* pool, memory_pool_drain_t drain) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_pools.push_back(memory_pool_entry_t{pool, drain});
+    }
+
+    void memory_pool_unregister(void* pool) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_pools.erase(
+            std::remove_if(
+                s_pools.begin(),
+                s_pools.end(),
+                [&](const memory_pool_entry_t& entry) { return entry.pool == pool; }),
+            s_pools.end());
+    }
+
+}
@@ -9,33 +9,89 @@
 
 #pragma once
 
+#include <new>
+#include <mutex>
+#include <atomic>
 #include <memory>
+#include <vector>
 #include <cstdint>
+#include <algorithm>
 
 namespace mayhem::common {
 
+    struct memory_pool_stats_t {
+        std::size_t arenas = 0;
+        std::size_t capacity = 0;
+        std::size_t live = 0;
+        std::size_t high_water = 0;
+    };
+
+    // a free slot for the calling thread, which is handed back when the
+    // thread exits; the lowest free one first, so slots stay below
+    // cache_slots as long as fewer threads than that are alive at once.
+    uint32_t memory_pool_next_slot();
+
+    // every live pool is told when a thread exits, so the items left in that
+    // thread's cache go back to the pool's free list before the slot is
+    // handed to another thread
+    using memory_pool_drain_t = void (*)(void* pool, uint32_t slot);
+
+    void memory_pool_register(void* pool, memory_pool_drain_t drain);
+
+    void memory_pool_unregister(void* pool);
+
+    inline thread_local uint32_t t_memory_pool_slot = UINT32_MAX;
+
+    // the cache slot of the calling thread, handed out when it first asks
+    // for one and fixed until the thread exits
+    inline uint32_t memory_pool_thread_slot() {
+        if (t_memory_pool_slot == UINT32_MAX)
+            t_memory_pool_slot = memory_pool_next_slot();
+        return t_memory_pool_slot;
+    }
+
+    // fixed-size items carved out of arenas of arena_size items.  each
+    // thread holding one of the first cache_slots slots owns a small cache
+    // in every pool, which it allocates from and frees into without locking.
+    // a cache is two magazines of up to magazine_size items: allocs pop the
+    // loaded one and frees push onto it, and when it runs empty or full it
+    // is swapped with the previous one if that helps.  only when neither
+    // does is the pool's lock taken, to trade a whole magazine with the
+    // depot of full ones, so a thread going back and forth around one
+    // boundary does not lock on every turn and no item list is walked.
+    // an item freed on another thread than the one that allocated it
+    // simply joins the freeing thread's cache, and a thread's cache goes
+    // back to the pool when it exits.  threads beyond cache_slots share one
+    // cache under the pool's lock.
+    //
+    // the first thread to use a pool becomes its owner and keeps its cache
+    // in the pool itself, found by comparing one pointer, and counts into
+    // plain fields that it publishes for stats() when it changes magazines
+    // or reaches a new peak.  a pool used from a single thread so never looks
+    // up a slot or touches an atomic per item.  ownership ends when that
+    // thread exits.
     template <typename T>
     class memory_pool {
     public:
-        explicit memory_pool(size_t arena_size) : _arena_size(arena_size) {
-            _arena = std::unique_ptr<arena_t>(new arena_t(arena_size));
-            _free_list = _arena->storage();
+        static constexpr uint32_t cache_slots = 32;
+
+        static constexpr uint32_t magazine_size = 32;
+
+        explicit memory_pool(std::size_t arena_size) : _arena_size(std::max<std::size_t>(arena_size, 1)) {
+            add_arena();
+            memory_pool_register(this, &memory_pool::drain_slot);
         }
 
         memory_pool(const memory_pool&) = delete;
 
+        // live items are not destroyed, only their storage is released
+        ~memory_pool() {
+            memory_pool_unregister(this);
+        }
+
         template <typename... Args>
         T* alloc(Args&&... args) {
-            if (_free_list == nullptr) {
-                std::unique_ptr<arena_t> new_arena(new arena_t(_arena_size));
-                new_arena->next_arena(std::move(_arena));
-                _arena.reset(new_arena.release());
-                _free_list = _arena->storage();
-            }
-
-            auto current_item = _free_list;
-            _free_list = current_item->next_item();
-
+            auto current_item = is_owner() ? take_owned() : take_slot();
             auto result = current_item->storage();
             new (result) T(std::forward<Args>(args)...);
             return result;
@@ -45,8 +101,103 @@ namespace mayhem::common {
             value->T::~T();
 
             auto current_item = item_t::storage_to_item(value);
-            current_item->next_item(_free_list);
-            _free_list = current_item;
+            if (is_owner())
+                give_owned(current_item);
+            else
+                give_slot(current_item);
+        }
+
+        // every item is free again at once, without running destructors; for
+        // pools of scratch objects that all die together.  no other thread
+        // may be using the pool.
+        void reset() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& cache : _caches)
+                cache.clear();
+            _owned.clear();
+            _owned_moved = 0;
+            settle_owned();
+            _shared.clear();
+
+            _free = nullptr;
+            _full.clear();
+            for (auto& arena : _arenas)
+                stock_locked(*arena);
+        }
+
+        // returns arenas that hold no live items to the heap, always keeping
+        // one so the next alloc does not have to allocate; returns how many
+        // were released.  the thread caches are emptied first, so no other
+        // thread may be using the pool.
+        //
+        // the free items are gathered into one list that does not track
+        // arenas, so this walks it twice: once to count each arena's free
+        // items and once to unlink the items of the arenas being released.
+        // what is kept stays on that list rather than in magazines.
+        std::size_t release() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& cache : _caches)
+                drain_locked(cache);
+            _owned_moved -= owned_count();
+            drain_locked(_owned);
+            settle_owned();
+            drain_locked(_shared);
+            for (auto& magazine : _full)
+                splice_locked(magazine);
+            _full.clear();
+
+            std::vector<std::size_t> free_counts(_arenas.size(), 0);
+            for (auto item = _free; item != nullptr; item = item->next_item())
+                free_counts[find_arena(item)]++;
+
+            std::vector<bool> released(_arenas.size(), false);
+            std::size_t count = 0;
+            for (std::size_t i = 0; i < _arenas.size() && count + 1 < _arenas.size(); i++) {
+                if (free_counts[i] != _arena_size)
+                    continue;
+                released[i] = true;
+                count++;
+            }
+            if (count == 0)
+                return 0;
+
+            item_t* kept = nullptr;
+            for (auto item = _free; item != nullptr;) {
+                auto next = item->next_item();
+                if (!released[find_arena(item)]) {
+                    item->next_item(kept);
+                    kept = item;
+                }
+                item = next;
+            }
+            _free = kept;
+
+            std::size_t index = 0;
+            _arenas.erase(
+                std::remove_if(
+                    _arenas.begin(),
+                    _arenas.end(),
+                    [&](const std::unique_ptr<arena_t>&) { return released[index++]; }),
+                _arenas.end());
+            return count;
+        }
+
+        // safe to call while other threads allocate.  the owner's items
+        // are counted as of its last magazine change or peak unless the
+        // owner asks.
+        memory_pool_stats_t stats() {
+            if (is_owner())
+                settle_owned();
+
+            memory_pool_stats_t stats{};
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                stats.arenas = _arenas.size();
+                stats.capacity = _arenas.size() * _arena_size;
+            }
+            stats.live = live();
+            stats.high_water = std::max(_high_water.load(std::memory_order_relaxed), stats.live);
+            return stats;
         }
 
     private:
@@ -76,31 +227,368 @@ namespace mayhem::common {
         };
 
         struct arena_t {
-            explicit arena_t(size_t size) : _storage(new item_t[size]) {
-                for (size_t i = 1; i < size; i++) {
-                    _storage[i - 1].next_item(&_storage[i]);
+            explicit arena_t(std::size_t size) : size(size), storage(new item_t[size]) {
+            }
+
+            std::size_t size;
+            std::unique_ptr<item_t[]> storage;
+        };
+
+        // a free list of its own.  it does not track its tail, which only
+        // a magazine leaving a cache for the free list needs.
+        struct magazine_t {
+            item_t* head = nullptr;
+            uint32_t count = 0;
+        };
+
+        // previous is always either empty or full.  allocs and frees are
+        // only written by the cache's owner, so they are counted without
+        // read-modify-write atomics; an item allocated on one thread and
+        // freed on another is counted by both, which still sums to the
+        // right total.
+        struct alignas(64) cache_t {
+            void clear() {
+                loaded = {};
+                previous = {};
+                peak = 0;
+                allocs.store(0, std::memory_order_relaxed);
+                frees.store(0, std::memory_order_relaxed);
+            }
+
+            magazine_t loaded{};
+            magazine_t previous{};
+            std::size_t peak = 0;
+            std::atomic<std::size_t> allocs{0};
+            std::atomic<std::size_t> frees{0};
+        };
+
+        // the slot's thread has exited, so nothing else touches its cache;
+        // the counts stay, since items it allocated may still be live.  an
+        // exiting owner, which is the thread running this, also gives up
+        // ownership, since a later thread may get the same thread_local
+        // address.
+        static void drain_slot(void* pool, uint32_t slot) {
+            auto self = static_cast<memory_pool*>(pool);
+            std::lock_guard<std::mutex> lock(self->_mutex);
+            if (self->is_owner() && self->_owner_slot == slot) {
+                self->_owned_moved -= self->owned_count();
+                self->drain_locked(self->_owned);
+                self->_owned.peak = 0;
+                self->settle_owned();
+                self->_owner.store(nullptr, std::memory_order_relaxed);
+            }
+            if (slot >= cache_slots)
+                return;
+            auto& cache = self->_caches[slot];
+            self->drain_locked(cache);
+            cache.peak = 0;
+        }
+
+        // the address of the calling thread's slot stands in for the thread
+        bool is_owner() const {
+            return _owner.load(std::memory_order_relaxed) == &t_memory_pool_slot;
+        }
+
+        // only a thread with a live slot can own the pool, so that its exit
+        // reaches drain_slot
+        bool claim(uint32_t slot) {
+            if (slot == UINT32_MAX - 1 || _owner.load(std::memory_order_relaxed) != nullptr)
+                return false;
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_owner.load(std::memory_order_relaxed) != nullptr)
+                return false;
+            _owner_slot = slot;
+            _owner.store(&t_memory_pool_slot, std::memory_order_relaxed);
+            return true;
+        }
+
+        std::ptrdiff_t owned_count() const {
+            return (std::ptrdiff_t) (_owned.loaded.count + _owned.previous.count);
+        }
+
+        // the owner's items out are those it moved out of the depot less
+        // those still in its cache.  _owned's allocs carry that count for
+        // other threads; its frees stay zero.
+        std::ptrdiff_t owned_live() const {
+            return _owned_moved - owned_count();
+        }
+
+        // called whenever the owner's moved count, previous magazine or
+        // peak changes.  a new peak is reached exactly when an alloc leaves
+        // loaded with fewer items than _owned_floor, so allocs in between
+        // compare one count.
+        void settle_owned() {
+            _owned_floor = _owned_moved - (std::ptrdiff_t) (_owned.previous.count + _owned.peak);
+            _owned.allocs.store((std::size_t) owned_live(), std::memory_order_relaxed);
+        }
+
+        item_t* take_owned() {
+            if (_owned.loaded.count == 0) {
+                if (!swap_loaded(_owned, 0)) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    refill_locked(_owned.loaded);
+                    _owned_moved += _owned.loaded.count;
+                }
+                settle_owned();
+            }
+            auto item = unlink(_owned.loaded);
+            if ((std::ptrdiff_t) _owned.loaded.count < _owned_floor) {
+                _owned.peak = (std::size_t) owned_live();
+                settle_owned();
+                raise_high_water();
+            }
+            return item;
+        }
+
+        void give_owned(item_t* item) {
+            if (_owned.loaded.count == magazine_size) {
+                if (!swap_loaded(_owned, magazine_size)) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _owned_moved -= magazine_size;
+                    unload_locked(_owned);
                 }
-                _storage[size - 1].next_item(nullptr);
+                settle_owned();
             }
+            link(_owned.loaded, item);
+        }
+
+        item_t* take_slot() {
+            const auto slot = memory_pool_thread_slot();
+            if (claim(slot))
+                return take_owned();
+            return slot < cache_slots ? take(_caches[slot]) : take_shared();
+        }
+
+        void give_slot(item_t* item) {
+            const auto slot = memory_pool_thread_slot();
+            if (claim(slot))
+                give_owned(item);
+            else if (slot < cache_slots)
+                give(_caches[slot], item);
+            else
+                give_shared(item);
+        }
 
-            item_t* storage() const {
-                return _storage.get();
+        item_t* take(cache_t& cache) {
+            if (cache.loaded.count == 0 && !swap_loaded(cache, 0)) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                refill_locked(cache.loaded);
             }
+            return pop(cache);
+        }
 
-            void next_arena(std::unique_ptr<arena_t>&& n) {
-                _next.reset(n.release());
+        void give(cache_t& cache, item_t* item) {
+            if (cache.loaded.count == magazine_size && !swap_loaded(cache, magazine_size)) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                unload_locked(cache);
             }
+            push(cache, item);
+        }
 
-        private:
-            std::unique_ptr<arena_t> _next {};
-            std::unique_ptr<item_t[]> _storage;
-        };
+        item_t* take_shared() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_shared.loaded.count == 0 && !swap_loaded(_shared, 0))
+                refill_locked(_shared.loaded);
+            return pop(_shared);
+        }
+
+        void give_shared(item_t* item) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_shared.loaded.count == magazine_size && !swap_loaded(_shared, magazine_size))
+                unload_locked(_shared);
+            push(_shared, item);
+        }
+
+        // loaded has run empty or full, its count being stuck; previous,
+        // being empty or full itself, only helps if it is the other
+        static bool swap_loaded(cache_t& cache, uint32_t stuck) {
+            if (cache.previous.count == stuck)
+                return false;
+            std::swap(cache.loaded, cache.previous);
+            return true;
+        }
+
+        static item_t* unlink(magazine_t& magazine) {
+            auto item = magazine.head;
+            magazine.head = item->next_item();
+            --magazine.count;
+            return item;
+        }
+
+        static void link(magazine_t& magazine, item_t* item) {
+            item->next_item(magazine.head);
+            magazine.head = item;
+            ++magazine.count;
+        }
+
+        item_t* pop(cache_t& cache) {
+            auto item = unlink(cache.loaded);
+            count_alloc(cache);
+            return item;
+        }
+
+        void push(cache_t& cache, item_t* item) {
+            link(cache.loaded, item);
+            count_free(cache);
+        }
+
+        // the pool-wide count is only summed when this thread's own count
+        // reaches a new peak, which keeps high_water exact for a pool used
+        // from one thread.  with several threads a peak that none of their
+        // own counts reached can go unrecorded.
+        void count_alloc(cache_t& cache) {
+            const auto allocs = cache.allocs.load(std::memory_order_relaxed) + 1;
+            cache.allocs.store(allocs, std::memory_order_relaxed);
+
+            const auto own = allocs - cache.frees.load(std::memory_order_relaxed);
+            if ((std::ptrdiff_t) own <= (std::ptrdiff_t) cache.peak)
+                return;
+            cache.peak = own;
+            raise_high_water();
+        }
+
+        void raise_high_water() {
+            const auto total = live();
+            auto high_water = _high_water.load(std::memory_order_relaxed);
+            while (total > high_water
+               && !_high_water.compare_exchange_weak(high_water, total, std::memory_order_relaxed)) {
+            }
+        }
+
+        void count_free(cache_t& cache) {
+            cache.frees.store(cache.frees.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        std::size_t live() const {
+            std::size_t total = _shared.allocs.load(std::memory_order_relaxed)
+                - _shared.frees.load(std::memory_order_relaxed)
+                + _owned.allocs.load(std::memory_order_relaxed)
+                - _owned.frees.load(std::memory_order_relaxed);
+            for (const auto& cache : _caches) {
+                total += cache.allocs.load(std::memory_order_relaxed)
+                    - cache.frees.load(std::memory_order_relaxed);
+            }
+            // an item freed on one thread before the thread that allocated
+            // it has published the alloc briefly sums below zero
+            return (std::ptrdiff_t) total < 0 ? 0 : total;
+        }
+
+        // caller holds _mutex, or is the constructor.  arenas are kept
+        // sorted by address so release can find an item's arena by binary
+        // search.  the depot is sized for every item in the pool, so
+        // handing it a magazine never allocates.
+        void add_arena() {
+            auto arena = std::make_unique<arena_t>(_arena_size);
+            _full.reserve((_arenas.size() + 1) * _arena_size / magazine_size);
+            stock_locked(*arena);
+            auto it = std::upper_bound(
+                _arenas.begin(),
+                _arenas.end(),
+                arena->storage.get(),
+                [](const item_t* item, const std::unique_ptr<arena_t>& a) {
+                    return item < a->storage.get();
+                });
+            _arenas.insert(it, std::move(arena));
+        }
+
+        std::size_t find_arena(const item_t* item) const {
+            auto it = std::upper_bound(
+                _arenas.begin(),
+                _arenas.end(),
+                item,
+                [](const item_t* value, const std::unique_ptr<arena_t>& a) {
+                    return value < a->storage.get();
+                });
+            return (std::size_t) (it - _arenas.begin()) - 1;
+        }
+
+        // caller holds _mutex.  cuts the arena into full magazines for the
+        // depot, the first items on top, and puts any remainder on the
+        // free list.
+        void stock_locked(arena_t& arena) {
+            const auto whole = arena.size - arena.size % magazine_size;
+            for (auto i = arena.size; i > whole; i--) {
+                arena.storage[i - 1].next_item(_free);
+                _free = &arena.storage[i - 1];
+            }
+            for (auto start = whole; start > 0; start -= magazine_size) {
+                magazine_t magazine{};
+                for (auto i = start; i > start - magazine_size; i--)
+                    link(magazine, &arena.storage[i - 1]);
+                _full.push_back(magazine);
+            }
+        }
+
+        // caller holds _mutex.  a full magazine from the depot if there is
+        // one; otherwise up to a magazine cut off the front of the free
+        // list, which is only walked for items that came back from exited
+        // threads or release.
+        void refill_locked(magazine_t& magazine) {
+            if (_full.empty() && _free == nullptr)
+                add_arena();
+
+            if (!_full.empty()) {
+                magazine = _full.back();
+                _full.pop_back();
+                return;
+            }
+
+            auto tail = _free;
+            uint32_t count = 1;
+            for (; count < magazine_size && tail->next_item() != nullptr; count++)
+                tail = tail->next_item();
+
+            magazine.head = _free;
+            magazine.count = count;
+            _free = tail->next_item();
+            tail->next_item(nullptr);
+        }
+
+        // caller holds _mutex.  loaded and previous are both full: previous
+        // goes to the depot and loaded takes its place.
+        void unload_locked(cache_t& cache) {
+            _full.push_back(cache.previous);
+            cache.previous = cache.loaded;
+            cache.loaded = {};
+        }
+
+        // caller holds _mutex.  a full magazine goes to the depot as it is;
+        // anything else is walked to its tail and spliced onto the free
+        // list.  only exiting threads and release get here.
+        void drain_locked(cache_t& cache) {
+            for (auto magazine : {&cache.loaded, &cache.previous}) {
+                if (magazine->count == magazine_size)
+                    _full.push_back(*magazine);
+                else
+                    splice_locked(*magazine);
+                *magazine = {};
+            }
+        }
+
+        void splice_locked(magazine_t& magazine) {
+            if (magazine.count == 0)
+                return;
+            auto tail = magazine.head;
+            while (tail->next_item() != nullptr)
+                tail = tail->next_item();
+            tail->next_item(_free);
+            _free = magazine.head;
+        }
 
     private:
-        size_t _arena_size;
-        item_t* _free_list;
-        std::unique_ptr<arena_t> _arena;
+        std::size_t _arena_size;
+        mutable std::mutex _mutex{};
+        item_t* _free = nullptr;
+        std::vector<magazine_t> _full{};
+        std::vector<std::unique_ptr<arena_t>> _arenas{};
+        std::atomic<const uint32_t*> _owner{nullptr};
+        uint32_t _owner_slot = 0;
+        std::ptrdiff_t _owned_moved = 0;
+        std::ptrdiff_t _owned_floor = 0;
+        cache_t _owned{};
+        cache_t _caches[cache_slots]{};
+        cache_t _shared{};
+        std::atomic<std::size_t> _high_water{0};
     };
 
 }
-
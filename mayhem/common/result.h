@@ -62,6 +62,15 @@ namespace mayhem::common {
                 result_message::types::warning);
         }
 
+        inline void append(const result& other) {
+            _messages.insert(
+                _messages.end(),
+                other._messages.begin(),
+                other._messages.end());
+            if (other.is_failed())
+                fail();
+        }
+
         inline bool is_failed() const {
             return !_success;
         }
@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace mayhem::common {
+
+    // slot indices for one writer and one reader sharing three buffers.  the
+    // writer fills back() and publishes it; the reader acquires the most
+    // recently published slot as front().  the third slot sits between them,
+    // so neither side ever waits on the other.  slots the reader never got
+    // to are simply overwritten.
+    class triple_buffer {
+    public:
+        triple_buffer() = default;
+
+        triple_buffer(const triple_buffer&) = delete;
+
+        uint32_t back() const {
+            return _back;
+        }
+
+        uint32_t front() const {
+            return _front;
+        }
+
+        // reader: true when a slot was published since the last acquire
+        bool ready() const {
+            return (_middle.load(std::memory_order_acquire) & fresh) != 0;
+        }
+
+        // writer: the slot the reader held when last seen.  the reader only
+        // ever moves on to newer slots, so it holds nothing older.
+        uint32_t reader_hint() const {
+            return 3 - _back - (_middle.load(std::memory_order_acquire) & index_mask);
+        }
+
+        // writer
+        void publish() {
+            _back = _middle.exchange(_back | fresh, std::memory_order_acq_rel) & index_mask;
+        }
+
+        // reader: false, keeping the current front, when nothing is ready
+        bool acquire() {
+            if (!ready())
+                return false;
+            _front = _middle.exchange(_front, std::memory_order_acq_rel) & index_mask;
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t fresh = 0b100;
+        static constexpr uint32_t index_mask = 0b011;
+
+        uint32_t _back = 0;
+        uint32_t _front = 1;
+        std::atomic<uint32_t> _middle{2};
+    };
+
+}
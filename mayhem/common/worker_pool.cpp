@@ -0,0 +1,96 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include "worker_pool.h"
+
+namespace mayhem::common {
+
+    worker_pool::worker_pool(uint32_t threads) {
+        _threads.reserve(threads);
+        for (uint32_t i = 0; i < threads; i++)
+            _threads.emplace_back([this]() { worker(); });
+    }
+
+    worker_pool::~worker_pool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _quit = true;
+        }
+        _wake.notify_all();
+        for (auto& thread : _threads)
+            thread.join();
+    }
+
+    uint32_t worker_pool::size() const {
+        return static_cast<uint32_t>(_threads.size());
+    }
+
+    uint32_t worker_pool::default_size() {
+        const auto cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }
+
+    void worker_pool::worker() {
+        uint64_t seen = 0;
+        for (;;) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&]() { return _quit || _generation != seen; });
+            if (_quit)
+                return;
+
+            // a worker that wakes after the job finished sees an empty job,
+            // and must not claim indices that belong to the next one.
+            seen = _generation;
+            const auto job = _job;
+            if (job.task == nullptr)
+                continue;
+            ++_busy;
+            lock.unlock();
+
+            execute(job);
+
+            lock.lock();
+            if (--_busy == 0)
+                _done.notify_all();
+        }
+    }
+
+    void worker_pool::execute(const job_t& job) {
+        for (;;) {
+            const auto index = _next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= job.count)
+                break;
+            job.task(job.context, index);
+        }
+    }
+
+    void worker_pool::dispatch(uint32_t count, task_t task, void* context) {
+        const auto job = job_t{task, context, count};
+        if (_threads.empty() || count < 2) {
+            for (uint32_t i = 0; i < count; i++)
+                task(context, i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = job;
+            _next.store(0, std::memory_order_relaxed);
+            ++_generation;
+        }
+        _wake.notify_all();
+
+        execute(job);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [&]() { return _busy == 0; });
+        _job = job_t{};
+    }
+
+}
@@ -0,0 +1,74 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+namespace mayhem::common {
+
+    // a fixed set of threads that sleep between jobs.  run() hands out the
+    // indices [0, count) to the workers and the calling thread, and returns
+    // once every index has been processed.
+    class worker_pool {
+    public:
+        explicit worker_pool(uint32_t threads);
+
+        worker_pool(const worker_pool&) = delete;
+
+        ~worker_pool();
+
+        uint32_t size() const;
+
+        template <typename F>
+        void run(uint32_t count, F&& f) {
+            using callable_t = typename std::remove_reference<F>::type;
+            dispatch(
+                count,
+                [](void* context, uint32_t index) {
+                    (*static_cast<callable_t*>(context))(index);
+                },
+                &f);
+        }
+
+        static uint32_t default_size();
+
+    private:
+        using task_t = void (*)(void*, uint32_t);
+
+        struct job_t {
+            task_t task = nullptr;
+            void* context = nullptr;
+            uint32_t count = 0;
+        };
+
+        void worker();
+
+        void execute(const job_t& job);
+
+        void dispatch(uint32_t count, task_t task, void* context);
+
+    private:
+        job_t _job{};
+        bool _quit = false;
+        uint32_t _busy = 0;
+        std::mutex _mutex{};
+        uint64_t _generation = 0;
+        std::atomic<uint32_t> _next{};
+        std::condition_variable _done{};
+        std::condition_variable _wake{};
+        std::vector<std::thread> _threads{};
+    };
+
+}
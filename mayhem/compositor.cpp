@@ -0,0 +1,135 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "log.h"
+#include "raster.h"
+#include "compositor.h"
+
+namespace mayhem {
+
+    void compositor_init(
+            compositor_t& compositor,
+            uint32_t height,
+            uint32_t band_height,
+            uint32_t workers) {
+        band_height = std::max<uint32_t>(band_height, 1);
+
+        compositor.band_height = (int32_t) band_height;
+        compositor.bands.clear();
+        for (uint32_t top = 0; top < height; top += band_height) {
+            compositor_band_t band{};
+            band.top = top;
+            band.bottom = std::min(top + band_height, height);
+            compositor.bands.push_back(std::move(band));
+        }
+
+        compositor.pool.reset();
+        if (workers > 0)
+            compositor.pool = std::make_unique<common::worker_pool>(workers);
+
+        log_message(
+            log_category_t::video,
+            "compositor: {} bands of {} rows, {} workers",
+            compositor.bands.size(),
+            band_height,
+            workers);
+    }
+
+    void compositor_reset(compositor_t& compositor) {
+        compositor.fills.clear();
+        compositor.blits.clear();
+        for (auto& band : compositor.bands)
+            band.items.clear();
+    }
+
+    void compositor_shutdown(compositor_t& compositor) {
+        compositor.pool.reset();
+        compositor.bands.clear();
+        compositor.fills.clear();
+        compositor.blits.clear();
+    }
+
+    // bands are band_height rows apart, so the ones a row range touches are
+    // found by division rather than by testing every band.
+    static void compositor_bin(
+            compositor_t& compositor,
+            int32_t top,
+            int32_t bottom,
+            compositor_item_t item) {
+        if (compositor.bands.empty())
+            return;
+
+        const auto last_band = (int32_t) compositor.bands.size() - 1;
+        const auto first = std::max(top / compositor.band_height, 0);
+        const auto last = std::min((bottom - 1) / compositor.band_height, last_band);
+        for (auto index = first; index <= last; index++)
+            compositor.bands[index].items.push_back(item);
+    }
+
+    void compositor_fill(compositor_t& compositor, const compositor_fill_t& fill) {
+        if (fill.left >= fill.right || fill.top >= fill.bottom || fill.bottom <= 0)
+            return;
+
+        const auto index = static_cast<uint32_t>(compositor.fills.size());
+        compositor.fills.push_back(fill);
+        compositor_bin(
+            compositor,
+            fill.top,
+            fill.bottom,
+            compositor_item_t{compositor_item_type_t::fill, index});
+    }
+
+    void compositor_blit(compositor_t& compositor, const blit_span_t& span) {
+        if (span.top >= span.bottom || span.bottom <= 0)
+            return;
+
+        const auto index = static_cast<uint32_t>(compositor.blits.size());
+        compositor.blits.push_back(span);
+        compositor_bin(
+            compositor,
+            span.top,
+            span.bottom,
+            compositor_item_t{compositor_item_type_t::blit, index});
+    }
+
+    void compositor_draw(
+            const compositor_t& compositor,
+            const compositor_band_t& band,
+            const blit_target_t& target) {
+        auto band_target = target;
+        band_target.clip_top = std::max(band.top, target.clip_top);
+        band_target.clip_bottom = std::min(band.bottom, target.clip_bottom);
+
+        for (const auto& item : band.items) {
+            if (item.type == compositor_item_type_t::fill) {
+                const auto& fill = compositor.fills[item.index];
+                raster_fill_rect(
+                    band_target,
+                    fill.left,
+                    fill.top,
+                    fill.right,
+                    fill.bottom,
+                    fill.color,
+                    fill.blend);
+                continue;
+            }
+
+            const auto& span = compositor.blits[item.index];
+            const auto top = std::max(span.top, band_target.clip_top);
+            const auto bottom = std::min(span.bottom, band_target.clip_bottom);
+            auto row = target.pixels + top * target.pitch;
+            for (auto y = top; y < bottom; y++) {
+                blit_draw_row(span, row, y);
+                row += target.pitch;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <common/worker_pool.h>
+#include "blit.h"
+
+namespace mayhem {
+
+    // a solid rectangle in target coordinates; right and bottom are exclusive.
+    // blend draws color over the target using its alpha byte.
+    struct compositor_fill_t {
+        int32_t left = 0;
+        int32_t top = 0;
+        int32_t right = 0;
+        int32_t bottom = 0;
+        uint32_t color = 0;
+        bool blend = false;
+    };
+
+    enum class compositor_item_type_t : uint8_t {
+        fill,
+        blit,
+    };
+
+    struct compositor_item_t {
+        compositor_item_type_t type = compositor_item_type_t::fill;
+        uint32_t index = 0;
+    };
+
+    // a horizontal strip of the target.  items index compositor_t::fills and
+    // compositor_t::blits in submission order and are clipped to the band
+    // when they are drawn.
+    struct compositor_band_t {
+        int32_t top = 0;
+        int32_t bottom = 0;
+        std::vector<compositor_item_t> items{};
+    };
+
+    struct compositor_t {
+        int32_t band_height = 1;
+        std::vector<compositor_band_t> bands{};
+        std::vector<compositor_fill_t> fills{};
+        std::vector<blit_span_t> blits{};
+        std::unique_ptr<common::worker_pool> pool{};
+    };
+
+    void compositor_init(
+        compositor_t& compositor,
+        uint32_t height,
+        uint32_t band_height,
+        uint32_t workers);
+
+    void compositor_reset(compositor_t& compositor);
+
+    void compositor_shutdown(compositor_t& compositor);
+
+    void compositor_fill(compositor_t& compositor, const compositor_fill_t& fill);
+
+    // span must already be prepared against the target it will be drawn to
+    void compositor_blit(compositor_t& compositor, const blit_span_t& span);
+
+    // draws every item binned to the band, clipped to the band and target
+    void compositor_draw(
+        const compositor_t& compositor,
+        const compositor_band_t& band,
+        const blit_target_t& target);
+
+    // calls f(band) for every band, spread across the worker pool.  bands
+    // never share rows, so the result does not depend on scheduling.
+    template <typename F>
+    void compositor_run(compositor_t& compositor, F&& f) {
+        auto& bands = compositor.bands;
+        if (compositor.pool == nullptr) {
+            for (auto& band : bands)
+                f(band);
+            return;
+        }
+        compositor.pool->run(
+            static_cast<uint32_t>(bands.size()),
+            [&](uint32_t index) { f(bands[index]); });
+    }
+
+}
@@ -0,0 +1,87 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <algorithm>
+#include "draw_list.h"
+
+namespace mayhem {
+
+    // the sequence number lives in the low 24 bits of the sort key
+    static constexpr uint32_t max_sort_sequence = 1u << 24;
+
+    void draw_list_init(draw_list_t& list, uint32_t capacity, uint32_t text_capacity) {
+        capacity = std::min(capacity, max_sort_sequence);
+        list.count = 0;
+        list.text_used = 0;
+        list.capacity = capacity;
+        list.text_capacity = text_capacity;
+        list.text = std::make_unique<char[]>(text_capacity);
+        list.order = std::make_unique<uint64_t[]>(capacity);
+        list.commands = std::make_unique<draw_command_t[]>(capacity);
+    }
+
+    void draw_list_reset(draw_list_t& list) {
+        list.count = 0;
+        list.text_used = 0;
+    }
+
+    draw_command_t* draw_list_push(
+            draw_list_t& list,
+            draw_command_type_t type,
+            uint8_t layer) {
+        if (list.count == list.capacity)
+            return nullptr;
+
+        const auto index = list.count++;
+        auto command = &list.commands[index];
+        *command = draw_command_t{};
+        command->type = type;
+        command->layer = layer;
+        list.order[index] = index;
+        return command;
+    }
+
+    bool draw_list_push_text(
+            draw_list_t& list,
+            draw_command_t* command,
+            std::string_view value) {
+        if (value.size() + 1 > list.text_capacity - list.text_used)
+            return false;
+
+        auto data = list.text.get() + list.text_used;
+        memcpy(data, value.data(), value.size());
+        data[value.size()] = '\0';
+        command->text_offset = list.text_used;
+        command->text_length = static_cast<uint32_t>(value.size());
+        list.text_used += command->text_length + 1;
+
+        return true;
+    }
+
+    std::string_view draw_list_text(const draw_list_t& list, const draw_command_t& command) {
+        return std::string_view(list.text.get() + command.text_offset, command.text_length);
+    }
+
+    void draw_list_sort(draw_list_t& list) {
+        // layer:8 | type:8 | bank:8 | index:16 | sequence:24.  the sequence
+        // makes every key unique, so an unstable sort gives a stable order
+        // without std::stable_sort's temporary buffer.
+        for (uint32_t i = 0; i < list.count; i++) {
+            const auto& command = list.commands[i];
+            list.order[i] = ((uint64_t) command.layer << 56)
+                | ((uint64_t) command.type << 48)
+                | ((uint64_t) command.id.bank << 40)
+                | ((uint64_t) command.id.index << 24)
+                | i;
+        }
+        std::sort(list.order.get(), list.order.get() + list.count);
+    }
+
+}
@@ -0,0 +1,89 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <string_view>
+#include "types.h"
+
+namespace mayhem {
+
+    // within a layer, commands draw in this order, which is the order the
+    // per-type entity views were walked in before the draw list existed.
+    enum class draw_command_type_t : uint8_t {
+        image,
+        hline,
+        vline,
+        box,
+        text,
+    };
+
+    // id is the image or font; lines keep their length in dest.size and
+    // text keeps its bytes in the list's text arena.  blend draws fills over
+    // the frame using the color's alpha.
+    struct draw_command_t {
+        draw_command_type_t type = draw_command_type_t::box;
+        uint8_t layer = 0;
+        bool fill = false;
+        bool blend = false;
+        color_t color{};
+        bank_id_t id{};
+        rect_t src{};
+        rect_t dest{};
+        uint32_t text_offset = 0;
+        uint32_t text_length = 0;
+    };
+
+    // fixed-capacity storage reset once per frame; nothing is allocated
+    // after draw_list_init.
+    struct draw_list_t {
+        uint32_t count = 0;
+        uint32_t capacity = 0;
+        uint32_t text_used = 0;
+        uint32_t text_capacity = 0;
+        std::unique_ptr<char[]> text{};
+        std::unique_ptr<uint64_t[]> order{};
+        std::unique_ptr<draw_command_t[]> commands{};
+    };
+
+    void draw_list_init(draw_list_t& list, uint32_t capacity, uint32_t text_capacity);
+
+    void draw_list_reset(draw_list_t& list);
+
+    // returns nullptr when the list is full
+    draw_command_t* draw_list_push(
+        draw_list_t& list,
+        draw_command_type_t type,
+        uint8_t layer);
+
+    // copies value into the text arena followed by a nul, so the result of
+    // draw_list_text can be handed to c apis; false when the arena is full
+    bool draw_list_push_text(
+        draw_list_t& list,
+        draw_command_t* command,
+        std::string_view value);
+
+    std::string_view draw_list_text(const draw_list_t& list, const draw_command_t& command);
+
+    // orders commands by layer, type and image or font, keeping submission
+    // order among equal keys so batches of the same texture are adjacent.
+    void draw_list_sort(draw_list_t& list);
+
+    // visits commands in the order established by the last draw_list_sort
+    template <typename F>
+    void draw_list_for_each(const draw_list_t& list, F&& f) {
+        for (uint32_t i = 0; i < list.count; i++) {
+            const auto index = static_cast<uint32_t>(list.order[i] & 0xffffff);
+            f(list.commands[index]);
+        }
+    }
+
+}
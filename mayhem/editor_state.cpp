@@ -25,6 +25,10 @@ namespace mayhem {
     }
 
     bool editor_state::update(common::result& r, game_t& game) {
+        return true;
+    }
+
+    bool editor_state::draw(common::result& r, game_t& game, float alpha) {
         video_queue_box(r, game, color_t{0x20, 0xd6, 0xc7}, 100, 100, 256, 64, true);
         video_queue_box(r, game, color_t{0x8b, 0x93, 0xaf}, 0, 0, 512, 480, true);
         return true;
@@ -25,6 +25,8 @@ namespace mayhem {
 
         bool update(common::result& r, game_t& game) override;
 
+        bool draw(common::result& r, game_t& game, float alpha) override;
+
     private:
     };
 
@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include "file_watch.h"
+
+namespace mayhem {
+
+    static constexpr uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+    static std::string path_directory(const std::string& path) {
+        const auto slash = path.find_last_of('/');
+        if (slash == std::string::npos)
+            return ".";
+        if (slash == 0)
+            return "/";
+        return path.substr(0, slash);
+    }
+
+    static std::string path_join(const std::string& directory, const char* name) {
+        if (directory == ".")
+            return name;
+        if (directory == "/")
+            return fmt::format("/{}", name);
+        return fmt::format("{}/{}", directory, name);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    bool file_watch_init(common::result& r, file_watch_t& watch, uint64_t debounce) {
+        watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch.fd == -1) {
+            r.error("G500", fmt::format("unable to initialize inotify: {}", strerror(errno)));
+            return false;
+        }
+        watch.debounce = debounce;
+        return true;
+    }
+
+    bool file_watch_add(common::result& r, file_watch_t& watch, const std::string& path) {
+        if (watch.fd == -1 || watch.files.count(path) != 0)
+            return true;
+
+        const auto directory = path_directory(path);
+        const auto wd = inotify_add_watch(watch.fd, directory.c_str(), watch_mask);
+        if (wd == -1) {
+            r.error("G501", fmt::format("unable to watch {}: {}", directory, strerror(errno)));
+            return false;
+        }
+
+        watch.directories[wd] = directory;
+        watch.files.insert(path);
+        return true;
+    }
+
+    void file_watch_poll(file_watch_t& watch, uint64_t now, std::vector<std::string>& changed) {
+        if (watch.fd == -1)
+            return;
+
+        alignas(inotify_event) char buffer[4096];
+        for (;;) {
+            const auto length = read(watch.fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+
+            for (ssize_t offset = 0; offset < length;) {
+                const auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                auto it = watch.directories.find(event->wd);
+                if (it == std::end(watch.directories) || event->len == 0)
+                    continue;
+
+                auto path = path_join(it->second, event->name);
+                if (watch.files.count(path) != 0)
+                    watch.pending[path] = now;
+            }
+        }
+
+        for (auto it = watch.pending.begin(); it != watch.pending.end();) {
+            if (now - it->second < watch.debounce) {
+                ++it;
+                continue;
+            }
+            changed.push_back(it->first);
+            it = watch.pending.erase(it);
+        }
+    }
+
+    void file_watch_shutdown(file_watch_t& watch) {
+        if (watch.fd != -1)
+            close(watch.fd);
+        watch.fd = -1;
+        watch.files.clear();
+        watch.directories.clear();
+        watch.pending.clear();
+    }
+
+}
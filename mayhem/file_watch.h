@@ -0,0 +1,46 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <common/result.h>
+
+namespace mayhem {
+
+    // inotify watches the directories that hold the files, not the files
+    // themselves: editors usually save by writing a new file and renaming
+    // it over the old one, which would silently end a watch on the file.
+    //
+    // an editor's save can raise several events over a few milliseconds, so
+    // a path is only reported once debounce nanoseconds have passed since
+    // its last event.
+    struct file_watch_t {
+        int fd = -1;
+        uint64_t debounce = 0;
+        std::unordered_set<std::string> files{};
+        std::unordered_map<int, std::string> directories{};
+        std::unordered_map<std::string, uint64_t> pending{};
+    };
+
+    bool file_watch_init(common::result& r, file_watch_t& watch, uint64_t debounce);
+
+    // paths are reported exactly as they were added
+    bool file_watch_add(common::result& r, file_watch_t& watch, const std::string& path);
+
+    // never blocks; appends the paths that have settled to changed
+    void file_watch_poll(file_watch_t& watch, uint64_t now, std::vector<std::string>& changed);
+
+    void file_watch_shutdown(file_watch_t& watch);
+
+}
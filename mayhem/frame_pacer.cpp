@@ -0,0 +1,101 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include "frame_pacer.h"
+
+namespace mayhem {
+
+    static uint64_t frame_deadline(const frame_pacer_t& pacer, uint64_t frame) {
+        return pacer.origin + frame * nanoseconds_per_second / pacer.rate;
+    }
+
+    static void frame_pacer_record(frame_pacer_t& pacer, uint64_t now) {
+        if (pacer.last != 0) {
+            pacer.intervals[pacer.next] = now - pacer.last;
+            pacer.next = (pacer.next + 1) % frame_pacer_history;
+            pacer.count = std::min(pacer.count + 1, frame_pacer_history);
+        }
+        pacer.last = now;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    uint64_t frame_pacer_now() {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+    }
+
+    void frame_pacer_init(frame_pacer_t& pacer, uint32_t rate) {
+        pacer.rate = std::max<uint32_t>(rate, 1);
+        pacer.origin = frame_pacer_now();
+        pacer.frame = 0;
+        pacer.last = 0;
+        pacer.count = 0;
+        pacer.next = 0;
+    }
+
+    void frame_pacer_mark(frame_pacer_t& pacer) {
+        frame_pacer_record(pacer, frame_pacer_now());
+    }
+
+    void frame_pacer_wait(frame_pacer_t& pacer) {
+        auto now = frame_pacer_now();
+        auto deadline = frame_deadline(pacer, pacer.frame + 1);
+
+        // a frame that overran by more than a whole period starts a new
+        // schedule instead of rushing to catch up
+        if (now > deadline + nanoseconds_per_second / pacer.rate) {
+            pacer.origin = now;
+            pacer.frame = 0;
+            frame_pacer_record(pacer, now);
+            return;
+        }
+
+        if (now + pacer.spin < deadline)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - pacer.spin - now));
+
+        while ((now = frame_pacer_now()) < deadline)
+            std::this_thread::yield();
+
+        ++pacer.frame;
+        frame_pacer_record(pacer, now);
+    }
+
+    bool frame_pacer_stats(const frame_pacer_t& pacer, frame_pacer_stats_t& stats) {
+        stats = {};
+        if (pacer.count == 0)
+            return false;
+
+        // a copy on the stack, so the profiler overlay can call this every
+        // frame without allocating
+        uint64_t intervals[frame_pacer_history];
+        const auto count = static_cast<std::size_t>(pacer.count);
+        std::copy(pacer.intervals, pacer.intervals + count, intervals);
+        uint64_t total = 0;
+        for (std::size_t i = 0; i < count; i++)
+            total += intervals[i];
+
+        const auto end = intervals + count;
+        const auto p50 = count / 2;
+        const auto p99 = std::min<std::size_t>(count * 99 / 100, count - 1);
+        std::nth_element(intervals, intervals + p50, end);
+        stats.p50 = intervals[p50];
+        std::nth_element(intervals, intervals + p99, end);
+        stats.p99 = intervals[p99];
+        stats.max = *std::max_element(intervals, end);
+        stats.count = pacer.count;
+        stats.hz = static_cast<double>(nanoseconds_per_second) * pacer.count / static_cast<double>(total);
+
+        return true;
+    }
+
+}
@@ -0,0 +1,57 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace mayhem {
+
+    static constexpr uint64_t nanoseconds_per_second = 1'000'000'000;
+
+    static constexpr uint32_t frame_pacer_history = 600;
+
+    struct frame_pacer_stats_t {
+        uint32_t count = 0;
+        double hz = 0;
+        uint64_t p50 = 0;
+        uint64_t p99 = 0;
+        uint64_t max = 0;
+    };
+
+    // deadlines are origin + n * period, computed exactly rather than
+    // accumulated, so a 60 Hz pacer does not drift by the 2/3 ns that
+    // 1e9 / 60 loses to rounding each frame.  waits sleep until spin
+    // nanoseconds before the deadline, then spin the rest of the way.
+    // intervals holds the last frame_pacer_history frame-to-frame times.
+    struct frame_pacer_t {
+        uint32_t rate = 0;
+        uint64_t spin = 2'000'000;
+        uint64_t origin = 0;
+        uint64_t frame = 0;
+        uint64_t last = 0;
+        uint32_t count = 0;
+        uint32_t next = 0;
+        uint64_t intervals[frame_pacer_history]{};
+    };
+
+    // monotonic, in nanoseconds
+    uint64_t frame_pacer_now();
+
+    void frame_pacer_init(frame_pacer_t& pacer, uint32_t rate);
+
+    // records the interval since the previous frame without waiting
+    void frame_pacer_mark(frame_pacer_t& pacer);
+
+    // waits for the next deadline, then records the interval
+    void frame_pacer_wait(frame_pacer_t& pacer);
+
+    bool frame_pacer_stats(const frame_pacer_t& pacer, frame_pacer_stats_t& stats);
+
+}
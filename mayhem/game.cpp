@@ -8,6 +8,10 @@
 // ----------------------------------------------------------------------------
 
 #include <SDL.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <common/defer.h>
 #include "game.h"
 #include "timer.h"
 #include "boot_state.h"
@@ -17,6 +21,8 @@ namespace mayhem {
 
     static state_machine s_machine{};
 
+    static constexpr uint64_t hot_reload_debounce = nanoseconds_per_second / 10;
+
     bool game_config_load(common::result& r, game_config_t& config) {
         return true;
     }
@@ -27,17 +33,131 @@ namespace mayhem {
 
     ///////////////////////////////////////////////////////////////////////////
 
-    bool game_run(common::result& r, game_t& game) {
-        const color_t white = {.r = 0xff, .g = 0xff, .b = 0xff, .a = 0xff};
+    // simulation steps are a fixed 1/target_frame_rate; each simulated frame
+    // feeds real elapsed time into the accumulator and draws with the
+    // leftover fraction of a step.  headless runs feed exactly one step per
+    // frame so that timers, and every frame hash, repeat.
+    struct game_clock_t {
+        uint64_t steps = 0;
+        uint64_t accumulator = 0;
+        uint64_t last_time = 0;
+    };
+
+    // headless runs count frames against simulated time, one step per
+    // frame, so the fps text they draw into every hashed frame repeats.
+    struct game_fps_counter_t {
+        uint16_t frames = 0;
+        uint64_t last_time = 0;
+        uint64_t simulated_time = 0;
+    };
+
+    static void game_fps_counter_init(const game_t& game, game_fps_counter_t& counter) {
+        counter = {};
+        if (!game.config.headless)
+            counter.last_time = frame_pacer_now();
+    }
 
-        uint16_t fps = 0;
-        uint16_t frame_count = 0;
-        uint32_t last_time = SDL_GetTicks();
-        uint32_t last_fps_time = last_time;
+    static void game_count_frame(game_t& game, game_fps_counter_t& counter) {
+        uint64_t now;
+        if (game.config.headless) {
+            counter.simulated_time += nanoseconds_per_second / target_frame_rate;
+            now = counter.simulated_time;
+        } else {
+            now = frame_pacer_now();
+        }
 
-        while (!SDL_QuitRequested()) {
-            game.ticks = SDL_GetTicks();
+        if (now - counter.last_time >= nanoseconds_per_second) {
+            game.fps.store(counter.frames, std::memory_order_relaxed);
+            counter.frames = 0;
+            counter.last_time = now;
+        }
+        ++counter.frames;
+    }
+
+    static void game_log_pacing(const frame_pacer_t& pacer, std::string_view name) {
+        frame_pacer_stats_t stats{};
+        if (!frame_pacer_stats(pacer, stats))
+            return;
+        log_message(
+            log_category_t::app,
+            "{} pacing: {:.3f} Hz, p50 {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms over {} frames",
+            name,
+            stats.hz,
+            stats.p50 / 1e6,
+            stats.p99 / 1e6,
+            stats.max / 1e6,
+            stats.count);
+    }
+
+    // main thread: watches whatever has been loaded and queues reloads of
+    // what changed.  images and fonts are decoded again on the loader and
+    // swapped in by asset_loader_update; bank files are remapped here, and
+    // the sheets and images taken from their changed entries rebuilt.
+    static bool game_hot_reload(common::result& r, game_t& game) {
+        if (!game.config.hot_reload)
+            return true;
+
+        if (!asset_loader_watch(r, game.assets, game.watch))
+            return false;
+
+        auto watched = true;
+        game.banks.for_each([&](const bank_file& file) {
+            watched = watched && file_watch_add(r, game.watch, std::string(file.path()));
+        });
+        if (!watched)
+            return false;
+
+        std::vector<std::string> changed{};
+        file_watch_poll(game.watch, frame_pacer_now(), changed);
+        for (const auto& path : changed) {
+            const auto count = asset_loader_reload(game.assets, path);
+            if (count > 0) {
+                log_message(log_category_t::app, "reload {}: {} assets queued", path, count);
+                continue;
+            }
+
+            if (!game.banks.exists(path))
+                continue;
+
+            std::lock_guard<std::mutex> lock(game.simulation_mutex);
+            common::result reload_result{};
+            if (!game.banks.reload(reload_result, path)
+            ||  !video_reload_bank(reload_result, game, path)) {
+                for (const auto& message : reload_result.messages())
+                    log_warn(log_category_t::app, "reload {}: {}", path, message.message());
+            }
+        }
+
+        return true;
+    }
 
+    static bool game_update_assets(common::result& r, game_t& game) {
+        alloc_scope_t alloc_scope(alloc_tag_t::assets);
+        return game_hot_reload(r, game) && asset_loader_update(r, game.assets);
+    }
+
+    // sound, state updates and draw are hot: with --assert-no-allocs a frame
+    // that allocates in any of them fails the run.  input may push and pop
+    // states, timer callbacks may create entities and video fills its text
+    // and image caches, so those are only counted.
+    //
+    // input, the fixed simulation steps and this frame's draw calls, ending
+    // with video_publish.  in threaded mode this runs on the simulation
+    // thread and is the only code that touches the registry and states.
+    static bool game_simulate(common::result& r, game_t& game, game_clock_t& clock) {
+        const color_t white = {.r = 0xff, .g = 0xff, .b = 0xff, .a = 0xff};
+        const auto step = nanoseconds_per_second / target_frame_rate;
+        const auto max_elapsed = nanoseconds_per_second / 4;
+
+        const auto now = frame_pacer_now();
+        if (game.config.headless)
+            clock.accumulator += step;
+        else
+            clock.accumulator += std::min(now - clock.last_time, max_elapsed);
+        clock.last_time = now;
+
+        {
+            alloc_scope_t alloc_scope(alloc_tag_t::input);
             if (key_pressed(SDL_SCANCODE_ESCAPE)) {
                 if (s_machine.depth() == 1) {
                     SDL_Event evt{};
@@ -54,53 +174,249 @@ namespace mayhem {
                     return false;
             }
 
+            if (key_pressed(SDL_SCANCODE_F2))
+                game.config.show_profiler = !game.config.show_profiler;
+        }
+
+        {
+            profiler_scope_t scope(game.profiler, profile_phase_t::sound);
+            alloc_scope_t alloc_scope(alloc_tag_t::sound, true);
             if (!sound_update(r, game.sound))
                 return false;
+        }
 
-            if (!timer_update(r, game))
-                return false;
+        while (clock.accumulator >= step) {
+            game.ticks = static_cast<uint32_t>(clock.steps * 1000 / target_frame_rate);
 
-            if (!s_machine.update(r, game))
-                return false;
+            {
+                profiler_scope_t scope(game.profiler, profile_phase_t::timers);
+                alloc_scope_t alloc_scope(alloc_tag_t::timers);
+                if (!timer_update(r, game))
+                    return false;
+            }
 
-            if (game.config.show_fps) {
-                if (!video_queue_text(
-                        r,
-                        game,
-                        bank_id_t{0xff, 0},
-                        white,
-                        2,
-                        2,
-                        fmt::format("FPS:{:03}", fps))) {
+            {
+                profiler_scope_t scope(game.profiler, profile_phase_t::state);
+                alloc_scope_t alloc_scope(alloc_tag_t::state, true);
+                if (!s_machine.update(r, game))
                     return false;
-                }
             }
 
+            clock.accumulator -= step;
+            ++clock.steps;
+        }
+
+        profiler_scope_t scope(game.profiler, profile_phase_t::draw);
+        alloc_scope_t alloc_scope(alloc_tag_t::draw, true);
+        const auto alpha = static_cast<float>(clock.accumulator) / static_cast<float>(step);
+        if (!s_machine.draw(r, game, alpha))
+            return false;
+
+        if (game.config.show_profiler) {
+            if (!profiler_draw_overlay(r, game))
+                return false;
+        } else if (game.config.show_fps) {
+            if (!video_queue_text(
+                    r,
+                    game,
+                    bank_id_t{0xff, 0},
+                    white,
+                    2,
+                    2,
+                    game.frame_arena.format("FPS:{:03}", game.fps.load(std::memory_order_relaxed)))) {
+                return false;
+            }
+        }
+
+        video_publish(game);
+
+        return true;
+    }
+
+    // composes and presents the newest published frame; always on the main
+    // thread, which owns the SDL renderer.  the frame phase runs from
+    // frame_start to here.
+    static bool game_render(
+            common::result& r,
+            game_t& game,
+            uint32_t frame,
+            uint64_t frame_start) {
+        {
+            profiler_scope_t scope(game.profiler, profile_phase_t::video);
+            alloc_scope_t alloc_scope(alloc_tag_t::video);
             if (!video_update(r, game))
                 return false;
+        }
+
+        profiler_add(game.profiler, profile_phase_t::frame, profiler_now() - frame_start);
+        profiler_end_frame(game.profiler);
+
+        if (game.config.headless)
+            fmt::print("frame {} {:016x}\n", frame, game.video.frame_hash);
+
+        return true;
+    }
+
+    // the simulation thread runs game_simulate at render_rate and publishes
+    // snapshots; this thread renders each new one as it arrives, so a vsync
+    // stall in present holds up only rendering.  game.pacer belongs to the
+    // simulation thread here, which is also where the overlay reads it.
+    // each simulated frame runs under game.simulation_mutex, which this
+    // thread only takes to store loaded assets or swap a reloaded bank.
+    // the simulation overlaps rendering, so here the frame phase covers
+    // rendering only.  sound, timers, state and draw still land under it,
+    // summed over whatever the simulation thread ran since the last
+    // rendered frame.
+    static bool game_run_threaded(common::result& r, game_t& game) {
+        std::atomic<bool> running{true};
+        common::result simulation_result{};
+
+        frame_pacer_init(game.pacer, game.config.render_rate);
+
+        std::thread simulation([&]() {
+            game_clock_t clock{};
+            clock.last_time = frame_pacer_now();
+
+            while (running.load(std::memory_order_acquire)) {
+                std::unique_lock<std::mutex> lock(game.simulation_mutex);
+                const auto simulated = game_simulate(simulation_result, game, clock);
+                lock.unlock();
+                if (!simulated) {
+                    SDL_Event evt{};
+                    evt.type = SDL_EventType::SDL_QUIT;
+                    SDL_PushEvent(&evt);
+                    break;
+                }
+                game.frame_arena.reset();
+
+                if (game.config.unthrottled)
+                    frame_pacer_mark(game.pacer);
+                else
+                    frame_pacer_wait(game.pacer);
+            }
+        });
+
+        auto success = true;
+        uint32_t frame = 0;
+        game_fps_counter_t counter{};
+        game_fps_counter_init(game, counter);
+
+        frame_pacer_t render_pacer{};
+        frame_pacer_init(render_pacer, game.config.render_rate);
 
-            uint32_t frame_duration = SDL_GetTicks() - game.ticks;
+        while (!SDL_QuitRequested()) {
+            if (game.config.frame_limit != 0 && frame == game.config.frame_limit)
+                break;
 
-            uint32_t fps_dt = last_time - last_fps_time;
-            if (fps_dt >= 1000) {
-                fps = frame_count;
-                frame_count = 0;
-                last_fps_time = last_time;
+            if (!game_update_assets(r, game)) {
+                success = false;
+                break;
             }
 
-            ++frame_count;
+            if (!video_frame_ready(game)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
 
-            if (frame_duration < milliseconds_per_frame) {
-                SDL_Delay(milliseconds_per_frame - frame_duration);
+            if (!game_render(r, game, frame, profiler_now()) || !alloc_tracker_end_frame(r)) {
+                success = false;
+                break;
             }
 
-            last_time = SDL_GetTicks();
+            ++frame;
+            game_count_frame(game, counter);
+            frame_pacer_mark(render_pacer);
+        }
+
+        running.store(false, std::memory_order_release);
+        simulation.join();
+        r.append(simulation_result);
+
+        game_log_pacing(game.pacer, "simulation");
+        game_log_pacing(render_pacer, "render");
+
+        return success && !simulation_result.is_failed();
+    }
+
+    bool game_run(common::result& r, game_t& game) {
+        alloc_tracker_start(game.config.alloc_mode);
+        defer(alloc_tracker_log_report());
+
+        if (game.config.threaded)
+            return game_run_threaded(r, game);
+
+        uint32_t frame = 0;
+        game_clock_t clock{};
+        clock.last_time = frame_pacer_now();
+        game_fps_counter_t counter{};
+        game_fps_counter_init(game, counter);
+        frame_pacer_init(game.pacer, game.config.render_rate);
+
+        while (!SDL_QuitRequested()) {
+            if (game.config.frame_limit != 0 && frame == game.config.frame_limit)
+                break;
+
+            const auto frame_start = profiler_now();
+
+            if (!game_update_assets(r, game))
+                return false;
+
+            if (!game_simulate(r, game, clock))
+                return false;
+
+            if (!game_render(r, game, frame, frame_start))
+                return false;
+            game.frame_arena.reset();
+
+            if (!alloc_tracker_end_frame(r))
+                return false;
+
+            ++frame;
+            game_count_frame(game, counter);
+
+            if (game.config.unthrottled)
+                frame_pacer_mark(game.pacer);
+            else
+                frame_pacer_wait(game.pacer);
         }
 
+        game_log_pacing(game.pacer, "frame");
+
+        return true;
+    }
+
+    // everything from the file watch to the first state; runs with the
+    // loader threads already started
+    static bool game_init_content(common::result& r, game_t& game) {
+        if (game.config.headless)
+            game.config.hot_reload = false;
+        if (game.config.hot_reload && !file_watch_init(r, game.watch, hot_reload_debounce))
+            return false;
+
+        if (!video_init(r, game))
+            return false;
+
+        // headless frames are hashed, so they must not depend on how fast
+        // the loader threads happen to run
+        if (game.config.headless && !asset_loader_wait(r, game.assets))
+            return false;
+
+        if (!s_machine.register_state<boot_state>(boot_state::type))
+            return false;
+
+        if (!s_machine.register_state<editor_state>(editor_state::type))
+            return false;
+
+        if (!s_machine.push(r, game, boot_state::type))
+            return false;
+
         return true;
     }
 
     bool game_init(common::result& r, game_t& game) {
+        if (game.config.headless)
+            SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+
         auto result = SDL_Init(SDL_INIT_EVENTS|
                                SDL_INIT_GAMECONTROLLER|
                                SDL_INIT_JOYSTICK|
@@ -114,7 +430,9 @@ namespace mayhem {
 
         log_init();
 
-        if (!sound_init(r, game.sound))
+        profiler_init(game.profiler);
+
+        if (!sound_init(r, game.sound, game.config.headless))
             return false;
 
         if (!key_init(r))
@@ -124,10 +442,17 @@ namespace mayhem {
             return false;
 
         if (!joystick_open(r, game.joystick))
-            return false;
+            log_message(log_category_t::input, "no game controller found.");
 
-        if (!window_create(r, game.window, game.config.window_x, game.config.window_y))
-            return false;
+        if (game.config.headless) {
+            if (!window_create_headless(r, game.window))
+                return false;
+        } else {
+            if (!window_create(r, game.window, game.config.window_x, game.config.window_y))
+                return false;
+        }
+
+        game.video.headless = game.config.headless;
 
         game.video.bg_size.w = 32;
         game.video.bg_size.h = 32;
@@ -136,28 +461,35 @@ namespace mayhem {
         game.video.tile_size.h = 32;
 
         game.video.max_sprites = 256;
+        game.video.max_sprites_per_line = 64;
         game.video.sprite_size.w = 16;
         game.video.sprite_size.h = 16;
 
         game.video.max_bg_size.w = 64;
         game.video.max_bg_size.h = 64;
 
-        if (!video_init(r, game))
-            return false;
+        game.video.image_cache_bytes = 4 * 1024 * 1024;
+        game.video.text_cache_bytes = 1024 * 1024;
 
-        if (!s_machine.register_state<boot_state>(boot_state::type))
-            return false;
+        asset_loader_init(game.assets, common::worker_pool::default_size());
+        game.assets.store_mutex = &game.simulation_mutex;
 
-        if (!s_machine.register_state<editor_state>(editor_state::type))
-            return false;
-
-        if (!s_machine.push(r, game, boot_state::type))
+        if (!game_init_content(r, game)) {
+            // main never calls game_shutdown after a failed init, and the
+            // loader threads must be joined before game goes away
+            asset_loader_shutdown(game.assets);
+            file_watch_shutdown(game.watch);
             return false;
+        }
 
         return true;
     }
 
+
     bool game_shutdown(common::result& r, game_t& game) {
+        asset_loader_shutdown(game.assets);
+        file_watch_shutdown(game.watch);
+
         if (!sound_shutdown(r, game.sound)) {
 
         }
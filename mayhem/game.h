@@ -9,14 +9,21 @@
 
 #pragma once
 
+#include <mutex>
+#include <atomic>
 #include <cstdint>
 #include <common/result.h>
+#include <common/frame_arena.h>
 #include <entt/entity/registry.hpp>
 #include "log.h"
 #include "video.h"
 #include "input.h"
 #include "sound.h"
 #include "window.h"
+#include "frame_pacer.h"
+#include "profiler.h"
+#include "alloc_tracker.h"
+#include "asset_loader.h"
 #include "bank_manager.h"
 #include "state_machine.h"
 
@@ -26,8 +33,39 @@ namespace mayhem {
 
     struct game_config_t {
         bool show_fps = true;
+        bool show_profiler = false;
+        int32_t render_threads = -1;
         int32_t window_x = -1;
         int32_t window_y = -1;
+
+        // headless runs use the dummy video driver and print a hash of each
+        // composed frame.  frame_limit stops game_run after that many frames
+        // (0 runs until quit); unthrottled skips frame pacing.
+        bool headless = false;
+        uint32_t frame_limit = 0;
+        bool unthrottled = false;
+
+        // frames are rendered and paced at render_rate, while the simulation
+        // always steps at target_frame_rate.
+        uint32_t render_rate = target_frame_rate;
+
+        // runs the simulation on its own thread, handing frames to the
+        // renderer on the main thread through video_publish.
+        bool threaded = false;
+
+        // watches loaded images, fonts and bank files and reloads them when
+        // they change on disk; never on in headless runs.
+        bool hot_reload = true;
+
+        // counts heap allocations per subsystem from the first frame on and
+        // logs them when game_run returns; assert_hot also fails the run on
+        // the first frame that allocates inside a hot section.
+        alloc_mode_t alloc_mode = alloc_mode_t::off;
+
+        // forces the blit and raster kernels to isa rather than the best the
+        // cpu has, so headless hashes from each set of kernels can be diffed.
+        bool force_isa = false;
+        blit_isa_t isa = blit_isa_t::scalar;
     };
 
     bool game_config_load(common::result& r, game_config_t& config);
@@ -41,11 +79,25 @@ namespace mayhem {
         video_t video{};
         window_t window{};
         bank_manager banks{};
+        asset_loader_t assets{};
+        file_watch_t watch{};
         joystick_t joystick{};
         game_config_t config{};
         sound_system_t sound{};
+        profiler_t profiler{};
+        frame_pacer_t pacer{};
+        std::atomic<uint16_t> fps{0};
         bool in_editor = false;
         entt::registry registry{};
+
+        // scratch for the frame being simulated, reset once it is done; in
+        // threaded mode it belongs to the simulation thread.
+        common::frame_arena frame_arena{64 * 1024};
+
+        // held by the simulation thread for each frame it runs in threaded
+        // mode.  the main thread takes it to change anything the frame reads:
+        // storing loaded assets and rebuilding what a reloaded bank fed.
+        std::mutex simulation_mutex{};
     };
 
     bool game_run(common::result& r, game_t& game);
@@ -0,0 +1,135 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include "image_cache.h"
+
+namespace mayhem {
+
+    static uint64_t make_cache_key(bank_id_t id, size_t size) {
+        return ((uint64_t) id.bank << 56)
+            | ((uint64_t) id.index << 40)
+            | (((uint64_t) size.w & 0xfffff) << 20)
+            | ((uint64_t) size.h & 0xfffff);
+    }
+
+    static std::size_t bitmap_bytes(const image_bitmap_t& bitmap) {
+        return bitmap.pixels.size() * sizeof(uint32_t);
+    }
+
+    static void image_bitmap_scale(
+            const image_bitmap_t& source,
+            size_t size,
+            image_bitmap_t& bitmap) {
+        bitmap.size = size;
+        bitmap.opaque = source.opaque;
+        bitmap.pixels.resize(size.w * size.h);
+
+        // same sampling as SDL_BlitScaled: nearest source pixel, no filtering
+        auto dst = bitmap.pixels.data();
+        for (int32_t y = 0; y < size.h; y++) {
+            const auto src_y = (int32_t) ((int64_t) y * source.size.h / size.h);
+            const auto src = source.pixels.data() + src_y * source.size.w;
+            for (int32_t x = 0; x < size.w; x++)
+                *dst++ = src[(int64_t) x * source.size.w / size.w];
+        }
+    }
+
+    static void image_cache_evict(image_cache_t& cache) {
+        while (cache.used > cache.budget && !cache.entries.empty()) {
+            auto& entry = cache.entries.back();
+
+            // everything nearer the front was used more recently
+            if (entry.frame == cache.frame)
+                break;
+
+            cache.used -= bitmap_bytes(entry.bitmap);
+            cache.lookup.erase(entry.key);
+            cache.entries.pop_back();
+            ++cache.stats.evictions;
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    void image_bitmap_premultiply(image_bitmap_t& bitmap) {
+        bitmap.opaque = true;
+        for (auto& pixel : bitmap.pixels) {
+            const auto alpha = pixel >> 24;
+            if (alpha == 0xff)
+                continue;
+
+            bitmap.opaque = false;
+            uint32_t result = alpha << 24;
+            for (uint32_t c = 0; c < 24; c += 8)
+                result |= ((((pixel >> c) & 0xff) * alpha + 127) / 255) << c;
+            pixel = result;
+        }
+    }
+
+    void image_cache_init(image_cache_t& cache, std::size_t budget) {
+        image_cache_clear(cache);
+        cache.budget = budget;
+    }
+
+    void image_cache_clear(image_cache_t& cache) {
+        cache.used = 0;
+        cache.lookup.clear();
+        cache.entries.clear();
+    }
+
+    void image_cache_begin_frame(image_cache_t& cache) {
+        ++cache.frame;
+        image_cache_evict(cache);
+    }
+
+    const image_bitmap_t* image_cache_get(
+            image_cache_t& cache,
+            asset_handle_t handle,
+            const image_bitmap_t& source,
+            size_t size) {
+        if (size.w <= 0 || size.h <= 0 || source.pixels.empty())
+            return nullptr;
+
+        if (size.w == source.size.w && size.h == source.size.h)
+            return &source;
+
+        const auto key = make_cache_key(handle.id, size);
+        auto it = cache.lookup.find(key);
+        if (it != std::end(cache.lookup)) {
+            auto& entry = *it->second;
+            cache.entries.splice(std::begin(cache.entries), cache.entries, it->second);
+            entry.frame = cache.frame;
+            if (entry.generation == handle.generation) {
+                ++cache.stats.hits;
+                return &entry.bitmap;
+            }
+
+            // the image was stored again since this copy was scaled
+            ++cache.stats.misses;
+            entry.generation = handle.generation;
+            image_bitmap_scale(source, size, entry.bitmap);
+            return &entry.bitmap;
+        }
+
+        ++cache.stats.misses;
+        cache.entries.emplace_front();
+        auto& entry = cache.entries.front();
+        entry.key = key;
+        entry.frame = cache.frame;
+        entry.generation = handle.generation;
+        image_bitmap_scale(source, size, entry.bitmap);
+        cache.used += bitmap_bytes(entry.bitmap);
+        cache.lookup[key] = std::begin(cache.entries);
+
+        image_cache_evict(cache);
+
+        return &entry.bitmap;
+    }
+
+}
@@ -0,0 +1,72 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <list>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "types.h"
+#include "asset_table.h"
+
+namespace mayhem {
+
+    // tightly packed BGRA32 with premultiplied alpha, ready to blit into
+    // video.fg.  opaque is set when every pixel has full alpha, so draws can
+    // be plain copies.
+    struct image_bitmap_t {
+        size_t size{};
+        bool opaque = false;
+        std::vector<uint32_t> pixels{};
+    };
+
+    struct image_cache_entry_t {
+        uint64_t key = 0;
+        uint32_t frame = 0;
+        uint32_t generation = 0;
+        image_bitmap_t bitmap{};
+    };
+
+    struct image_cache_stats_t {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t evictions = 0;
+    };
+
+    // scaled variants keyed by (bank_id_t, w, h), most recently used first.
+    // an entry scaled from an older generation of the image is redone.
+    // entries used during the current frame are never evicted, so pointers
+    // handed out stay valid until the next image_cache_begin_frame.
+    struct image_cache_t {
+        uint32_t frame = 0;
+        std::size_t used = 0;
+        std::size_t budget = 0;
+        image_cache_stats_t stats{};
+        std::list<image_cache_entry_t> entries{};
+        std::unordered_map<uint64_t, std::list<image_cache_entry_t>::iterator> lookup{};
+    };
+
+    void image_bitmap_premultiply(image_bitmap_t& bitmap);
+
+    void image_cache_init(image_cache_t& cache, std::size_t budget);
+
+    void image_cache_clear(image_cache_t& cache);
+
+    void image_cache_begin_frame(image_cache_t& cache);
+
+    // returns source itself when size matches, otherwise a nearest-neighbour
+    // scaled copy from the cache; nullptr for an empty size.
+    const image_bitmap_t* image_cache_get(
+        image_cache_t& cache,
+        asset_handle_t handle,
+        const image_bitmap_t& source,
+        size_t size);
+
+}
@@ -0,0 +1,84 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <algorithm>
+#include "palette.h"
+
+namespace mayhem {
+
+    static palette_t s_palettes[max_palettes]{};
+    static uint32_t s_versions[max_palettes]{};
+    static uint32_t s_version = 0;
+
+    static void palette_mark_changed(uint8_t index) {
+        auto& pal = s_palettes[index];
+        for (uint32_t i = 0; i < 16; i++) {
+            pal.planes[0][i] = pal.entries[i].blue;
+            pal.planes[1][i] = pal.entries[i].green;
+            pal.planes[2][i] = pal.entries[i].red;
+            pal.planes[3][i] = pal.entries[i].alpha;
+        }
+        s_versions[index] = ++s_version;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    palette_t* palette(uint8_t index) {
+        return &s_palettes[index];
+    }
+
+    uint32_t palette_version(uint8_t index) {
+        return s_versions[index];
+    }
+
+    void palette_set(
+            uint8_t index,
+            uint8_t first,
+            const palette_entry_t* entries,
+            uint32_t count) {
+        count = std::min(count, max_palette_entries - first);
+        memcpy(&s_palettes[index].entries[first], entries, count * sizeof(palette_entry_t));
+        palette_mark_changed(index);
+    }
+
+    void palette_rotate(uint8_t index, uint8_t first, uint32_t count, int32_t step) {
+        count = std::min(count, max_palette_entries - first);
+        if (count < 2)
+            return;
+
+        auto begin = &s_palettes[index].entries[first];
+        auto end = begin + count;
+        if (step > 0)
+            std::rotate(begin, end - 1, end);
+        else
+            std::rotate(begin, begin + 1, end);
+
+        palette_mark_changed(index);
+    }
+
+    void palette_fade(
+            uint8_t index,
+            const palette_t& source,
+            palette_entry_t target,
+            uint8_t level) {
+        auto& pal = s_palettes[index];
+        const uint32_t inverse = 255 - level;
+        for (uint32_t i = 0; i < max_palette_entries; i++) {
+            const auto& from = source.entries[i];
+            auto& to = pal.entries[i];
+            to.blue = (uint8_t) ((from.blue * inverse + target.blue * level + 127) / 255);
+            to.green = (uint8_t) ((from.green * inverse + target.green * level + 127) / 255);
+            to.red = (uint8_t) ((from.red * inverse + target.red * level + 127) / 255);
+            to.alpha = from.alpha;
+        }
+        palette_mark_changed(index);
+    }
+
+}
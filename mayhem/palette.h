@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace mayhem {
+
+    static constexpr uint32_t max_palettes = 256;
+    static constexpr uint32_t max_palette_entries = 256;
+
+    // laid out as BGRA32 so an entry can be stored straight into video.fg
+    union palette_entry_t {
+        uint32_t value;
+        struct {
+            uint8_t blue;
+            uint8_t green;
+            uint8_t red;
+            uint8_t alpha;
+        };
+    };
+
+    struct palette_t {
+        palette_entry_t entries[max_palette_entries];
+
+        // the first 16 entries split into blue, green, red and alpha byte
+        // planes; this is the lookup table for the pshufb expansion kernel.
+        alignas(16) uint8_t planes[4][16];
+    };
+
+    palette_t* palette(uint8_t index);
+
+    // bumped on every change to the palette at index, so a copy can tell
+    // whether it is current without comparing entries.
+    uint32_t palette_version(uint8_t index);
+
+    void palette_set(
+        uint8_t index,
+        uint8_t first,
+        const palette_entry_t* entries,
+        uint32_t count);
+
+    // rotates count entries starting at first by one step; a negative step
+    // rotates toward lower indices.  used for water, lava and similar cycles.
+    void palette_rotate(uint8_t index, uint8_t first, uint32_t count, int32_t step);
+
+    // writes source blended toward target by level / 255 into the palette at
+    // index.  alpha is preserved so transparent entries stay transparent.
+    void palette_fade(
+        uint8_t index,
+        const palette_t& source,
+        palette_entry_t target,
+        uint8_t level);
+
+}
@@ -0,0 +1,261 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <SDL.h>
+#include <algorithm>
+#include <fmt/format.h>
+#include "game.h"
+#include "profiler.h"
+
+namespace mayhem {
+
+    struct profile_phase_info_t {
+        std::string_view name;
+        uint8_t depth;
+    };
+
+    static const profile_phase_info_t s_phases[] = {
+        {"frame",       0},
+        {"sound",       1},
+        {"timers",      1},
+        {"state",       1},
+        {"draw",        1},
+        {"video",       1},
+        {"bg",          2},
+        {"sprites",     2},
+        {"bin",         2},
+        {"text",        3},
+        {"compose",     2},
+        {"restore",     3},
+        {"scanlines",   3},
+        {"overlays",    3},
+        {"upload",      2},
+        {"present",     2},
+    };
+
+    static_assert(sizeof(s_phases) / sizeof(s_phases[0]) == profile_phase_count);
+
+    // overlay layout, in screen pixels
+    static constexpr uint32_t average_frames = 30;
+    static constexpr int32_t overlay_x = 4;
+    static constexpr int32_t overlay_y = 4;
+    static constexpr int32_t row_height = 16;
+    static constexpr int32_t indent_width = 8;
+    static constexpr int32_t label_width = 110;
+    static constexpr int32_t value_width = 48;
+    static constexpr int32_t budget_width = 120;
+    static constexpr int32_t graph_budget = 48;
+    static constexpr int32_t graph_height = 80;
+    static constexpr int32_t graph_bar_width = 2;
+    static constexpr int32_t padding = 4;
+
+    static const color_t s_background = {0x00, 0x00, 0x00, 0xb0};
+    static const color_t s_text = {0xff, 0xff, 0xff, 0xff};
+    static const color_t s_budget = {0xff, 0xe0, 0x40, 0xff};
+    static const color_t s_over_budget = {0xff, 0x40, 0x40, 0xff};
+    static const color_t s_depth_colors[] = {
+        {0x40, 0xd0, 0x40, 0xff},
+        {0x40, 0xa0, 0xff, 0xff},
+        {0xa0, 0x80, 0xff, 0xff},
+        {0xff, 0xa0, 0x40, 0xff},
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    profiler_scope_t::profiler_scope_t(
+            profiler_t& profiler,
+            profile_phase_t phase) : profiler(profiler),
+                                     phase(phase),
+                                     start(profiler.enabled ? profiler_now() : 0) {
+    }
+
+    profiler_scope_t::~profiler_scope_t() {
+        if (profiler.enabled)
+            profiler_add(profiler, phase, profiler_now() - start);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    void profiler_init(profiler_t& profiler) {
+        profiler.frequency = std::max<uint64_t>(SDL_GetPerformanceFrequency(), 1);
+        profiler.frames.store(0, std::memory_order_relaxed);
+        for (auto& ticks : profiler.current)
+            ticks.store(0, std::memory_order_relaxed);
+        for (auto& slot : profiler.history)
+            slot.sequence.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t profiler_now() {
+        return SDL_GetPerformanceCounter();
+    }
+
+    void profiler_add(profiler_t& profiler, profile_phase_t phase, uint64_t ticks) {
+        profiler.current[static_cast<uint32_t>(phase)].fetch_add(ticks, std::memory_order_relaxed);
+    }
+
+    // single writer: only the thread running game_run ends frames
+    void profiler_end_frame(profiler_t& profiler) {
+        const auto index = profiler.frames.load(std::memory_order_relaxed);
+        const auto lap = static_cast<uint32_t>(index / profiler_history);
+        auto& slot = profiler.history[index % profiler_history];
+
+        slot.sequence.store(lap * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (uint32_t i = 0; i < profile_phase_count; i++) {
+            slot.ticks[i].store(
+                profiler.current[i].exchange(0, std::memory_order_relaxed),
+                std::memory_order_relaxed);
+        }
+        slot.sequence.store(lap * 2 + 2, std::memory_order_release);
+
+        profiler.frames.store(index + 1, std::memory_order_release);
+    }
+
+    double profiler_ms(const profiler_t& profiler, uint64_t ticks) {
+        return static_cast<double>(ticks) * 1000.0 / static_cast<double>(profiler.frequency);
+    }
+
+    std::string_view profiler_phase_name(profile_phase_t phase) {
+        return s_phases[static_cast<uint32_t>(phase)].name;
+    }
+
+    uint32_t profiler_phase_depth(profile_phase_t phase) {
+        return s_phases[static_cast<uint32_t>(phase)].depth;
+    }
+
+    bool profiler_sample(const profiler_t& profiler, uint32_t age, profile_sample_t& sample) {
+        const auto frames = profiler.frames.load(std::memory_order_acquire);
+        if (age >= frames || age >= profiler_history)
+            return false;
+
+        const auto index = frames - 1 - age;
+        const auto expected = static_cast<uint32_t>(index / profiler_history) * 2 + 2;
+        const auto& slot = profiler.history[index % profiler_history];
+
+        if (slot.sequence.load(std::memory_order_acquire) != expected)
+            return false;
+        for (uint32_t i = 0; i < profile_phase_count; i++)
+            sample.ticks[i] = slot.ticks[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == expected;
+    }
+
+    bool profiler_draw_overlay(common::result& r, game_t& game) {
+        const auto& profiler = game.profiler;
+        const auto budget_ms = 1000.0 / target_frame_rate;
+
+        profile_sample_t average{};
+        profile_sample_t sample{};
+        uint32_t count = 0;
+        for (uint32_t age = 0; age < average_frames; age++) {
+            if (!profiler_sample(profiler, age, sample))
+                continue;
+            for (uint32_t i = 0; i < profile_phase_count; i++)
+                average.ticks[i] += sample.ticks[i];
+            ++count;
+        }
+        if (count == 0)
+            return true;
+
+        const auto previous_layer = game.video.draw_layer;
+        const auto previous_blend = game.video.draw_blend;
+        video_draw_layer(game, 0xff);
+        video_draw_blend(game, true);
+
+        const auto rows_height = static_cast<int32_t>(profile_phase_count) * row_height;
+        const auto graph_top = overlay_y + padding + rows_height + padding;
+        const auto graph_bottom = graph_top + graph_height;
+        const auto pacing_top = graph_bottom + padding;
+        const auto width = padding + label_width + value_width + budget_width + padding;
+        if (!video_queue_box(
+                r,
+                game,
+                s_background,
+                overlay_y,
+                overlay_x,
+                width,
+                pacing_top + row_height + padding - overlay_y,
+                true)) {
+            return false;
+        }
+
+        // per-phase averages: label, milliseconds and a bar where
+        // budget_width is one whole frame at the target rate
+        for (uint32_t i = 0; i < profile_phase_count; i++) {
+            const auto& phase = s_phases[i];
+            const auto ms = profiler_ms(profiler, average.ticks[i] / count);
+            const auto y = overlay_y + padding + static_cast<int32_t>(i) * row_height;
+            const auto x = overlay_x + padding;
+
+            if (!video_queue_text(r, game, bank_id_t{0xff, 0}, s_text, y, x + phase.depth * indent_width, phase.name))
+                return false;
+            if (!video_queue_text(r, game, bank_id_t{0xff, 0}, s_text, y, x + label_width, game.frame_arena.format("{:.2f}", ms)))
+                return false;
+
+            const auto bar = std::min(
+                static_cast<int32_t>(ms / budget_ms * budget_width + 0.5),
+                budget_width);
+            if (bar > 0) {
+                const auto& color = ms > budget_ms ? s_over_budget : s_depth_colors[phase.depth];
+                const auto bar_x = x + label_width + value_width;
+                if (!video_queue_box(r, game, color, y + 4, bar_x, bar, row_height - 8, true))
+                    return false;
+            }
+        }
+
+        // frame times, oldest on the left; the line is the frame budget
+        const auto graph_x = overlay_x + padding;
+        for (uint32_t age = 0; age < profiler_history; age++) {
+            if (!profiler_sample(profiler, age, sample))
+                continue;
+            const auto ms = profiler_ms(profiler, sample.ticks[0]);
+            const auto h = std::clamp(
+                static_cast<int32_t>(ms / budget_ms * graph_budget + 0.5),
+                1,
+                graph_height);
+            const auto x = graph_x + static_cast<int32_t>(profiler_history - 1 - age) * graph_bar_width;
+            const auto& color = ms > budget_ms ? s_over_budget : s_depth_colors[0];
+            if (!video_queue_box(r, game, color, graph_bottom - h, x, graph_bar_width, h, true))
+                return false;
+        }
+        if (!video_queue_hline(
+                r,
+                game,
+                s_budget,
+                graph_bottom - graph_budget,
+                graph_x,
+                static_cast<int32_t>(profiler_history) * graph_bar_width)) {
+            return false;
+        }
+
+        frame_pacer_stats_t pacing{};
+        if (frame_pacer_stats(game.pacer, pacing)) {
+            if (!video_queue_text(
+                    r,
+                    game,
+                    bank_id_t{0xff, 0},
+                    s_text,
+                    pacing_top,
+                    graph_x,
+                    game.frame_arena.format(
+                        "{:.3f} Hz  p50 {:.2f}  p99 {:.2f}",
+                        pacing.hz,
+                        pacing.p50 / 1e6,
+                        pacing.p99 / 1e6))) {
+                return false;
+            }
+        }
+
+        video_draw_layer(game, previous_layer);
+        video_draw_blend(game, previous_blend);
+
+        return true;
+    }
+
+}
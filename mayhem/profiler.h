@@ -0,0 +1,102 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <common/result.h>
+
+namespace mayhem {
+
+    // phases nest as listed in the table in profiler.cpp; restore, scanlines
+    // and overlays are summed over every compositor band, so with workers
+    // they can add up to more than compose itself.
+    enum class profile_phase_t : uint8_t {
+        frame,
+        sound,
+        timers,
+        state,
+        draw,
+        video,
+        video_bg,
+        video_sprites,
+        video_bin,
+        video_text,
+        video_compose,
+        video_restore,
+        video_scanlines,
+        video_overlays,
+        video_upload,
+        video_present,
+        count
+    };
+
+    static constexpr uint32_t profile_phase_count = static_cast<uint32_t>(profile_phase_t::count);
+
+    static constexpr uint32_t profiler_history = 128;
+
+    struct profile_sample_t {
+        uint64_t ticks[profile_phase_count]{};
+    };
+
+    // one slot of the history ring.  sequence is odd while the slot is being
+    // written, so a reader on another thread can detect a torn copy and
+    // retry instead of taking a lock.
+    struct profile_slot_t {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint64_t> ticks[profile_phase_count]{};
+    };
+
+    // phases are accumulated into current from any thread during a frame;
+    // profiler_end_frame publishes them into the ring.  ticks are
+    // SDL_GetPerformanceCounter units, see profiler_ms.
+    struct profiler_t {
+        bool enabled = true;
+        uint64_t frequency = 1;
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> current[profile_phase_count]{};
+        profile_slot_t history[profiler_history]{};
+    };
+
+    struct profiler_scope_t {
+        profiler_scope_t(profiler_t& profiler, profile_phase_t phase);
+
+        ~profiler_scope_t();
+
+        profiler_t& profiler;
+        profile_phase_t phase;
+        uint64_t start;
+    };
+
+    struct game_t;
+
+    void profiler_init(profiler_t& profiler);
+
+    uint64_t profiler_now();
+
+    void profiler_add(profiler_t& profiler, profile_phase_t phase, uint64_t ticks);
+
+    void profiler_end_frame(profiler_t& profiler);
+
+    double profiler_ms(const profiler_t& profiler, uint64_t ticks);
+
+    std::string_view profiler_phase_name(profile_phase_t phase);
+
+    uint32_t profiler_phase_depth(profile_phase_t phase);
+
+    // age 0 is the most recently finished frame.  false when that frame has
+    // not been recorded or was overwritten while being copied.
+    bool profiler_sample(const profiler_t& profiler, uint32_t age, profile_sample_t& sample);
+
+    // per-phase bars and a frame time graph, queued on the top draw layer
+    bool profiler_draw_overlay(common::result& r, game_t& game);
+
+}
@@ -0,0 +1,337 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <algorithm>
+#include "log.h"
+#include "raster.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MAYHEM_RASTER_X86
+#include <immintrin.h>
+#endif
+
+namespace mayhem {
+
+    // per-channel source terms for blending: c * a + 128, with the alpha
+    // channel treated as 255 so that it accumulates coverage.
+    struct blend_terms_t {
+        uint16_t inv = 0;
+        uint16_t src[4]{};
+    };
+
+    static blend_terms_t make_blend_terms(uint32_t color) {
+        const auto a = color >> 24;
+        blend_terms_t terms{};
+        terms.inv = static_cast<uint16_t>(255 - a);
+        terms.src[0] = static_cast<uint16_t>((color & 0xff) * a + 128);
+        terms.src[1] = static_cast<uint16_t>(((color >> 8) & 0xff) * a + 128);
+        terms.src[2] = static_cast<uint16_t>(((color >> 16) & 0xff) * a + 128);
+        terms.src[3] = static_cast<uint16_t>(255 * a + 128);
+        return terms;
+    }
+
+    // (v + (v >> 8)) >> 8 is an exact round(v / 255) for the range used here.
+    // blue/red and green/alpha are done as two 16-bit lanes of one word;
+    // no lane can carry into the next.
+    static uint32_t blend_pixel(uint32_t pixel, const blend_terms_t& terms) {
+        const auto src_br = (uint32_t) terms.src[0] | ((uint32_t) terms.src[2] << 16);
+        const auto src_ga = (uint32_t) terms.src[1] | ((uint32_t) terms.src[3] << 16);
+        auto br = (pixel & 0x00ff00ffu) * terms.inv + src_br;
+        auto ga = ((pixel >> 8) & 0x00ff00ffu) * terms.inv + src_ga;
+        br = ((br + ((br >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+        ga = ((ga + ((ga >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+        return br | (ga << 8);
+    }
+
+    // two pixels per 64-bit store
+    static void fill_span_scalar(uint32_t* dst, uint32_t count, uint32_t color) {
+        const auto pair = ((uint64_t) color << 32) | color;
+        uint32_t i = 0;
+        for (; i + 2 <= count; i += 2)
+            memcpy(dst + i, &pair, sizeof(pair));
+        if (i < count)
+            dst[i] = color;
+    }
+
+    static void blend_span_scalar(uint32_t* dst, uint32_t count, uint32_t color) {
+        const auto terms = make_blend_terms(color);
+        for (uint32_t i = 0; i < count; i++)
+            dst[i] = blend_pixel(dst[i], terms);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+#ifdef MAYHEM_RASTER_X86
+    // both wide fills align dst first, so the main loop never splits a
+    // cache line; short spans fall straight through to the scalar tail.
+    __attribute__((target("sse2")))
+    static void fill_span_sse2(uint32_t* dst, uint32_t count, uint32_t color) {
+        uint32_t i = 0;
+        for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 15) != 0; i++)
+            dst[i] = color;
+
+        const auto v = _mm_set1_epi32(static_cast<int32_t>(color));
+        for (; i + 8 <= count; i += 8) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(dst + i), v);
+            _mm_store_si128(reinterpret_cast<__m128i*>(dst + i + 4), v);
+        }
+        fill_span_scalar(dst + i, count - i, color);
+    }
+
+    __attribute__((target("sse2")))
+    static inline __m128i blend_half_sse2(__m128i d, __m128i inv, __m128i src) {
+        auto v = _mm_add_epi16(_mm_mullo_epi16(d, inv), src);
+        return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+    }
+
+    __attribute__((target("sse2")))
+    static void blend_span_sse2(uint32_t* dst, uint32_t count, uint32_t color) {
+        const auto terms = make_blend_terms(color);
+        const auto zero = _mm_setzero_si128();
+        const auto inv = _mm_set1_epi16(static_cast<int16_t>(terms.inv));
+        const auto src = _mm_setr_epi16(
+            terms.src[0], terms.src[1], terms.src[2], terms.src[3],
+            terms.src[0], terms.src[1], terms.src[2], terms.src[3]);
+
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            const auto lo = blend_half_sse2(_mm_unpacklo_epi8(d, zero), inv, src);
+            const auto hi = blend_half_sse2(_mm_unpackhi_epi8(d, zero), inv, src);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        for (; i < count; i++)
+            dst[i] = blend_pixel(dst[i], terms);
+    }
+
+    __attribute__((target("avx2")))
+    static void fill_span_avx2(uint32_t* dst, uint32_t count, uint32_t color) {
+        uint32_t i = 0;
+        for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 31) != 0; i++)
+            dst[i] = color;
+
+        const auto v = _mm256_set1_epi32(static_cast<int32_t>(color));
+        for (; i + 16 <= count; i += 16) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), v);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i + 8), v);
+        }
+        fill_span_scalar(dst + i, count - i, color);
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256i blend_half_avx2(__m256i d, __m256i inv, __m256i src) {
+        auto v = _mm256_add_epi16(_mm256_mullo_epi16(d, inv), src);
+        return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+    }
+
+    __attribute__((target("avx2")))
+    static void blend_span_avx2(uint32_t* dst, uint32_t count, uint32_t color) {
+        const auto terms = make_blend_terms(color);
+        const auto zero = _mm256_setzero_si256();
+        const auto inv = _mm256_set1_epi16(static_cast<int16_t>(terms.inv));
+        const auto src = _mm256_set1_epi64x(static_cast<int64_t>(
+            (uint64_t) terms.src[0]
+            | ((uint64_t) terms.src[1] << 16)
+            | ((uint64_t) terms.src[2] << 32)
+            | ((uint64_t) terms.src[3] << 48)));
+
+        uint32_t i = 0;
+        for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 31) != 0; i++)
+            dst[i] = blend_pixel(dst[i], terms);
+
+        // unpack and pack both work within 128-bit lanes, so pixel order
+        // survives the round trip.
+        for (; i + 8 <= count; i += 8) {
+            const auto d = _mm256_load_si256(reinterpret_cast<const __m256i*>(dst + i));
+            const auto lo = blend_half_avx2(_mm256_unpacklo_epi8(d, zero), inv, src);
+            const auto hi = blend_half_avx2(_mm256_unpackhi_epi8(d, zero), inv, src);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+        }
+        for (; i < count; i++)
+            dst[i] = blend_pixel(dst[i], terms);
+    }
+#endif
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    static const raster_kernels_t s_scalar_kernels = {
+        blit_isa_t::scalar,
+        fill_span_scalar,
+        blend_span_scalar,
+    };
+
+#ifdef MAYHEM_RASTER_X86
+    static const raster_kernels_t s_sse2_kernels = {
+        blit_isa_t::sse2,
+        fill_span_sse2,
+        blend_span_sse2,
+    };
+
+    static const raster_kernels_t s_ssse3_kernels = {
+        blit_isa_t::ssse3,
+        fill_span_sse2,
+        blend_span_sse2,
+    };
+
+    static const raster_kernels_t s_avx2_kernels = {
+        blit_isa_t::avx2,
+        fill_span_avx2,
+        blend_span_avx2,
+    };
+#endif
+
+    static const raster_kernels_t* s_kernels = &s_scalar_kernels;
+
+    void raster_init() {
+        if (!raster_select(blit_kernels().isa))
+            raster_select(blit_isa_t::scalar);
+
+        log_message(
+            log_category_t::video,
+            "raster kernels: {}",
+            blit_isa_name(s_kernels->isa));
+    }
+
+    bool raster_select(blit_isa_t isa) {
+        auto kernels = raster_kernels(isa);
+        if (kernels == nullptr)
+            return false;
+        s_kernels = kernels;
+        return true;
+    }
+
+    const raster_kernels_t& raster_kernels() {
+        return *s_kernels;
+    }
+
+    // the blit table already knows which instruction sets this cpu has
+    const raster_kernels_t* raster_kernels(blit_isa_t isa) {
+        if (blit_kernels(isa) == nullptr)
+            return nullptr;
+
+        switch (isa) {
+            case blit_isa_t::scalar:
+                return &s_scalar_kernels;
+#ifdef MAYHEM_RASTER_X86
+            case blit_isa_t::sse2:
+                return &s_sse2_kernels;
+            case blit_isa_t::ssse3:
+                return &s_ssse3_kernels;
+            case blit_isa_t::avx2:
+                return &s_avx2_kernels;
+#endif
+            default:
+                return nullptr;
+        }
+    }
+
+    void raster_fill_rect(
+            const blit_target_t& target,
+            int32_t left,
+            int32_t top,
+            int32_t right,
+            int32_t bottom,
+            uint32_t color,
+            bool blend) {
+        left = std::max(left, target.clip_left);
+        top = std::max(top, target.clip_top);
+        right = std::min(right, target.clip_right);
+        bottom = std::min(bottom, target.clip_bottom);
+        if (left >= right || top >= bottom)
+            return;
+
+        const auto alpha = color >> 24;
+        if (blend && alpha == 0)
+            return;
+
+        auto kernel = blend && alpha != 0xff ? s_kernels->blend : s_kernels->fill;
+        const auto count = static_cast<uint32_t>(right - left);
+
+        // one pixel wide columns are not worth a kernel call per row
+        auto row = target.pixels + top * target.pitch + left;
+        if (count == 1 && kernel == s_kernels->fill) {
+            for (auto y = top; y < bottom; y++) {
+                *row = color;
+                row += target.pitch;
+            }
+            return;
+        }
+
+        // a rectangle spanning whole rows is one contiguous run
+        if (count == static_cast<uint32_t>(target.pitch)) {
+            kernel(row, count * static_cast<uint32_t>(bottom - top), color);
+            return;
+        }
+
+        for (auto y = top; y < bottom; y++) {
+            kernel(row, count, color);
+            row += target.pitch;
+        }
+    }
+
+    void raster_hline(
+            const blit_target_t& target,
+            int32_t x,
+            int32_t y,
+            int32_t w,
+            uint32_t color,
+            bool blend) {
+        if (w <= 0)
+            return;
+        raster_fill_rect(target, x, y, x + w, y + 1, color, blend);
+    }
+
+    void raster_vline(
+            const blit_target_t& target,
+            int32_t x,
+            int32_t y,
+            int32_t h,
+            uint32_t color,
+            bool blend) {
+        if (h <= 0)
+            return;
+        raster_fill_rect(target, x, y, x + 1, y + h, color, blend);
+    }
+
+    void raster_box(
+            const blit_target_t& target,
+            int32_t x,
+            int32_t y,
+            int32_t w,
+            int32_t h,
+            uint32_t color,
+            bool fill,
+            bool blend) {
+        if (w <= 0 || h <= 0)
+            return;
+
+        if (fill) {
+            raster_fill_rect(target, x, y, x + w, y + h, color, blend);
+            return;
+        }
+
+        // the left edge starts below the top edge so no pixel is blended twice
+        raster_hline(target, x, y, w, color, blend);
+        raster_hline(target, x, y + h, w, color, blend);
+        raster_vline(target, x, y + 1, h - 1, color, blend);
+        raster_vline(target, x + w, y, h, color, blend);
+    }
+
+    void raster_clear(const blit_target_t& target, uint32_t color) {
+        raster_fill_rect(
+            target,
+            target.clip_left,
+            target.clip_top,
+            target.clip_right,
+            target.clip_bottom,
+            color);
+    }
+
+}
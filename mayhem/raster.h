@@ -0,0 +1,79 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include "blit.h"
+
+namespace mayhem {
+
+    // span kernels write count BGRA32 pixels starting at dst.  fill stores
+    // color as-is; blend draws color over dst using color's alpha byte, and
+    // the result's alpha is the usual a + dst_a * (1 - a).
+    using raster_span_kernel_t = void (*)(uint32_t* dst, uint32_t count, uint32_t color);
+
+    struct raster_kernels_t {
+        blit_isa_t isa = blit_isa_t::scalar;
+        raster_span_kernel_t fill = nullptr;
+        raster_span_kernel_t blend = nullptr;
+    };
+
+    // picks the same instruction set as the blit kernels
+    void raster_init();
+
+    bool raster_select(blit_isa_t isa);
+
+    const raster_kernels_t& raster_kernels();
+
+    const raster_kernels_t* raster_kernels(blit_isa_t isa);
+
+    // every primitive is clipped against the target's clip rectangle once,
+    // up front; right and bottom are exclusive.
+    void raster_fill_rect(
+        const blit_target_t& target,
+        int32_t left,
+        int32_t top,
+        int32_t right,
+        int32_t bottom,
+        uint32_t color,
+        bool blend = false);
+
+    void raster_hline(
+        const blit_target_t& target,
+        int32_t x,
+        int32_t y,
+        int32_t w,
+        uint32_t color,
+        bool blend = false);
+
+    void raster_vline(
+        const blit_target_t& target,
+        int32_t x,
+        int32_t y,
+        int32_t h,
+        uint32_t color,
+        bool blend = false);
+
+    // the outline covers the same pixels as the old video_draw_rect: the
+    // right and bottom edges sit at x + w and y + h.
+    void raster_box(
+        const blit_target_t& target,
+        int32_t x,
+        int32_t y,
+        int32_t w,
+        int32_t h,
+        uint32_t color,
+        bool fill = false,
+        bool blend = false);
+
+    // fills the whole clip rectangle
+    void raster_clear(const blit_target_t& target, uint32_t color);
+
+}
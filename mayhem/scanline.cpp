@@ -0,0 +1,85 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "scanline.h"
+
+namespace mayhem {
+
+    void scanline_init(scanline_buckets_t& buckets, uint32_t lines, uint32_t limit) {
+        buckets.lines = lines;
+        buckets.limit = limit;
+        buckets.dropped = 0;
+        buckets.counts.assign(lines, 0);
+        buckets.entries.assign(lines * limit, 0);
+        buckets.sprites.clear();
+    }
+
+    void scanline_reset(scanline_buckets_t& buckets) {
+        buckets.dropped = 0;
+        buckets.sprites.clear();
+        std::fill(std::begin(buckets.counts), std::end(buckets.counts), 0);
+    }
+
+    void scanline_add(
+            scanline_buckets_t& buckets,
+            uint16_t index,
+            uint8_t priority,
+            const blit_span_t& span) {
+        buckets.sprites.push_back(scanline_sprite_t{index, priority, span});
+    }
+
+    void scanline_bin(scanline_buckets_t& buckets) {
+        auto& sprites = buckets.sprites;
+
+        // each sprite is added once, so the table index breaks priority ties
+        // without std::stable_sort's temporary buffer.  higher indices sort
+        // first so they end up drawn last, on top, as the sprite table was
+        // drawn in order before scanline buckets.
+        std::sort(
+            std::begin(sprites),
+            std::end(sprites),
+            [](const scanline_sprite_t& lhs, const scanline_sprite_t& rhs) {
+                if (lhs.priority != rhs.priority)
+                    return lhs.priority > rhs.priority;
+                return lhs.index > rhs.index;
+            });
+
+        for (uint16_t i = 0; i < sprites.size(); i++) {
+            const auto& span = sprites[i].span;
+            const auto bottom = std::min<uint32_t>(span.bottom, buckets.lines);
+            for (auto line = (uint32_t) std::max(span.top, 0); line < bottom; line++) {
+                auto& count = buckets.counts[line];
+                if (count == buckets.limit) {
+                    ++buckets.dropped;
+                    continue;
+                }
+                buckets.entries[line * buckets.limit + count++] = i;
+            }
+        }
+    }
+
+    void scanline_compose(
+            const scanline_buckets_t& buckets,
+            const blit_target_t& target,
+            uint32_t first_line,
+            uint32_t last_line) {
+        last_line = std::min(last_line, buckets.lines);
+
+        auto row = target.pixels + first_line * target.pitch;
+        for (auto line = first_line; line < last_line; line++) {
+            // each bucket is in priority order; draw it back to front
+            const auto bucket = buckets.entries.data() + line * buckets.limit;
+            for (auto i = (int32_t) buckets.counts[line] - 1; i >= 0; i--)
+                blit_draw_row(buckets.sprites[bucket[i]].span, row, line);
+            row += target.pitch;
+        }
+    }
+
+}
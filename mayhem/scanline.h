@@ -0,0 +1,56 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "blit.h"
+
+namespace mayhem {
+
+    struct scanline_sprite_t {
+        uint16_t index = 0;
+        uint8_t priority = 0;
+        blit_span_t span{};
+    };
+
+    // sprites are binned into every target line they cover, in priority
+    // order.  higher priorities win the per-line slots and are drawn on top;
+    // equal priorities fall back to sprite table order, higher index on top.
+    struct scanline_buckets_t {
+        uint32_t lines = 0;
+        uint32_t limit = 0;
+        uint32_t dropped = 0;
+        std::vector<uint16_t> counts{};
+        std::vector<uint16_t> entries{};
+        std::vector<scanline_sprite_t> sprites{};
+    };
+
+    void scanline_init(scanline_buckets_t& buckets, uint32_t lines, uint32_t limit);
+
+    void scanline_reset(scanline_buckets_t& buckets);
+
+    void scanline_add(
+        scanline_buckets_t& buckets,
+        uint16_t index,
+        uint8_t priority,
+        const blit_span_t& span);
+
+    void scanline_bin(scanline_buckets_t& buckets);
+
+    // draws lines [first_line, last_line) of the target; bands of lines may
+    // be composed independently.
+    void scanline_compose(
+        const scanline_buckets_t& buckets,
+        const blit_target_t& target,
+        uint32_t first_line,
+        uint32_t last_line);
+
+}
@@ -13,13 +13,21 @@
 
 namespace mayhem {
 
-    bool sound_init(common::result& r, sound_system_t& system) {
+    bool sound_init(common::result& r, sound_system_t& system, bool nosound) {
         auto result = FMOD::System_Create(&system.handle);
         if (result != FMOD_OK) {
             r.error("S001", fmt::format("fmod error {}: {}", result, FMOD_ErrorString(result)));
             return false;
         }
 
+        if (nosound) {
+            result = system.handle->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+            if (result != FMOD_OK) {
+                r.error("S001", fmt::format("fmod error {}: {}", result, FMOD_ErrorString(result)));
+                return false;
+            }
+        }
+
         result = system.handle->init(512, FMOD_INIT_NORMAL, 0);
         if (result != FMOD_OK) {
             r.error("S001", fmt::format("fmod error {}: {}", result, FMOD_ErrorString(result)));
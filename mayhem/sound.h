@@ -18,7 +18,8 @@ namespace mayhem {
         FMOD::System* handle = nullptr;
     };
 
-    bool sound_init(common::result& r, sound_system_t& system);
+    // nosound drives fmod without an output device, for headless runs
+    bool sound_init(common::result& r, sound_system_t& system, bool nosound = false);
 
     bool sound_update(common::result& r, sound_system_t& system);
 
@@ -10,6 +10,7 @@
 #include <string>
 #include <fmt/format.h>
 #include "log.h"
+#include "game.h"
 #include "state_machine.h"
 
 namespace mayhem {
@@ -27,6 +28,9 @@ namespace mayhem {
         return "default"sv;
     }
 
+    void state::assets(bank_request_list_t& requests) const {
+    }
+
     bool state::enter(common::result& r, game_t& game) {
         return true;
     }
@@ -39,6 +43,10 @@ namespace mayhem {
         return true;
     }
 
+    bool state::draw(common::result& r, game_t& game, float alpha) {
+        return true;
+    }
+
     ///////////////////////////////////////////////////////////////////////////
 
     state_machine::~state_machine() {
@@ -92,6 +100,16 @@ namespace mayhem {
         return top->update(r, game);
     }
 
+    bool state_machine::draw(common::result& r, game_t& game, float alpha) {
+        if (_states.empty()) {
+            r.error("G400", "the game state stack must not be empty.");
+            return false;
+        }
+
+        auto top = _states.top();
+        return top->draw(r, game, alpha);
+    }
+
     bool state_machine::push(common::result& r, game_t& game, uint32_t type) {
         auto state = find_state(type);
         if (state == nullptr) {
@@ -106,6 +124,11 @@ namespace mayhem {
                 return false;
         }
 
+        bank_request_list_t requests{};
+        state->assets(requests);
+        if (!requests.empty() && !game.banks.prefetch(r, requests))
+            return false;
+
         _states.push(state);
         log_debug(log_category_t::app, "enter state: {}", state->name());
         return state->enter(r, game);
@@ -12,6 +12,7 @@
 #include <stack>
 #include <unordered_map>
 #include <common/result.h>
+#include "bank_manager.h"
 
 namespace mayhem {
 
@@ -24,12 +25,21 @@ namespace mayhem {
 
         virtual std::string_view name() const;
 
+        // the bank entries this state reads once entered; they are
+        // prefetched by state_machine::push before enter is called.
+        virtual void assets(bank_request_list_t& requests) const;
+
         virtual bool enter(common::result& r, game_t& game);
 
         virtual bool leave(common::result& r, game_t& game);
 
+        // update runs once per fixed simulation step; draw runs once per
+        // rendered frame, with alpha the fraction of a step elapsed since
+        // the last update, for interpolating between simulation states.
         virtual bool update(common::result& r, game_t& game);
 
+        virtual bool draw(common::result& r, game_t& game, float alpha);
+
     protected:
         state_machine* machine();
 
@@ -57,6 +67,8 @@ namespace mayhem {
 
         bool update(common::result& r, game_t& game);
 
+        bool draw(common::result& r, game_t& game, float alpha);
+
         template <typename T, typename... Args>
         bool register_state(uint32_t type, Args&&... args) {
             static_assert(
@@ -0,0 +1,136 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <common/hash.h>
+#include "text_cache.h"
+
+namespace mayhem {
+
+    static uint64_t make_cache_key(asset_handle_t font, color_t color, std::string_view text) {
+        const auto seed = ((uint64_t) font.id.bank << 56)
+            | ((uint64_t) font.id.index << 40)
+            | ((uint64_t) (font.generation & 0xff) << 32)
+            | ((uint64_t) color.r << 24)
+            | ((uint64_t) color.g << 16)
+            | ((uint64_t) color.b << 8)
+            | (uint64_t) color.a;
+        return common::hash64(text.data(), text.size(), seed);
+    }
+
+    static bool entry_matches(
+            const text_cache_entry_t& entry,
+            asset_handle_t font,
+            color_t color,
+            std::string_view text) {
+        return entry.font.id.bank == font.id.bank
+            && entry.font.id.index == font.id.index
+            && entry.font.generation == font.generation
+            && entry.color.r == color.r
+            && entry.color.g == color.g
+            && entry.color.b == color.b
+            && entry.color.a == color.a
+            && entry.text == text;
+    }
+
+    static std::size_t bitmap_bytes(const image_bitmap_t& bitmap) {
+        return bitmap.pixels.size() * sizeof(uint32_t);
+    }
+
+    // an entry that lost its key to a collision is no longer in lookup, so
+    // only the entry lookup points at takes the key with it
+    static void text_cache_erase(
+            text_cache_t& cache,
+            std::list<text_cache_entry_t>::iterator it) {
+        cache.used -= bitmap_bytes(it->bitmap);
+        auto lookup_it = cache.lookup.find(it->key);
+        if (lookup_it != std::end(cache.lookup) && lookup_it->second == it)
+            cache.lookup.erase(lookup_it);
+        cache.entries.erase(it);
+    }
+
+    static void text_cache_evict(text_cache_t& cache) {
+        while (cache.used > cache.budget && !cache.entries.empty()) {
+            auto it = std::prev(std::end(cache.entries));
+
+            // everything nearer the front was used more recently
+            if (it->frame == cache.frame)
+                break;
+
+            text_cache_erase(cache, it);
+            ++cache.stats.evictions;
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    void text_cache_init(text_cache_t& cache, std::size_t budget) {
+        text_cache_clear(cache);
+        cache.budget = budget;
+    }
+
+    void text_cache_clear(text_cache_t& cache) {
+        cache.used = 0;
+        cache.lookup.clear();
+        cache.entries.clear();
+    }
+
+    void text_cache_begin_frame(text_cache_t& cache) {
+        ++cache.frame;
+        text_cache_evict(cache);
+    }
+
+    const image_bitmap_t* text_cache_get(
+            text_cache_t& cache,
+            const bitmap_font_t& font,
+            asset_handle_t handle,
+            color_t color,
+            std::string_view text) {
+        if (text.empty())
+            return nullptr;
+
+        const auto key = make_cache_key(handle, color, text);
+        auto cached = true;
+        auto it = cache.lookup.find(key);
+        if (it != std::end(cache.lookup)) {
+            if (entry_matches(*it->second, handle, color, text)) {
+                ++cache.stats.hits;
+                cache.entries.splice(std::begin(cache.entries), cache.entries, it->second);
+                it->second->frame = cache.frame;
+                return &it->second->bitmap;
+            }
+
+            // a hash collision: the newer string takes the slot, unless the
+            // older one was already handed out this frame and may be binned
+            // for compose.  then the newer string is rendered into an entry
+            // outside lookup, which is evicted like any other.
+            if (it->second->frame == cache.frame)
+                cached = false;
+            else
+                text_cache_erase(cache, it->second);
+        }
+
+        ++cache.stats.misses;
+        cache.entries.emplace_front();
+        auto& entry = cache.entries.front();
+        entry.key = key;
+        entry.frame = cache.frame;
+        entry.font = handle;
+        entry.color = color;
+        entry.text = std::string(text);
+        bitmap_font_render(font, color, text, entry.bitmap);
+        cache.used += bitmap_bytes(entry.bitmap);
+        if (cached)
+            cache.lookup[key] = std::begin(cache.entries);
+
+        text_cache_evict(cache);
+
+        return &entry.bitmap;
+    }
+
+}
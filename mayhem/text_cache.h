@@ -0,0 +1,67 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <list>
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include "types.h"
+#include "asset_table.h"
+#include "bitmap_font.h"
+#include "image_cache.h"
+
+namespace mayhem {
+
+    struct text_cache_entry_t {
+        uint64_t key = 0;
+        uint32_t frame = 0;
+        asset_handle_t font{};
+        color_t color{};
+        std::string text{};
+        image_bitmap_t bitmap{};
+    };
+
+    struct text_cache_stats_t {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t evictions = 0;
+    };
+
+    // whole strings rasterized once into premultiplied bitmaps, so drawing
+    // one again is a single blit.  runs are keyed by (font handle, color,
+    // hash of the text), most recently used first; a font stored again under
+    // the same id has a new generation, so its old runs never match.  like
+    // image_cache_t, entries used during the current frame are never evicted.
+    struct text_cache_t {
+        uint32_t frame = 0;
+        std::size_t used = 0;
+        std::size_t budget = 0;
+        text_cache_stats_t stats{};
+        std::list<text_cache_entry_t> entries{};
+        std::unordered_map<uint64_t, std::list<text_cache_entry_t>::iterator> lookup{};
+    };
+
+    void text_cache_init(text_cache_t& cache, std::size_t budget);
+
+    void text_cache_clear(text_cache_t& cache);
+
+    void text_cache_begin_frame(text_cache_t& cache);
+
+    // nullptr for empty text
+    const image_bitmap_t* text_cache_get(
+        text_cache_t& cache,
+        const bitmap_font_t& font,
+        asset_handle_t handle,
+        color_t color,
+        std::string_view text);
+
+}
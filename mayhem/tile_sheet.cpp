@@ -0,0 +1,211 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <unordered_map>
+#include <fmt/format.h>
+#include <common/hash.h>
+#include "tile_sheet.h"
+
+namespace mayhem {
+
+    static constexpr uint8_t flip_variants[] = {
+        0,
+        tile_hflip,
+        tile_vflip,
+        tile_hflip | tile_vflip
+    };
+
+    // copies a w x h tile from src, with the given pitch, into dst mirrored
+    // by flips; flipping is its own inverse, so the same call undoes it.
+    static void copy_flipped(
+            const uint32_t* src,
+            int32_t src_pitch,
+            uint32_t* dst,
+            int32_t dst_pitch,
+            size_t tile_size,
+            uint8_t flips) {
+        for (int32_t y = 0; y < tile_size.h; y++) {
+            const auto sy = (flips & tile_vflip) != 0 ? tile_size.h - 1 - y : y;
+            const auto row = src + sy * src_pitch;
+            auto out = dst + y * dst_pitch;
+            if ((flips & tile_hflip) == 0) {
+                memcpy(out, row, tile_size.w * sizeof(uint32_t));
+                continue;
+            }
+            for (int32_t x = 0; x < tile_size.w; x++)
+                out[x] = row[tile_size.w - 1 - x];
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    bool tile_sheet_pack(
+            common::result& r,
+            const uint32_t* pixels,
+            size_t sheet_size,
+            size_t tile_size,
+            std::vector<uint8_t>& packed) {
+        if (tile_size.w <= 0
+        ||  tile_size.h <= 0
+        ||  tile_size.w > sheet_size.w
+        ||  tile_size.h > sheet_size.h
+        ||  tile_size.w > UINT16_MAX
+        ||  tile_size.h > UINT16_MAX) {
+            r.error("B003", fmt::format(
+                "invalid tile size {}x{} for sheet {}x{}",
+                tile_size.w,
+                tile_size.h,
+                sheet_size.w,
+                sheet_size.h));
+            return false;
+        }
+
+        const auto columns = sheet_size.w / tile_size.w;
+        const auto rows = sheet_size.h / tile_size.h;
+        if (columns > UINT16_MAX || rows > UINT16_MAX) {
+            r.error("B003", fmt::format("sheet has too many tiles: {}x{}", columns, rows));
+            return false;
+        }
+
+        const auto tile_pixels = (std::size_t) tile_size.w * tile_size.h;
+        std::vector<uint32_t> tiles{};
+        std::vector<tile_sheet_frame_t> frames{};
+        frames.reserve(columns * rows);
+
+        // keyed by content hash; collisions are settled by comparing pixels
+        std::unordered_multimap<uint64_t, uint32_t> lookup{};
+        std::vector<uint32_t> cell(tile_pixels);
+        std::vector<uint32_t> variant(tile_pixels);
+
+        for (int32_t row = 0; row < rows; row++) {
+            for (int32_t column = 0; column < columns; column++) {
+                const auto src = pixels
+                    + row * tile_size.h * sheet_size.w
+                    + column * tile_size.w;
+                copy_flipped(src, sheet_size.w, cell.data(), tile_size.w, tile_size, 0);
+
+                tile_sheet_frame_t frame{};
+                auto found = false;
+                for (auto flips : flip_variants) {
+                    copy_flipped(cell.data(), tile_size.w, variant.data(), tile_size.w, tile_size, flips);
+                    const auto hash = common::hash64(variant.data(), tile_pixels * sizeof(uint32_t));
+                    const auto range = lookup.equal_range(hash);
+                    for (auto it = range.first; it != range.second; ++it) {
+                        const auto existing = tiles.data() + it->second * tile_pixels;
+                        if (memcmp(existing, variant.data(), tile_pixels * sizeof(uint32_t)) != 0)
+                            continue;
+                        frame.tile = (uint16_t) it->second;
+                        frame.flips = flips;
+                        found = true;
+                        break;
+                    }
+                    if (found)
+                        break;
+                }
+
+                if (!found) {
+                    const auto tile = (uint32_t) (tiles.size() / tile_pixels);
+                    if (tile > UINT16_MAX) {
+                        r.error("B003", fmt::format("sheet has more than {} unique tiles", UINT16_MAX + 1));
+                        return false;
+                    }
+                    lookup.emplace(common::hash64(cell.data(), tile_pixels * sizeof(uint32_t)), tile);
+                    tiles.insert(tiles.end(), cell.begin(), cell.end());
+                    frame.tile = (uint16_t) tile;
+                }
+
+                frames.push_back(frame);
+            }
+        }
+
+        tile_sheet_header_t header{};
+        header.tile_w = (uint16_t) tile_size.w;
+        header.tile_h = (uint16_t) tile_size.h;
+        header.columns = (uint16_t) columns;
+        header.rows = (uint16_t) rows;
+        header.tile_count = (uint32_t) (tiles.size() / tile_pixels);
+
+        const auto frames_size = frames.size() * sizeof(tile_sheet_frame_t);
+        const auto tiles_size = tiles.size() * sizeof(uint32_t);
+        packed.resize(sizeof(header) + frames_size + tiles_size);
+        auto out = packed.data();
+        memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        memcpy(out, frames.data(), frames_size);
+        out += frames_size;
+        memcpy(out, tiles.data(), tiles_size);
+
+        return true;
+    }
+
+    bool tile_sheet_unpack(
+            common::result& r,
+            const uint8_t* data,
+            std::size_t data_size,
+            std::vector<uint32_t>& pixels,
+            size_t& sheet_size,
+            size_t& tile_size) {
+        tile_sheet_header_t header{};
+        if (data == nullptr || data_size < sizeof(header)) {
+            r.error("B004", "tile sheet is truncated");
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+
+        const auto frame_count = (std::size_t) header.columns * header.rows;
+        const auto tile_pixels = (std::size_t) header.tile_w * header.tile_h;
+        const auto expected = sizeof(header)
+            + frame_count * sizeof(tile_sheet_frame_t)
+            + (std::size_t) header.tile_count * tile_pixels * sizeof(uint32_t);
+        if (tile_pixels == 0 || data_size != expected) {
+            r.error("B004", fmt::format(
+                "tile sheet is {} bytes, expected {}",
+                data_size,
+                expected));
+            return false;
+        }
+
+        tile_size = size_t{header.tile_w, header.tile_h};
+        sheet_size = size_t{header.columns * tile_size.w, header.rows * tile_size.h};
+        pixels.resize((std::size_t) sheet_size.w * sheet_size.h);
+
+        std::vector<uint32_t> tiles(header.tile_count * tile_pixels);
+        const auto frames_offset = sizeof(header);
+        const auto tiles_offset = frames_offset + frame_count * sizeof(tile_sheet_frame_t);
+        if (!tiles.empty())
+            memcpy(tiles.data(), data + tiles_offset, tiles.size() * sizeof(uint32_t));
+
+        for (std::size_t i = 0; i < frame_count; i++) {
+            tile_sheet_frame_t frame{};
+            memcpy(&frame, data + frames_offset + i * sizeof(frame), sizeof(frame));
+            if (frame.tile >= header.tile_count) {
+                r.error("B004", fmt::format(
+                    "tile sheet frame {} uses tile {} of {}",
+                    i,
+                    frame.tile,
+                    header.tile_count));
+                return false;
+            }
+
+            const auto column = (int32_t) (i % header.columns);
+            const auto row = (int32_t) (i / header.columns);
+            copy_flipped(
+                tiles.data() + frame.tile * tile_pixels,
+                tile_size.w,
+                pixels.data() + row * tile_size.h * sheet_size.w + column * tile_size.w,
+                sheet_size.w,
+                tile_size,
+                frame.flips);
+        }
+
+        return true;
+    }
+
+}
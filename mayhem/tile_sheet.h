@@ -0,0 +1,67 @@
+// ----------------------------------------------------------------------------
+//
+// Mayhem
+//
+// Copyright (C) 2019 Jeff Panici
+// All rights reserved.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <common/result.h>
+#include "types.h"
+
+namespace mayhem {
+
+    // a sheet sliced into tiles with identical tiles stored once.  a frame
+    // that is a mirror image of a stored tile refers to it with the flips
+    // that turn the tile into the frame.
+    //
+    // the entry is a tile_sheet_header_t, then columns * rows frames in
+    // left-to-right, top-to-bottom order, then tile_count tiles of BGRA32
+    // pixels, each tile_w * tile_h.
+    enum tile_flip_t : uint8_t {
+        tile_hflip = 1,
+        tile_vflip = 2
+    };
+
+    struct tile_sheet_header_t {
+        uint16_t tile_w;
+        uint16_t tile_h;
+        uint16_t columns;
+        uint16_t rows;
+        uint32_t tile_count;
+    };
+
+    struct tile_sheet_frame_t {
+        uint16_t tile;
+        uint8_t flips;
+        uint8_t reserved;
+    };
+
+    static_assert(sizeof(tile_sheet_header_t) == 12);
+
+    static_assert(sizeof(tile_sheet_frame_t) == 4);
+
+    // pixels is a BGRA32 sheet of sheet_size; any partial cells at its right
+    // and bottom edges are dropped.
+    bool tile_sheet_pack(
+        common::result& r,
+        const uint32_t* pixels,
+        size_t sheet_size,
+        size_t tile_size,
+        std::vector<uint8_t>& packed);
+
+    // rebuilds the sheet as it was packed, less any dropped edges
+    bool tile_sheet_unpack(
+        common::result& r,
+        const uint8_t* data,
+        std::size_t data_size,
+        std::vector<uint32_t>& pixels,
+        size_t& sheet_size,
+        size_t& tile_size);
+
+}
@@ -15,7 +15,7 @@ namespace mayhem {
             common::result& r,
             game_t& game,
             uint32_t duration,
-            const timer_t::timer_callback_t& callback,
+            timer_t::timer_callback_t callback,
             id entity_id) {
         auto stand_alone = false;
         if (entity_id == entt::null) {
@@ -26,7 +26,7 @@ namespace mayhem {
         auto& timer = game.registry.assign<timer_t>(entity_id);
         timer.active = true;
         timer.duration = duration;
-        timer.callback = callback;
+        timer.callback = std::move(callback);
         timer.stand_alone = stand_alone;
         timer.expiry = game.ticks + duration;
 
@@ -42,7 +42,7 @@ namespace mayhem {
                 continue;
 
             if (game.ticks > timer.expiry) {
-                if (timer.callback == nullptr) {
+                if (!timer.callback) {
                     if (timer.stand_alone) {
                         game.registry.destroy(entity);
                     } else {
@@ -10,14 +10,15 @@
 #pragma once
 
 #include <cstdint>
-#include <functional>
 #include <common/result.h>
+#include <common/inline_function.h>
 #include "game.h"
 
 namespace mayhem {
 
     struct timer_t {
-        using timer_callback_t = std::function<bool (timer_t*, game_t&)>;
+        // captures up to 32 bytes, held inline in the component
+        using timer_callback_t = common::inline_function<bool (timer_t*, game_t&)>;
 
         bool active;
         uint32_t expiry;
@@ -30,7 +31,7 @@ namespace mayhem {
         common::result& r,
         game_t& game,
         uint32_t duration,
-        const timer_t::timer_callback_t& callback,
+        timer_t::timer_callback_t callback,
         id entity_id = entt::null);
 
     bool timer_update(common::result& r, game_t& game);
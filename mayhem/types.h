@@ -9,6 +9,35 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace mayhem {
 
-}
\ No newline at end of file
+    struct size_t {
+        int32_t w = 0;
+        int32_t h = 0;
+    };
+
+    struct point_t {
+        int32_t x = 0;
+        int32_t y = 0;
+    };
+
+    struct rect_t {
+        point_t pos{};
+        size_t size{};
+    };
+
+    struct color_t {
+        uint8_t r = 0;
+        uint8_t g = 0;
+        uint8_t b = 0;
+        uint8_t a = 0;
+    };
+
+    struct bank_id_t {
+        uint8_t bank = 0;
+        uint16_t index = 0;
+    };
+
+}
@@ -7,13 +7,25 @@
 //
 // ----------------------------------------------------------------------------
 
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <fmt/format.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <SDL_surface.h>
+#include <common/hash.h>
 #include <common/defer.h>
-#include <SDL_FontCache.h>
+#include "blit.h"
+#include "raster.h"
+#include "atlas.h"
+#include "asset_table.h"
+#include "image_cache.h"
+#include "text_cache.h"
 #include "game.h"
 #include "video.h"
+#include "asset_loader.h"
+#include "tile_sheet.h"
 #include "window.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -21,24 +33,106 @@
 
 namespace mayhem {
 
-    static std::unordered_map<std::string, image_t> s_images{};
-    static std::unordered_map<std::string, font_data_t> s_fonts{};
-
+    static constexpr uint32_t max_draw_commands = 4096;
+    static constexpr uint32_t max_draw_text = 64 * 1024;
+
+    static asset_table_t<image_t> s_images{};
+    static asset_table_t<font_data_t> s_fonts{};
+    static asset_table_t<tile_bitmap_t> s_tile_bitmaps{};
+    static atlas_t s_atlas{};
+
+    // where the tile bitmaps cut from images came from, so a reloaded image
+    // rebuilds only the bitmaps and sheets that use it.  the renderer redraws
+    // the bg cells that use changed_tiles on its next frame.
+    struct tile_source_t {
+        bank_id_t image_id{};
+        rect_t source{};
+        bool indexed = false;
+        uint8_t palette = 0;
+    };
+
+    struct sheet_source_t {
+        bank_id_t image_id{};
+        size_t frame_size{};
+        bank_id_t first_id{};
+        uint32_t count = 0;
+    };
+
+    // the same for bank entries, which are found again by name once their
+    // file is remapped; hash is of the entry's stored bytes, so only the
+    // entries that changed are decoded again.
+    struct bank_source_t {
+        std::string path{};
+        uint8_t bank = 0;
+        std::string name{};
+        uint64_t hash = 0;
+        bank_id_t id{};
+        uint32_t count = 0;
+    };
+
+    static std::unordered_map<uint32_t, tile_source_t> s_tile_sources{};
+    static std::vector<sheet_source_t> s_sheets{};
+    static std::vector<bank_source_t> s_bank_sheets{};
+    static std::vector<bank_source_t> s_bank_images{};
+    static std::vector<bank_id_t> s_changed_tiles{};
+
+    // what the client takes from the bank mayhem-bankc builds out of
+    // etc/assets.yaml.  anything the bank is missing, or the whole bank if it
+    // has not been built, is loaded from its png instead; a sheet loaded
+    // that way is kept as an image at fallback_sheet_bank.
+    struct sheet_asset_t {
+        const char* name;
+        const char* path;
+        size_t frame_size;
+        bank_id_t first_id;
+    };
+
+    struct logo_asset_t {
+        const char* name;
+        const char* path;
+        bank_id_t id;
+    };
+
+    static constexpr const char* asset_bank_path = "../assets/mayhem.bank";
+
+    static constexpr uint8_t sheet_bank = 0;
+
+    static constexpr uint8_t logo_bank = 2;
+
+    static constexpr uint8_t fallback_sheet_bank = 0xfe;
+
+    static const sheet_asset_t s_sheet_assets[] = {
+        {"adventurer", "../assets/sheets/Adventurer_Sprite_Sheet.png", {32, 32}, {1, 0}},
+        {"arena", "../assets/sheets/Arena-Tile-Set.png", {16, 16}, {2, 0}},
+        {"dungeon", "../assets/sheets/Dungeon_Tileset.png", {16, 16}, {3, 0}},
+    };
+
+    static const logo_asset_t s_logo_assets[] = {
+        {"fmod", "../assets/logos/fmod-logo-white1.png", {0xff, 1}},
+        {"nybbles", "../assets/logos/nybbles-logo.png", {0xff, 2}},
+    };
+
+    // for messages only; lookups index the asset tables directly
     static std::string make_bank_key(bank_id_t id) {
         return fmt::format("{}:{}", id.bank, id.index);
     }
 
-    static SDL_Color to_fc_color(const color_t& color) {
-        return FC_MakeColor(color.r, color.g, color.b, color.a);
+    static uint32_t make_tile_key(bank_id_t id) {
+        return ((uint32_t) id.bank << 16) | id.index;
     }
 
+    static bool image_rebuild_tiles(common::result& r, bank_id_t image_id);
+
     ///////////////////////////////////////////////////////////////////////////
 
     image_t* image_find(bank_id_t id) {
-        auto it = s_images.find(make_bank_key(id));
-        if (it == std::end(s_images))
-            return nullptr;
-        return &it->second;
+        return asset_find(s_images, id);
+    }
+
+    static uint32_t image_pixel_format(int32_t format) {
+        return format == STBI_rgb ?
+            SDL_PIXELFORMAT_RGB24 :
+            SDL_PIXELFORMAT_RGBA32;
     }
 
     bool image_load(
@@ -50,47 +144,462 @@ namespace mayhem {
         if (image != nullptr)
             return true;
 
-        auto result = s_images.insert(std::make_pair(make_bank_key(id), image_t {}));
-        if (!result.second)
+        image_t new_image{};
+        if (!image_decode(r, path, format, new_image))
             return false;
 
-        auto& new_image = result.first->second;
+        return image_store(r, id, new_image);
+    }
 
-        new_image.data = stbi_load(
+    // converted once here so blits never go through SDL's format
+    // conversion; the surface keeps straight alpha for tile bitmaps.
+    static bool image_build_bitmap(common::result& r, image_t& image) {
+        const auto format = image.format;
+        const auto bytes_per_pixel = format == STBI_rgb ? 3 : 4;
+        auto& bitmap = image.bitmap;
+        bitmap.size = image.size;
+        bitmap.pixels.resize(image.size.w * image.size.h);
+        if (SDL_ConvertPixels(
+                image.size.w,
+                image.size.h,
+                image_pixel_format(format),
+                image.data,
+                bytes_per_pixel * image.size.w,
+                SDL_PIXELFORMAT_BGRA32,
+                bitmap.pixels.data(),
+                image.size.w * 4) != 0) {
+            r.error("V003", fmt::format("unable to convert image: {}", SDL_GetError()));
+            image_free(image);
+            return false;
+        }
+        image_bitmap_premultiply(bitmap);
+
+        return true;
+    }
+
+    bool image_decode(
+            common::result& r,
+            const std::string& path,
+            int32_t format,
+            image_t& image) {
+        int32_t channels = 0;
+        image.data = stbi_load(
             path.c_str(),
-            &new_image.size.w,
-            &new_image.size.h,
-            &new_image.format,
+            &image.size.w,
+            &image.size.h,
+            &channels,
             format);
-        if (new_image.data == nullptr) {
-            r.error("V003", stbi_failure_reason());
+        if (image.data == nullptr) {
+            r.error("V003", fmt::format("unable to decode image {}: {}", path, stbi_failure_reason()));
             return false;
         }
+        image.format = format;
 
-        int depth, pitch;
-        uint32_t pixel_format;
-        if (format == STBI_rgb) {
-            depth = 24;
-            pitch = 3*new_image.size.w;
-            pixel_format = SDL_PIXELFORMAT_RGB24;
-        } else {
-            depth = 32;
-            pitch = 4*new_image.size.w;
-            pixel_format = SDL_PIXELFORMAT_RGBA32;
-        }
-
-        new_image.surface = SDL_CreateRGBSurfaceWithFormatFrom(
-            new_image.data,
-            new_image.size.w,
-            new_image.size.h,
-            depth,
-            pitch,
-            pixel_format);
-        if (new_image.surface == nullptr) {
+        return image_build_bitmap(r, image);
+    }
+
+    // image_free hands data to stbi_image_free, which is plain free, so the
+    // pixels are swizzled into a malloc'd copy of the entry
+    bool image_decode(common::result& r, const bank_entry& entry, image_t& image) {
+        if (entry.type() != static_cast<uint8_t>(bank_entry_type_t::image)) {
+            r.error("B004", fmt::format("bank entry {} is not an image", entry.name()));
+            return false;
+        }
+
+        if (entry.compressed() && !entry.decompress(r))
+            return false;
+
+        bank_image_t header{};
+        if (entry.size() >= sizeof(header))
+            memcpy(&header, entry.data(), sizeof(header));
+        const auto pixel_bytes = (std::size_t) header.w * header.h * 4;
+        if (entry.size() < sizeof(header) || entry.size() != sizeof(header) + pixel_bytes) {
+            r.error("B004", fmt::format("bank entry {} is not a valid image", entry.name()));
+            return false;
+        }
+
+        image.size = size_t{header.w, header.h};
+        image.format = STBI_rgb_alpha;
+        image.data = static_cast<uint8_t*>(std::malloc(pixel_bytes));
+        if (image.data == nullptr
+        ||  SDL_ConvertPixels(
+                header.w,
+                header.h,
+                SDL_PIXELFORMAT_BGRA32,
+                entry.data() + sizeof(header),
+                header.w * 4,
+                SDL_PIXELFORMAT_RGBA32,
+                image.data,
+                header.w * 4) != 0) {
+            r.error("V003", fmt::format("unable to convert image: {}", SDL_GetError()));
+            image_free(image);
+            return false;
+        }
+
+        return image_build_bitmap(r, image);
+    }
+
+    bool image_store(common::result& r, bank_id_t id, image_t& image) {
+        const auto bytes_per_pixel = image.format == STBI_rgb ? 3 : 4;
+        image.surface = SDL_CreateRGBSurfaceWithFormatFrom(
+            image.data,
+            image.size.w,
+            image.size.h,
+            bytes_per_pixel * 8,
+            bytes_per_pixel * image.size.w,
+            image_pixel_format(image.format));
+        if (image.surface == nullptr) {
             r.error("V003", "unable to create surface from bitmap.");
+            image_free(image);
+            return false;
+        }
+
+        auto existing = image_find(id);
+        if (existing != nullptr)
+            image_free(*existing);
+
+        asset_store(s_images, id) = std::move(image);
+        image = image_t{};
+
+        return existing == nullptr || image_rebuild_tiles(r, id);
+    }
+
+    void image_free(image_t& image) {
+        SDL_FreeSurface(image.surface);
+        stbi_image_free(image.data);
+        image.surface = nullptr;
+        image.data = nullptr;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+
+    tile_bitmap_t* tile_bitmap_find(bank_id_t id) {
+        return asset_find(s_tile_bitmaps, id);
+    }
+
+    bool tile_bitmap_load(
+            common::result& r,
+            bank_id_t image_id,
+            const rect_t& source,
+            bank_id_t id) {
+        auto image = image_find(image_id);
+        if (image == nullptr) {
+            r.error("V001", fmt::format("unknown image: {}", make_bank_key(image_id)));
+            return false;
+        }
+
+        if (source.pos.x < 0
+        ||  source.pos.y < 0
+        ||  source.size.w <= 0
+        ||  source.size.h <= 0
+        ||  source.pos.x + source.size.w > image->size.w
+        ||  source.pos.y + source.size.h > image->size.h) {
+            r.error("V005", fmt::format("tile bitmap source outside image: {}", make_bank_key(image_id)));
+            return false;
+        }
+
+        auto& bitmap = asset_store(s_tile_bitmaps, id);
+        bitmap.size = source.size;
+        bitmap.pixels.resize(source.size.w * source.size.h);
+
+        auto surface = image->surface;
+        auto bytes_per_pixel = surface->format->BytesPerPixel;
+        auto src = static_cast<const uint8_t*>(surface->pixels)
+            + source.pos.y * surface->pitch
+            + source.pos.x * bytes_per_pixel;
+        auto result = SDL_ConvertPixels(
+            source.size.w,
+            source.size.h,
+            surface->format->format,
+            src,
+            surface->pitch,
+            SDL_PIXELFORMAT_BGRA32,
+            bitmap.pixels.data(),
+            source.size.w * 4);
+        if (result != 0) {
+            r.error("V005", fmt::format("unable to convert tile bitmap: {}", SDL_GetError()));
+            return false;
+        }
+
+        s_tile_sources[make_tile_key(id)] = tile_source_t{image_id, source};
+        return true;
+    }
+
+    bool tile_bitmap_load_indexed(
+            common::result& r,
+            bank_id_t image_id,
+            const rect_t& source,
+            uint8_t palette_index,
+            bank_id_t id) {
+        if (!tile_bitmap_load(r, image_id, source, id))
+            return false;
+
+        const auto pal = palette(palette_index);
+        auto bitmap = tile_bitmap_find(id);
+
+        std::unordered_map<uint32_t, uint8_t> lookup{};
+        for (int32_t i = max_palette_entries - 1; i >= 0; i--)
+            lookup[pal->entries[i].value] = (uint8_t) i;
+
+        bitmap->colors = 0;
+        bitmap->indices.resize(bitmap->pixels.size());
+        for (std::size_t i = 0; i < bitmap->pixels.size(); i++) {
+            auto it = lookup.find(bitmap->pixels[i]);
+            if (it == std::end(lookup)) {
+                r.error("V005", fmt::format(
+                    "tile bitmap color {:08x} not in palette {}",
+                    bitmap->pixels[i],
+                    palette_index));
+                asset_release(s_tile_bitmaps, id);
+                return false;
+            }
+            bitmap->indices[i] = it->second;
+            bitmap->colors = std::max<uint16_t>(bitmap->colors, it->second + 1);
+        }
+
+        bitmap->pixels.clear();
+        bitmap->pixels.shrink_to_fit();
+
+        auto& tile_source = s_tile_sources[make_tile_key(id)];
+        tile_source.indexed = true;
+        tile_source.palette = palette_index;
+
+        return true;
+    }
+
+    bool tile_bitmap_create_indexed(
+            common::result& r,
+            const uint8_t* indices,
+            size_t size,
+            bank_id_t id) {
+        if (size.w <= 0 || size.h <= 0) {
+            r.error("V005", fmt::format("invalid tile bitmap size: {}x{}", size.w, size.h));
+            return false;
+        }
+
+        s_tile_sources.erase(make_tile_key(id));
+
+        auto& bitmap = asset_store(s_tile_bitmaps, id);
+        bitmap.size = size;
+        bitmap.pixels.clear();
+        bitmap.indices.assign(indices, indices + size.w * size.h);
+        bitmap.colors = 0;
+        for (auto index : bitmap.indices)
+            bitmap.colors = std::max<uint16_t>(bitmap.colors, index + 1);
+
+        return true;
+    }
+
+    static bool tile_bitmap_cut_sheet(
+            common::result& r,
+            bank_id_t image_id,
+            size_t frame_size,
+            bank_id_t first_id,
+            uint32_t& count) {
+        auto image = image_find(image_id);
+        if (image == nullptr) {
+            r.error("V001", fmt::format("unknown image: {}", make_bank_key(image_id)));
+            return false;
+        }
+
+        // the atlas keeps straight alpha, like every other tile bitmap
+        auto surface = image->surface;
+        std::vector<uint32_t> pixels(image->size.w * image->size.h);
+        auto result = SDL_ConvertPixels(
+            image->size.w,
+            image->size.h,
+            surface->format->format,
+            surface->pixels,
+            surface->pitch,
+            SDL_PIXELFORMAT_BGRA32,
+            pixels.data(),
+            image->size.w * 4);
+        if (result != 0) {
+            r.error("V005", fmt::format("unable to convert sheet: {}", SDL_GetError()));
+            return false;
+        }
+
+        if (!atlas_add_sheet(r, s_atlas, pixels.data(), image->size, frame_size, first_id, count))
+            return false;
+
+        log_message(
+            log_category_t::video,
+            "sheet {}: {} frames of {}x{}",
+            make_bank_key(image_id),
+            count,
+            frame_size.w,
+            frame_size.h);
+
+        return true;
+    }
+
+    bool tile_bitmap_add_sheet(
+            common::result& r,
+            bank_id_t image_id,
+            size_t frame_size,
+            bank_id_t first_id) {
+        uint32_t count = 0;
+        if (!tile_bitmap_cut_sheet(r, image_id, frame_size, first_id, count))
+            return false;
+
+        s_sheets.push_back(sheet_source_t{image_id, frame_size, first_id, count});
+        return true;
+    }
+
+    static uint64_t bank_entry_hash(const bank_entry& entry) {
+        return common::hash64(entry.stored(), entry.stored_size());
+    }
+
+    static bank_source_t make_bank_source(
+            const bank_file& file,
+            uint8_t bank,
+            const bank_entry& entry,
+            bank_id_t id,
+            uint32_t count) {
+        return bank_source_t{
+            std::string(file.path()),
+            bank,
+            std::string(entry.name()),
+            bank_entry_hash(entry),
+            id,
+            count};
+    }
+
+    // checks everything before staging a frame, so on failure the atlas is
+    // as it was
+    static bool tile_bitmap_cut_bank_sheet(
+            common::result& r,
+            const bank_entry& entry,
+            bank_id_t first_id,
+            uint32_t& count) {
+        count = 0;
+        if (entry.type() != static_cast<uint8_t>(bank_entry_type_t::tile_sheet)) {
+            r.error("B004", fmt::format("bank entry {} is not a tile sheet", entry.name()));
             return false;
         }
 
+        if (entry.compressed() && !entry.decompress(r))
+            return false;
+
+        std::vector<uint32_t> pixels{};
+        size_t sheet_size{};
+        size_t tile_size{};
+        if (!tile_sheet_unpack(r, entry.data(), entry.size(), pixels, sheet_size, tile_size))
+            return false;
+
+        if (!atlas_add_sheet(r, s_atlas, pixels.data(), sheet_size, tile_size, first_id, count))
+            return false;
+
+        log_message(
+            log_category_t::video,
+            "tile sheet {}: {} frames of {}x{}",
+            entry.name(),
+            count,
+            tile_size.w,
+            tile_size.h);
+
+        return true;
+    }
+
+    bool tile_bitmap_add_bank_sheet(
+            common::result& r,
+            const bank_file& file,
+            uint8_t bank,
+            const bank_entry& entry,
+            bank_id_t first_id) {
+        uint32_t count = 0;
+        if (!tile_bitmap_cut_bank_sheet(r, entry, first_id, count))
+            return false;
+
+        s_bank_sheets.push_back(make_bank_source(file, bank, entry, first_id, count));
+        return true;
+    }
+
+    // frames staged since the last build are the last ones in the atlas.  a
+    // fully transparent frame is stored too, as a bitmap with no pixels, so
+    // it replaces whatever the id drew before a reload.
+    bool tile_bitmap_build_atlas(common::result& r) {
+        const auto first_frame = s_atlas.frames.size() - s_atlas.staged_offsets.size();
+        if (!atlas_build(r, s_atlas))
+            return false;
+
+        for (auto i = first_frame; i < s_atlas.frames.size(); i++) {
+            const auto& frame = s_atlas.frames[i];
+            auto& bitmap = asset_store(s_tile_bitmaps, frame.id);
+            bitmap.cell = frame.size;
+            if (frame.rect.size.w == 0 || frame.rect.size.h == 0)
+                continue;
+
+            const auto& page = s_atlas.pages[frame.page];
+            bitmap.size = frame.rect.size;
+            bitmap.page = page.pixels.data()
+                + frame.rect.pos.y * page.size.w
+                + frame.rect.pos.x;
+            bitmap.pitch = page.size.w;
+            bitmap.trim = frame.trim;
+        }
+
+        return true;
+    }
+
+    // ids first_id + first up to first_id + end
+    static void tile_bitmap_release(bank_id_t first_id, uint32_t first, uint32_t end) {
+        for (auto i = first; i < end; i++)
+            asset_release(s_tile_bitmaps, bank_id_t{first_id.bank, (uint16_t) (first_id.index + i)});
+    }
+
+    // the sheets cut from the image are added again under the same ids and
+    // packed into new pages; once their bitmaps are stored, the pages only
+    // the old frames were in are released.
+    static bool image_rebuild_tiles(common::result& r, bank_id_t image_id) {
+        const auto first_changed = s_changed_tiles.size();
+        std::vector<std::pair<uint32_t, tile_source_t>> tiles{};
+        for (const auto& kvp : s_tile_sources) {
+            const auto& source = kvp.second;
+            if (source.image_id.bank == image_id.bank && source.image_id.index == image_id.index)
+                tiles.push_back(kvp);
+        }
+
+        for (const auto& [key, source] : tiles) {
+            const auto id = bank_id_t{(uint8_t) (key >> 16), (uint16_t) (key & 0xffff)};
+            const auto rebuilt = source.indexed ?
+                tile_bitmap_load_indexed(r, image_id, source.source, source.palette, id) :
+                tile_bitmap_load(r, image_id, source.source, id);
+            if (!rebuilt)
+                return false;
+            s_changed_tiles.push_back(id);
+        }
+
+        auto repack = false;
+        for (auto& sheet : s_sheets) {
+            if (sheet.image_id.bank != image_id.bank || sheet.image_id.index != image_id.index)
+                continue;
+
+            atlas_remove_frames(s_atlas, sheet.first_id, sheet.count);
+            uint32_t count = 0;
+            if (!tile_bitmap_cut_sheet(r, image_id, sheet.frame_size, sheet.first_id, count))
+                return false;
+
+            // frames past the end of a sheet that shrank are gone for good
+            tile_bitmap_release(sheet.first_id, count, sheet.count);
+            for (uint32_t i = 0; i < std::max(count, sheet.count); i++)
+                s_changed_tiles.push_back(bank_id_t{sheet.first_id.bank, (uint16_t) (sheet.first_id.index + i)});
+            sheet.count = count;
+            repack = true;
+        }
+
+        if (repack) {
+            if (!tile_bitmap_build_atlas(r))
+                return false;
+            atlas_release_pages(s_atlas);
+        }
+
+        log_message(
+            log_category_t::video,
+            "image {} reloaded: {} tile bitmaps rebuilt",
+            make_bank_key(image_id),
+            s_changed_tiles.size() - first_changed);
+
         return true;
     }
 
@@ -99,256 +608,754 @@ namespace mayhem {
     bool font_load(
             common::result& r,
             const std::string& path,
-            SDL_Renderer* renderer,
             uint32_t size,
-            int32_t style,
+            uint8_t style,
             color_t color,
             bank_id_t id) {
         auto font = font_find(id);
         if (font != nullptr)
             return true;
 
-        auto result = s_fonts.insert(std::make_pair(make_bank_key(id), font_data_t {}));
-        if (!result.second)
-            return false;
-
-        auto& data = result.first->second;
+        font_data_t data{};
         data.size = size;
         data.style = style;
         data.color = color;
-        data.handle = FC_CreateFont();
+        if (!bitmap_font_load(r, path, size, style, data.font))
+            return false;
 
-        return FC_LoadFont(
-            data.handle,
-            renderer,
-            path.c_str(),
-            size,
-            to_fc_color(data.color),
-            style) != 0;
+        font_store(id, data);
+        return true;
+    }
+
+    void font_store(bank_id_t id, font_data_t& data) {
+        asset_store(s_fonts, id) = std::move(data);
     }
 
     font_data_t* font_find(bank_id_t id) {
-        auto it = s_fonts.find(make_bank_key(id));
-        if (it == std::end(s_fonts))
-            return nullptr;
-        return &it->second;
+        return asset_find(s_fonts, id);
     }
 
     ///////////////////////////////////////////////////////////////////////////
 
-    static bool video_draw_tile(game_t& game, uint32_t ty, uint32_t tx, layer_t& layer) {
-//        const palette_t* pal = palette(tile.palette);
-//        if (pal == NULL)
-//            return false;
-//
-//        const tile_bitmap_t* bitmap = tile_bitmap(tile.id);
-//        if (bitmap == NULL)
-//            return false;
+    static blit_target_t video_blit_target(SDL_Surface* surface, const rect_t& clip) {
+        return blit_target_t {
+            static_cast<uint32_t*>(surface->pixels),
+            surface->pitch / 4,
+            clip.pos.x,
+            clip.pos.y,
+            clip.pos.x + clip.size.w,
+            clip.pos.y + clip.size.h
+        };
+    }
+
+    static blit_source_t video_blit_source(
+            const video_t& video,
+            const tile_bitmap_t* bitmap,
+            const tile_t& tile) {
+        auto source = blit_source_t{};
+        source.pitch = bitmap->size.w;
+        source.w = bitmap->size.w;
+        source.h = bitmap->size.h;
+        if (bitmap->page != nullptr) {
+            source.pixels = bitmap->page;
+            source.pitch = bitmap->pitch;
+        } else if (bitmap->indices.empty()) {
+            source.pixels = bitmap->pixels.data();
+        } else {
+            source.indices = bitmap->indices.data();
+            source.palette = &video.frame->palettes[tile.palette];
+            source.nibble = bitmap->colors <= 16;
+        }
+        return source;
+    }
+
+    // atlas frames are trimmed, so their pixels start somewhere inside the
+    // cell; flipping mirrors that offset.
+    static point_t video_bitmap_origin(const tile_bitmap_t* bitmap, int32_t x, int32_t y, uint8_t flags) {
+        if (bitmap->page == nullptr)
+            return point_t{x, y};
+
+        auto dx = bitmap->trim.x;
+        auto dy = bitmap->trim.y;
+        if ((flags & (uint8_t) blit_flags_t::hflip) != 0)
+            dx = bitmap->cell.w - bitmap->trim.x - bitmap->size.w;
+        if ((flags & (uint8_t) blit_flags_t::vflip) != 0)
+            dy = bitmap->cell.h - bitmap->trim.y - bitmap->size.h;
+        return point_t{x + dx, y + dy};
+    }
+
+    static bool video_draw_tile(game_t& game, uint32_t ty, uint32_t tx, const layer_t& layer, bool opaque) {
+        const auto bitmap = tile_bitmap_find(layer.tile.id);
+        if (bitmap == nullptr)
+            return false;
 
         auto& video = game.video;
-        const auto tile_width = video.tile_size.w;
-        const auto tile_height = video.tile_size.h;
-
-        const bool vertical_flip = (layer.flags & (uint8_t)tile_flags_t::vflip) == (uint8_t)tile_flags_t::vflip;
-        const bool horizontal_flip = (layer.flags & (uint8_t)tile_flags_t::hflip) == (uint8_t)tile_flags_t::hflip;
-
-        auto sy = (uint8_t) (vertical_flip ? tile_height - 1 : 0);
-        auto syd = (int8_t) (vertical_flip ? -1 : 1);
-        auto sxd = (int8_t) (horizontal_flip ? -1 : 1);
-
-        for (uint32_t y = 0; y < tile_height; y++) {
-            auto p = static_cast<uint8_t*>(video.bg->pixels) + ((ty + y) * video.bg->pitch + (tx * 4));
-            auto sx = (uint8_t) (horizontal_flip ? tile_width - 1 : 0);
-            for (uint32_t x = 0; x < tile_width; x++) {
-                const auto pixel_offset = (const uint32_t) (sy * tile_width + sx);
-//              const palette_entry_t* pal_entry = &pal->entries[bitmap->data[pixel_offset]];
-//              *p++ = pal_entry->blue;
-//              *p++ = pal_entry->green;
-//              *p++ = pal_entry->red;
-//              *p++ = pal_entry->alpha;
-                sx += sxd;
-            }
-            sy += syd;
+
+        // a tile never spills into its neighbours, so the clip is its own cell
+        const auto cell = rect_t{
+            {(int32_t) tx, (int32_t) ty},
+            {video.tile_size.w, video.tile_size.h}};
+        const auto source = video_blit_source(video, bitmap, layer.tile);
+
+        auto flags = (uint8_t) (layer.flags & ((uint8_t)tile_flags_t::hflip | (uint8_t)tile_flags_t::vflip));
+        if (!opaque)
+            flags |= (uint8_t) blit_flags_t::keyed;
+
+        const auto target = video_blit_target(video.bg, cell);
+        if (bitmap->size.w == 0 || bitmap->size.h == 0) {
+            if (opaque)
+                raster_clear(target, 0);
+            return true;
+        }
+
+        if (opaque
+        &&  bitmap->page != nullptr
+        &&  (bitmap->size.w < video.tile_size.w || bitmap->size.h < video.tile_size.h)) {
+            raster_clear(target, 0);
         }
 
+        const auto origin = video_bitmap_origin(bitmap, tx, ty, flags);
+        blit_draw(target, source, origin.x, origin.y, flags);
+
         return true;
     }
 
+    static void video_damage_rect(video_t& video, int32_t x, int32_t y, int32_t w, int32_t h) {
+        if (w <= 0 || h <= 0)
+            return;
+
+        const auto left = std::max(x, 0);
+        const auto top = std::max(y, 0);
+        const auto right = std::min(x + w, (int32_t) screen_width);
+        const auto bottom = std::min(y + h, (int32_t) screen_height);
+        if (left >= right || top >= bottom)
+            return;
+
+        const auto cell_width = video.tile_size.w;
+        const auto cell_height = video.tile_size.h;
+        const auto cx = left / cell_width;
+        const auto cy = top / cell_height;
+        video.fg_damage.mark_rect(
+            cx,
+            cy,
+            (right - 1) / cell_width - cx + 1,
+            (bottom - 1) / cell_height - cy + 1);
+    }
+
+    static void video_clear_tile_cell(game_t& game, uint32_t ty, uint32_t tx) {
+        auto& video = game.video;
+        const auto row_bytes = video.tile_size.w * 4;
+        auto p = static_cast<uint8_t*>(video.bg->pixels) + (ty * video.bg->pitch + (tx * 4));
+        for (uint32_t y = 0; y < video.tile_size.h; y++) {
+            memset(p, 0, row_bytes);
+            p += video.bg->pitch;
+        }
+    }
+
+    // tiles are expanded into video.bg when drawn, so a palette change is
+    // applied by redrawing the tiles that reference it.
+    static void video_mark_palette_changes(game_t& game) {
+        auto& video = game.video;
+        const auto& frame = *video.frame;
+
+        uint64_t changed[max_palettes / 64]{};
+        auto any_changed = false;
+        for (uint32_t i = 0; i < max_palettes; i++) {
+            if (frame.palette_versions[i] == video.rendered_palette_versions[i])
+                continue;
+            video.rendered_palette_versions[i] = frame.palette_versions[i];
+            changed[i >> 6] |= (uint64_t) 1 << (i & 63);
+            any_changed = true;
+        }
+        if (!any_changed)
+            return;
+
+        for (uint32_t row = 0; row < video.bg_size.h; row++) {
+            for (uint32_t col = 0; col < video.bg_size.w; col++) {
+                const auto& block = frame.blocks[row * video.bg_size.w + col];
+                for (const auto& layer : block.layers) {
+                    if ((layer.flags & (uint8_t)tile_flags_t::enabled) == 0)
+                        continue;
+                    const auto index = layer.tile.palette;
+                    if ((changed[index >> 6] & ((uint64_t) 1 << (index & 63))) != 0) {
+                        video.bg_dirty.mark(col, row);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // tiles are expanded into video.bg too, so a tile bitmap rebuilt by a
+    // reload is applied by redrawing only the cells that use it.
+    static void video_mark_tile_changes(game_t& game) {
+        if (s_changed_tiles.empty())
+            return;
+
+        std::unordered_set<uint32_t> changed{};
+        for (const auto& id : s_changed_tiles)
+            changed.insert(make_tile_key(id));
+        s_changed_tiles.clear();
+
+        auto& video = game.video;
+        const auto& frame = *video.frame;
+        for (uint32_t row = 0; row < video.bg_size.h; row++) {
+            for (uint32_t col = 0; col < video.bg_size.w; col++) {
+                const auto& block = frame.blocks[row * video.bg_size.w + col];
+                for (const auto& layer : block.layers) {
+                    if ((layer.flags & (uint8_t)tile_flags_t::enabled) == 0)
+                        continue;
+                    if (changed.count(make_tile_key(layer.tile.id)) != 0) {
+                        video.bg_dirty.mark(col, row);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // switches to the newest published frame, if any, and marks the bg cells
+    // whose blocks differ from what was last drawn into bg, which can only be
+    // among the frame's changed_blocks.
+    static void video_acquire_frame(game_t& game) {
+        auto& video = game.video;
+        if (!video.buffers.acquire())
+            return;
+        video.frame = &video.frames[video.buffers.front()];
+
+        const auto& frame = *video.frame;
+        if (frame.bg_generation != video.rendered_generation) {
+            video.rendered_generation = frame.bg_generation;
+            video.bg_invalid = true;
+            video.bg_dirty.mark_all();
+        }
+
+        for (auto index : frame.changed_blocks) {
+            if (frame.versions[index] == video.rendered_versions[index])
+                continue;
+            video.rendered_versions[index] = frame.versions[index];
+            video.bg_dirty.mark(index % video.bg_size.w, index / video.bg_size.w);
+        }
+    }
+
     static void video_update_bg(game_t& game) {
-        const auto tile_map_size = game.video.bg_size.w * game.video.bg_size.h;
-        const auto tile_map_max_width = game.video.bg_size.w * game.video.tile_size.w;
+        auto& video = game.video;
+        video.stats.tiles_redrawn = 0;
+
+        video_mark_palette_changes(game);
+        video_mark_tile_changes(game);
 
-        SDL_LockSurface(game.video.bg);
+        if (video.bg_dirty.empty())
+            return;
 
-        uint32_t tx = 0;
-        uint32_t ty = 0;
-        for (uint32_t i = 0; i < tile_map_size; i++) {
-            auto& block = game.video.blocks[i];
+        SDL_LockSurface(video.bg);
 
-            for (auto& layer : block.layers) {
-                if ((layer.flags & (uint8_t)tile_flags_t::changed) == 0)
-                    goto next_tile;
+        const auto& frame = *video.frame;
+        video.bg_dirty.for_each([&](uint32_t col, uint32_t row) {
+            const auto& block = frame.blocks[row * video.bg_size.w + col];
+            const auto tx = col * video.tile_size.w;
+            const auto ty = row * video.tile_size.h;
 
+            // layers composite bottom to top, so a change to any one of them
+            // means the whole cell is rebuilt.
+            video_clear_tile_cell(game, ty, tx);
+            auto opaque = true;
+            for (const auto& layer : block.layers) {
                 if ((layer.flags & (uint8_t)tile_flags_t::enabled) == 0)
-                    goto next_tile;
+                    continue;
 
-                if (video_draw_tile(game, ty, tx, layer))
-                    layer.flags &= ~(uint8_t)tile_flags_t::changed;
+                if (video_draw_tile(game, ty, tx, layer, opaque))
+                    opaque = false;
             }
 
-            next_tile:
-            tx += game.video.tile_size.w;
-            if (tx == tile_map_max_width) {
-                tx = 0;
-                ty += game.video.tile_size.h;
-            }
-        }
+            ++video.stats.tiles_redrawn;
+            video_damage_rect(
+                video,
+                (int32_t) tx - (int32_t) frame.x_scroll,
+                (int32_t) ty - (int32_t) frame.y_scroll,
+                video.tile_size.w,
+                video.tile_size.h);
+        });
+
+        SDL_UnlockSurface(video.bg);
 
-        SDL_UnlockSurface(game.video.bg);
+        video.bg_dirty.clear();
     }
 
-    ///////////////////////////////////////////////////////////////////////////
+    static void video_begin_restore(game_t& game) {
+        auto& video = game.video;
 
-    static bool video_draw_sprite(game_t& game, sprite_t& sprite) {
-//        const palette_t* pal = palette(tile.palette);
-//        if (pal == NULL)
-//            return false;
-//
-//        const sprite_bitmap_t* bitmap = sprite_bitmap(tile.id);
-//        if (bitmap == NULL)
-//            return false;
+        const auto scrolled = video.frame->x_scroll != video.last_x_scroll
+            || video.frame->y_scroll != video.last_y_scroll;
+        video.stats.full_copy = video.bg_invalid || scrolled;
+
+        // everything damaged so far is restored this frame; overlays drawn
+        // from here on are collected for the next one.
+        std::swap(video.fg_damage, video.fg_restore);
+        video.fg_damage.clear();
+        video.stats.cells_restored = video.stats.full_copy ? 0 : video.fg_restore.count();
+    }
+
+    static void video_copy_bg_row(video_t& video, int32_t y, int32_t left, int32_t right) {
+        const auto src_x = left + (int32_t) video.frame->x_scroll;
+        const auto src_y = y + (int32_t) video.frame->y_scroll;
+        if (src_y >= video.bg->h || src_x >= video.bg->w)
+            return;
+
+        right = std::min(right, video.bg->w - (int32_t) video.frame->x_scroll);
+        if (left >= right)
+            return;
+
+        const auto src = static_cast<const uint8_t*>(video.bg->pixels)
+            + src_y * video.bg->pitch
+            + src_x * 4;
+        const auto dst = static_cast<uint8_t*>(video.fg->pixels)
+            + y * video.fg->pitch
+            + left * 4;
+        memcpy(dst, src, (right - left) * 4);
+    }
 
+    // copies the band's rows of fg back from the scrolled bg; only damaged
+    // cells unless the whole screen is stale.
+    static void video_restore_band(game_t& game, const compositor_band_t& band) {
         auto& video = game.video;
 
-        const auto sprite_width = video.sprite_size.w;
-        const auto sprite_height =video.sprite_size.h;
-
-        const bool horizontal_flip = (sprite.flags & (uint8_t)sprite_flags_t::hflip) == (uint8_t)sprite_flags_t::hflip;
-        const bool vertical_flip = (sprite.flags & (uint8_t)sprite_flags_t::vflip) == (uint8_t)sprite_flags_t::vflip;
-
-        auto sy = (uint8_t) (vertical_flip ? sprite_height - 1 : 0);
-        auto syd = (int8_t) (vertical_flip ? -1 : 1);
-        auto sxd = (int8_t) (horizontal_flip ? -1 : 1);
-
-        for (uint32_t y = 0; y < sprite_height; y++) {
-            uint32_t ty = sprite.pos.y + y;
-            if (ty > video.clip.pos.y
-            &&  ty < video.clip.pos.y + video.clip.size.h) {
-                auto p = static_cast<uint8_t*>(video.fg->pixels) + (ty * video.fg->pitch + (sprite.pos.x * 4));
-                auto sx = (uint8_t) (horizontal_flip ? sprite_width - 1 : 0);
-                for (uint32_t x = 0; x < sprite_width; x++) {
-                    uint32_t tx = sprite.pos.x + x;
-                    if (tx < video.clip.pos.x
-                    ||  tx > video.clip.pos.x + video.clip.size.w) {
-                        p += 4;
-                    } else {
-                        const auto pixel_offset = (const uint32_t) (sy * sprite_width + sx);
-//                        const palette_entry_t* pal_entry = &pal->entries[bitmap->data[pixel_offset]];
-//                        if (pal_entry->alpha == 0x00)
-//                            p += 4;
-//                        else {
-//                            *p++ = pal_entry->blue;
-//                            *p++ = pal_entry->green;
-//                            *p++ = pal_entry->red;
-//                            *p++ = pal_entry->alpha;
-//                        }
-                    }
-                    sx += sxd;
-                }
-            }
-            sy += syd;
+        if (video.stats.full_copy) {
+            for (auto y = band.top; y < band.bottom; y++)
+                video_copy_bg_row(video, y, 0, screen_width);
+            return;
         }
 
-        return true;
+        const auto cell_width = video.tile_size.w;
+        const auto cell_height = video.tile_size.h;
+        video.fg_restore.for_each_span(
+            band.top / cell_height,
+            (band.bottom + cell_height - 1) / cell_height,
+            [&](uint32_t x, uint32_t y, uint32_t length) {
+                const auto left = (int32_t) (x * cell_width);
+                const auto right = std::min<int32_t>(left + length * cell_width, screen_width);
+                const auto top = std::max<int32_t>(y * cell_height, band.top);
+                const auto bottom = std::min<int32_t>((y + 1) * cell_height, band.bottom);
+                for (auto row = top; row < bottom; row++)
+                    video_copy_bg_row(video, row, left, right);
+            });
+    }
+
+    static void video_end_restore(game_t& game) {
+        auto& video = game.video;
+        video.fg_restore.clear();
+        video.bg_invalid = false;
+        video.last_x_scroll = video.frame->x_scroll;
+        video.last_y_scroll = video.frame->y_scroll;
+    }
+
+    static bool video_prepare_sprite(game_t& game, const sprite_t& sprite, blit_span_t& span) {
+        const auto bitmap = tile_bitmap_find(sprite.tile.id);
+        if (bitmap == nullptr)
+            return false;
+
+        auto& video = game.video;
+
+        const auto flags = (uint8_t) ((uint8_t) blit_flags_t::keyed
+            | (sprite.flags & ((uint8_t)sprite_flags_t::hflip | (uint8_t)sprite_flags_t::vflip)));
+        const auto origin = video_bitmap_origin(bitmap, sprite.pos.x, sprite.pos.y, flags);
+
+        auto source = video_blit_source(video, bitmap, sprite.tile);
+        source.w = std::min(source.w, video.sprite_size.w - (origin.x - sprite.pos.x));
+        source.h = std::min(source.h, video.sprite_size.h - (origin.y - sprite.pos.y));
+
+        return blit_prepare(
+            video_blit_target(video.fg, video.clip),
+            source,
+            origin.x,
+            origin.y,
+            flags,
+            span);
     }
 
     static void video_update_fg(game_t& game) {
-        SDL_LockSurface(game.video.fg);
+        auto& video = game.video;
+        auto& buckets = video.sprite_lines;
 
-        for (uint32_t i = 0; i < game.video.max_sprites; i++) {
-            auto& sprite = game.video.sprites[i];
+        scanline_reset(buckets);
+
+        for (uint32_t i = 0; i < video.max_sprites; i++) {
+            const auto& sprite = video.frame->sprites[i];
 
             if ((sprite.flags & (uint8_t)sprite_flags_t::enabled) == 0)
                 continue;
 
-            if (!video_draw_sprite(game, sprite)) {
+            blit_span_t span{};
+            if (!video_prepare_sprite(game, sprite, span))
                 continue;
-            }
 
-            sprite.flags &= ~(uint8_t)sprite_flags_t::changed;
+            scanline_add(buckets, (uint16_t) i, sprite.priority, span);
+            video_damage_rect(
+                video,
+                span.left,
+                span.top,
+                span.count,
+                span.bottom - span.top);
         }
 
-        SDL_UnlockSurface(game.video.fg);
+        scanline_bin(buckets);
+
+        video.stats.sprites_drawn = (uint32_t) buckets.sprites.size();
+        video.stats.sprite_lines_dropped = buckets.dropped;
     }
 
     ///////////////////////////////////////////////////////////////////////////
 
-    static void video_draw_vline(game_t& game, vline_t& line) {
-        auto p = static_cast<uint8_t*>(game.video.fg->pixels)
-            + (line.pos.y * game.video.fg->pitch + (line.pos.x * 4));
-        for (uint32_t y = 0; y < line.h; y++) {
-            *p++ = line.color.b;
-            *p++ = line.color.g;
-            *p++ = line.color.r;
-            *p++ = line.color.a;
-            p += game.video.fg->pitch;
-        }
-    }
-
-    static void video_draw_hline(game_t& game, hline_t& line) {
-        auto p = static_cast<uint8_t*>(game.video.fg->pixels)
-            + (line.pos.y * game.video.fg->pitch + (line.pos.x * 4));
-        for (uint32_t x = 0; x < line.w; x++) {
-            *p++ = line.color.b;
-            *p++ = line.color.g;
-            *p++ = line.color.r;
-            *p++ = line.color.a;
-        }
-    }
-
-    static void video_draw_rect(game_t& game, box_t& box) {
-        if (box.fill) {
-            for (uint32_t y = 0; y < box.bounds.size.h; y++) {
-                hline_t line{};
-                line.color = box.color;
-                line.w = box.bounds.size.w;
-                line.pos.x = box.bounds.pos.x;
-                line.pos.y = box.bounds.pos.y + y;
-                video_draw_hline(game, line);
-            }
-        } else {
-            vline_t vline{};
-            vline.color = box.color;
-            vline.h = box.bounds.size.h;
-            vline.pos.x = box.bounds.pos.x;
-            vline.pos.y = box.bounds.pos.y;
-            video_draw_vline(game, vline);
+    static uint32_t to_bgra(const color_t& color) {
+        return (uint32_t) color.b
+            | ((uint32_t) color.g << 8)
+            | ((uint32_t) color.r << 16)
+            | ((uint32_t) color.a << 24);
+    }
 
-            vline.pos.x += box.bounds.size.w;
-            video_draw_vline(game, vline);
+    static void video_queue_fill(
+            game_t& game,
+            const draw_command_t& command,
+            int32_t x,
+            int32_t y,
+            int32_t w,
+            int32_t h) {
+        if (w <= 0 || h <= 0)
+            return;
+        video_damage_rect(game.video, x, y, w, h);
+        compositor_fill(
+            game.video.compositor,
+            compositor_fill_t{x, y, x + w, y + h, to_bgra(command.color), command.blend});
+    }
+
+    static void video_bin_command(game_t& game, const draw_command_t& command) {
+        const auto& bounds = command.dest;
+        switch (command.type) {
+            case draw_command_type_t::hline:
+                video_queue_fill(game, command, bounds.pos.x, bounds.pos.y, bounds.size.w, 1);
+                break;
+            case draw_command_type_t::vline:
+                video_queue_fill(game, command, bounds.pos.x, bounds.pos.y, 1, bounds.size.h);
+                break;
+            case draw_command_type_t::box:
+                if (command.fill) {
+                    video_queue_fill(game, command, bounds.pos.x, bounds.pos.y, bounds.size.w, bounds.size.h);
+                } else {
+                    // same pixels as raster_box: the left edge starts below
+                    // the top edge so blended outlines have no double corner.
+                    video_queue_fill(game, command, bounds.pos.x, bounds.pos.y, bounds.size.w, 1);
+                    video_queue_fill(game, command, bounds.pos.x, bounds.pos.y + bounds.size.h, bounds.size.w, 1);
+                    video_queue_fill(game, command, bounds.pos.x, bounds.pos.y + 1, 1, bounds.size.h - 1);
+                    video_queue_fill(game, command, bounds.pos.x + bounds.size.w, bounds.pos.y, 1, bounds.size.h);
+                }
+                break;
+            default:
+                break;
+        }
+    }
 
-            hline_t hline{};
-            hline.color = box.color;
-            hline.w = box.bounds.size.w;
-            hline.pos.y = box.bounds.pos.y;
-            hline.pos.x = box.bounds.pos.x;
-            video_draw_hline(game, hline);
+    // a premultiplied bitmap drawn whole at pos; opaque ones are plain copies
+    static void video_bin_bitmap(game_t& game, const image_bitmap_t& bitmap, const point_t& pos) {
+        auto& video = game.video;
 
-            hline.pos.y += box.bounds.size.h;
-            video_draw_hline(game, hline);
+        blit_source_t source{};
+        source.pixels = bitmap.pixels.data();
+        source.pitch = bitmap.size.w;
+        source.w = bitmap.size.w;
+        source.h = bitmap.size.h;
+
+        blit_span_t span{};
+        const auto flags = bitmap.opaque ? blit_flags_t::none : blit_flags_t::blend;
+        if (!blit_prepare(
+                video_blit_target(video.fg, video.clip),
+                source,
+                pos.x,
+                pos.y,
+                (uint8_t) flags,
+                span)) {
+            return;
+        }
+
+        video_damage_rect(video, pos.x, pos.y, bitmap.size.w, bitmap.size.h);
+        compositor_blit(video.compositor, span);
+    }
+
+    // images are drawn whole; the cache supplies a premultiplied copy at the
+    // destination size, so the band pass only copies or blends.
+    static void video_bin_image(game_t& game, const draw_command_t& command) {
+        auto image = image_find(command.id);
+        if (image == nullptr)
+            return;
+
+        const auto bitmap = image_cache_get(
+            game.video.images,
+            asset_handle(s_images, command.id),
+            image->bitmap,
+            command.dest.size);
+        if (bitmap == nullptr)
+            return;
+
+        video_bin_bitmap(game, *bitmap, command.dest.pos);
+    }
+
+    // text runs are rasterized once by the text cache and then drawn like a
+    // blended image, so an unchanged label costs a single blit.
+    static void video_bin_text(game_t& game, const draw_command_t& command) {
+        auto font = font_find(command.id);
+        if (font == nullptr)
+            return;
+
+        auto& video = game.video;
+        profiler_scope_t scope(game.profiler, profile_phase_t::video_text);
+        const auto bitmap = text_cache_get(
+            video.texts,
+            font->font,
+            asset_handle(s_fonts, command.id),
+            command.color,
+            draw_list_text(video.frame->draws, command));
+        if (bitmap == nullptr)
+            return;
+
+        video_bin_bitmap(game, *bitmap, command.dest.pos);
+    }
+
+    static draw_list_t& video_back_draws(video_t& video) {
+        return video.frames[video.buffers.back()].draws;
+    }
+
+    static draw_command_t* video_push_command(
+            common::result& r,
+            game_t& game,
+            draw_command_type_t type) {
+        auto& video = game.video;
+        auto& draws = video_back_draws(video);
+        auto command = draw_list_push(draws, type, video.draw_layer);
+        if (command == nullptr) {
+            r.error(
+                "V006",
+                fmt::format("draw list is full: {} commands", draws.capacity));
+            return nullptr;
+        }
+        command->blend = video.draw_blend;
+        return command;
+    }
+
+    // fg already holds everything, text included, so presenting is one
+    // upload and one copy
+    static void video_present(game_t& game) {
+        auto& video = game.video;
+        auto& profiler = game.profiler;
+
+        {
+            profiler_scope_t scope(profiler, profile_phase_t::video_upload);
+            SDL_UpdateTexture(
+                game.window.texture,
+                nullptr,
+                video.fg->pixels,
+                video.fg->pitch);
+            SDL_RenderCopy(
+                game.window.renderer,
+                game.window.texture,
+                nullptr,
+                nullptr);
+        }
+
+        {
+            profiler_scope_t scope(profiler, profile_phase_t::video_present);
+            SDL_RenderPresent(game.window.renderer);
         }
     }
 
     ///////////////////////////////////////////////////////////////////////////
 
+    // changed_blocks takes a block the first time it changes after a publish
+    static void video_touch_block(video_t& video, uint32_t index) {
+        if (video.block_versions[index] <= video.published_block_version)
+            video.changed_blocks.push_back(index);
+        video.block_versions[index] = ++video.block_version;
+    }
+
+    bool video_set_tile(
+            common::result& r,
+            game_t& game,
+            uint32_t ty,
+            uint32_t tx,
+            uint32_t layer,
+            tile_t tile,
+            uint8_t flags) {
+        auto& video = game.video;
+        if (tx >= video.bg_size.w || ty >= video.bg_size.h) {
+            r.error("V004", fmt::format("tile position out of range: {}, {}", tx, ty));
+            return false;
+        }
+
+        auto& block = video.blocks[ty * video.bg_size.w + tx];
+        if (layer >= block.layers.size())
+            block.layers.resize(layer + 1);
+
+        auto& entry = block.layers[layer];
+        flags &= ~(uint8_t)tile_flags_t::changed;
+        if (entry.tile.id.bank == tile.id.bank
+        &&  entry.tile.id.index == tile.id.index
+        &&  entry.tile.palette == tile.palette
+        &&  (entry.flags & ~(uint8_t)tile_flags_t::changed) == flags) {
+            return true;
+        }
+
+        entry.tile = tile;
+        entry.flags = flags | (uint8_t)tile_flags_t::changed;
+        video_touch_block(video, ty * video.bg_size.w + tx);
+
+        return true;
+    }
+
+    bool video_clear_tile(
+            common::result& r,
+            game_t& game,
+            uint32_t ty,
+            uint32_t tx,
+            uint32_t layer) {
+        auto& video = game.video;
+        if (tx >= video.bg_size.w || ty >= video.bg_size.h) {
+            r.error("V004", fmt::format("tile position out of range: {}, {}", tx, ty));
+            return false;
+        }
+
+        auto& block = video.blocks[ty * video.bg_size.w + tx];
+        if (layer >= block.layers.size())
+            return true;
+
+        auto& entry = block.layers[layer];
+        if ((entry.flags & (uint8_t)tile_flags_t::enabled) == 0)
+            return true;
+
+        entry.flags = (uint8_t)tile_flags_t::changed;
+        video_touch_block(video, ty * video.bg_size.w + tx);
+
+        return true;
+    }
+
+    void video_invalidate_bg(game_t& game) {
+        ++game.video.bg_generation;
+    }
+
+    static bool video_load_logos(common::result& r, game_t& game, bank_file* assets) {
+        auto logos = assets != nullptr ? assets->find(logo_bank) : nullptr;
+        for (const auto& logo : s_logo_assets) {
+            auto entry = logos != nullptr ? logos->find(logo.name) : nullptr;
+            if (entry == nullptr) {
+                asset_loader_queue_image(game.assets, logo.path, STBI_rgb_alpha, logo.id);
+                continue;
+            }
+
+            image_t image{};
+            if (!image_decode(r, *entry, image) || !image_store(r, logo.id, image))
+                return false;
+            s_bank_images.push_back(make_bank_source(*assets, logo_bank, *entry, logo.id, 1));
+        }
+        return true;
+    }
+
+    // a sheet missing from the bank has to be waited for, since it can only
+    // be cut once its image is stored
+    static bool video_load_sheets(common::result& r, game_t& game, bank_file* assets) {
+        auto sheets = assets != nullptr ? assets->find(sheet_bank) : nullptr;
+        std::vector<std::pair<asset_load_handle_t, uint16_t>> pending{};
+        for (uint16_t i = 0; i < std::size(s_sheet_assets); i++) {
+            const auto& sheet = s_sheet_assets[i];
+            auto entry = sheets != nullptr ? sheets->find(sheet.name) : nullptr;
+            if (entry == nullptr) {
+                pending.emplace_back(
+                    asset_loader_queue_image(
+                        game.assets,
+                        sheet.path,
+                        STBI_rgb_alpha,
+                        bank_id_t{fallback_sheet_bank, i}),
+                    i);
+                continue;
+            }
+
+            if (!tile_bitmap_add_bank_sheet(r, *assets, sheet_bank, *entry, sheet.first_id))
+                return false;
+        }
+
+        for (const auto& [handle, index] : pending) {
+            const auto& sheet = s_sheet_assets[index];
+            if (!asset_loader_wait(r, game.assets, handle)
+            ||  !tile_bitmap_add_sheet(r, bank_id_t{fallback_sheet_bank, index}, sheet.frame_size, sheet.first_id)) {
+                return false;
+            }
+        }
+
+        return tile_bitmap_build_atlas(r);
+    }
+
     bool video_init(common::result& r, game_t& game) {
+        blit_init();
+        raster_init();
+        if (game.config.force_isa) {
+            if (!blit_select(game.config.isa) || !raster_select(game.config.isa)) {
+                r.error("V009", fmt::format(
+                    "{} kernels are not available on this cpu",
+                    blit_isa_name(game.config.isa)));
+                return false;
+            }
+            log_message(
+                log_category_t::video,
+                "blit and raster kernels forced to {}",
+                blit_isa_name(game.config.isa));
+        }
+
         game.video.clip.pos.x = 0;
         game.video.clip.pos.y = 0;
         game.video.clip.size.w = screen_width;
         game.video.clip.size.h = screen_height;
 
+        const auto max_blocks = game.video.max_bg_size.w * game.video.max_bg_size.h;
         game.video.sprites.resize(game.video.max_sprites);
-        game.video.blocks.resize(game.video.max_bg_size.w * game.video.max_bg_size.h);
+        game.video.blocks.resize(max_blocks);
+        game.video.block_versions.assign(max_blocks, 0);
+        game.video.changed_blocks.reserve(max_blocks);
+        for (auto& stale : game.video.stale_blocks)
+            stale.resize(game.video.max_bg_size.w, game.video.max_bg_size.h);
+        game.video.rendered_versions.assign(max_blocks, 0);
+        game.video.rendered_palette_versions.assign(max_palettes, 0);
+        for (auto& frame : game.video.frames) {
+            frame.sprites.resize(game.video.max_sprites);
+            frame.blocks.resize(max_blocks);
+            frame.versions.assign(max_blocks, 0);
+            frame.changed_blocks.reserve(max_blocks);
+            frame.palettes.resize(max_palettes);
+            frame.palette_versions.assign(max_palettes, 0);
+            draw_list_init(frame.draws, max_draw_commands, max_draw_text);
+        }
+        game.video.frame = &game.video.frames[game.video.buffers.front()];
+
+        compositor_init(
+            game.video.compositor,
+            screen_height,
+            game.video.tile_size.h,
+            game.config.render_threads < 0 ?
+                common::worker_pool::default_size() :
+                (uint32_t) game.config.render_threads);
+
+        scanline_init(
+            game.video.sprite_lines,
+            screen_height,
+            std::min(game.video.max_sprites_per_line, game.video.max_sprites));
+
+        game.video.bg_dirty.resize(game.video.bg_size.w, game.video.bg_size.h);
+        game.video.fg_damage.resize(
+            (screen_width + game.video.tile_size.w - 1) / game.video.tile_size.w,
+            (screen_height + game.video.tile_size.h - 1) / game.video.tile_size.h);
+        game.video.fg_restore.resize(
+            game.video.fg_damage.width(),
+            game.video.fg_damage.height());
+        game.video.bg_invalid = true;
+        game.video.bg_dirty.mark_all();
+
+        image_cache_init(game.video.images, game.video.image_cache_bytes);
+        text_cache_init(game.video.texts, game.video.text_cache_bytes);
 
         const auto bg_surface_width = game.video.tile_size.w * game.video.bg_size.w;
         const auto bg_surface_height = game.video.tile_size.h * game.video.bg_size.h;
@@ -369,135 +1376,269 @@ namespace mayhem {
         SDL_SetSurfaceBlendMode(game.video.fg, SDL_BLENDMODE_NONE);
         //SDL_SetSurfaceRLE(game.video.fg, SDL_TRUE);
 
-        if (!font_load(
-                r,
-                "../assets/fonts/joystick/joystick.ttf",
-                game.window.renderer,
-                14,
-                TTF_STYLE_NORMAL,
-                color_t{0xff, 0xff, 0xff, 0xff},
-                bank_id_t{0xff, 0})) {
-            r.error("V002", "unable to load font: ../assets/fonts/joystick/joystick.ttf");
-            return false;
+        // logos loaded from png stream in behind the first frames; the
+        // system font is waited for, since the fps and profiler overlays
+        // draw with it.
+        const auto font = asset_loader_queue_font(
+            game.assets,
+            "../assets/fonts/joystick/Joystick.ttf",
+            14,
+            (uint8_t) font_style_t::normal,
+            color_t{0xff, 0xff, 0xff, 0xff},
+            bank_id_t{0xff, 0});
+
+        common::result bank_result{};
+        auto assets = game.banks.load(bank_result, asset_bank_path);
+        if (assets == nullptr) {
+            for (const auto& message : bank_result.messages())
+                log_warn(log_category_t::video, "{}; loading pngs instead", message.message());
         }
 
-        if (!image_load(r, "../assets/logos/fmod-logo-white1.png", STBI_rgb_alpha, bank_id_t{0xff, 1})) {
-            r.error("V002", "unable to load image: ../assets/logos/fmod-logo-white1.png");
+        if (!video_load_logos(r, game, assets)
+        ||  !video_load_sheets(r, game, assets)) {
             return false;
         }
 
-        if (!image_load(r, "../assets/logos/nybbles-logo.png", STBI_rgb_alpha, bank_id_t{0xff, 2})) {
-            r.error("V002", "unable to load image: ../assets/logos/nybbles-logo.png");
+        if (!asset_loader_wait(r, game.assets, font)) {
+            r.error("V002", "unable to load font: ../assets/fonts/joystick/Joystick.ttf");
             return false;
         }
 
         return true;
     }
 
+    static const bank_entry* bank_source_find(bank_file& file, const bank_source_t& source) {
+        auto bank = file.find(source.bank);
+        return bank != nullptr ? bank->find(source.name) : nullptr;
+    }
+
+    bool video_reload_bank(common::result& r, game_t& game, const std::string& path) {
+        auto file = game.banks.find(path);
+        if (file == nullptr)
+            return true;
+
+        const auto first_changed = s_changed_tiles.size();
+        auto success = true;
+        auto repack = false;
+        for (auto& sheet : s_bank_sheets) {
+            if (sheet.path != path)
+                continue;
+
+            auto entry = bank_source_find(*file, sheet);
+            if (entry == nullptr || bank_entry_hash(*entry) == sheet.hash)
+                continue;
+
+            // the old frames go either way; if the new ones cannot be cut,
+            // their bitmaps go with them rather than point at a freed page
+            atlas_remove_frames(s_atlas, sheet.id, sheet.count);
+            uint32_t count = 0;
+            if (!tile_bitmap_cut_bank_sheet(r, *entry, sheet.id, count))
+                success = false;
+
+            tile_bitmap_release(sheet.id, count, sheet.count);
+            for (uint32_t i = 0; i < std::max(count, sheet.count); i++)
+                s_changed_tiles.push_back(bank_id_t{sheet.id.bank, (uint16_t) (sheet.id.index + i)});
+            sheet.count = count;
+            sheet.hash = bank_entry_hash(*entry);
+            repack = true;
+        }
+
+        if (repack) {
+            if (!tile_bitmap_build_atlas(r))
+                return false;
+            atlas_release_pages(s_atlas);
+        }
+
+        uint32_t images = 0;
+        for (auto& source : s_bank_images) {
+            if (source.path != path)
+                continue;
+
+            auto entry = bank_source_find(*file, source);
+            if (entry == nullptr || bank_entry_hash(*entry) == source.hash)
+                continue;
+
+            image_t image{};
+            if (!image_decode(r, *entry, image) || !image_store(r, source.id, image)) {
+                success = false;
+                continue;
+            }
+            source.hash = bank_entry_hash(*entry);
+            images++;
+        }
+
+        log_message(
+            log_category_t::video,
+            "bank {} reloaded: {} tile bitmaps and {} images rebuilt",
+            path,
+            s_changed_tiles.size() - first_changed,
+            images);
+
+        return success;
+    }
+
+    void video_publish(game_t& game) {
+        auto& video = game.video;
+        auto& back = video.frames[video.buffers.back()];
+
+        back.x_scroll = video.x_scroll;
+        back.y_scroll = video.y_scroll;
+        back.bg_generation = video.bg_generation;
+        back.sprites = video.sprites;
+        for (auto& sprite : video.sprites)
+            sprite.flags &= ~(uint8_t)sprite_flags_t::changed;
+
+        // every frame is now stale for the blocks changed since the last
+        // publish.  the back frame takes all it is stale for, and as every
+        // changed block reaches it, clearing changed flags here never loses
+        // one.  the renderer has to compare what its frame is stale for.
+        const auto stride = video.bg_size.w;
+        for (auto index : video.changed_blocks) {
+            for (auto& stale : video.stale_blocks)
+                stale.mark(index % stride, index / stride);
+        }
+
+        auto& stale = video.stale_blocks[video.buffers.back()];
+        stale.for_each([&](uint32_t x, uint32_t y) {
+            const auto index = y * stride + x;
+            back.blocks[index] = video.blocks[index];
+            back.versions[index] = video.block_versions[index];
+        });
+        stale.clear();
+
+        back.changed_blocks.clear();
+        video.stale_blocks[video.buffers.reader_hint()].for_each([&](uint32_t x, uint32_t y) {
+            back.changed_blocks.push_back(y * stride + x);
+        });
+
+        for (auto index : video.changed_blocks) {
+            for (auto& layer : video.blocks[index].layers)
+                layer.flags &= ~(uint8_t)tile_flags_t::changed;
+        }
+        video.changed_blocks.clear();
+        video.published_block_version = video.block_version;
+
+        for (uint32_t i = 0; i < max_palettes; i++) {
+            const auto version = palette_version(static_cast<uint8_t>(i));
+            if (back.palette_versions[i] == version)
+                continue;
+            back.palettes[i] = *palette(static_cast<uint8_t>(i));
+            back.palette_versions[i] = version;
+        }
+
+        video.buffers.publish();
+
+        draw_list_reset(video_back_draws(video));
+        video.draw_layer = 0;
+        video.draw_blend = false;
+    }
+
+    bool video_frame_ready(const game_t& game) {
+        return game.video.buffers.ready();
+    }
+
     bool video_update(common::result& r, game_t& game) {
-        video_update_bg(game);
+        auto& video = game.video;
+        auto& profiler = game.profiler;
 
-        const auto source_rect = SDL_Rect {
-            (int)game.video.x_scroll,
-            (int)game.video.y_scroll,
-            screen_width,
-            screen_height
-        };
-        SDL_BlitSurface(
-            game.video.bg,
-            &source_rect,
-            game.video.fg,
-            nullptr);
-
-        video_update_fg(game);
-
-        auto blit_view = game.registry.view<blit_t>();
-        for (auto entity : blit_view) {
-            auto& blit = blit_view.get(entity);
-            auto image = image_find(blit.image);
-
-            const auto src_rect = SDL_Rect {
-                blit.src_rect.pos.x,
-                blit.src_rect.pos.y,
-                blit.src_rect.size.w,
-                blit.src_rect.size.h,
-            };
-            auto dest_rect = SDL_Rect {
-                blit.dest_rect.pos.x,
-                blit.dest_rect.pos.y,
-                blit.dest_rect.size.w,
-                blit.dest_rect.size.h,
-            };
-            SDL_BlitScaled(image->surface, &src_rect, game.video.fg, &dest_rect);
-            game.registry.destroy(entity);
-        }
-
-        auto hline_view = game.registry.view<hline_t>();
-        for (auto entity : hline_view) {
-            auto& hline = hline_view.get(entity);
-            video_draw_hline(game, hline);
-            game.registry.destroy(entity);
-        }
-
-        auto vline_view = game.registry.view<vline_t>();
-        for (auto entity : vline_view) {
-            auto& vline = vline_view.get(entity);
-            video_draw_vline(game, vline);
-            game.registry.destroy(entity);
-        }
-
-        auto box_view = game.registry.view<box_t>();
-        for (auto entity : box_view) {
-            auto& box = box_view.get(entity);
-            video_draw_rect(game, box);
-            game.registry.destroy(entity);
-        }
-
-        SDL_UpdateTexture(
-            game.window.texture,
-            nullptr,
-            game.video.fg->pixels,
-            game.video.fg->pitch);
-        SDL_RenderCopy(
-            game.window.renderer,
-            game.window.texture,
-            nullptr,
-            nullptr);
-
-        auto text_view = game.registry.view<text_t>();
-        for (auto entity : text_view) {
-            auto& text = text_view.get(entity);
-            auto font = font_find(text.font.id);
-            FC_DrawColor(
-                font->handle,
-                game.window.renderer,
-                text.pos.x,
-                text.pos.y,
-                to_fc_color(text.color),
-                text.data.c_str());
-            game.registry.destroy(entity);
+        video_acquire_frame(game);
+
+        {
+            profiler_scope_t scope(profiler, profile_phase_t::video_bg);
+            video_update_bg(game);
+        }
+
+        {
+            profiler_scope_t scope(profiler, profile_phase_t::video_sprites);
+            video_begin_restore(game);
+            video_update_fg(game);
         }
 
-        SDL_RenderPresent(game.window.renderer);
+        // overlays are binned into bands in draw order, then each band is
+        // restored from bg, gets its sprites and then its overlays, all in
+        // one pass.
+        {
+            profiler_scope_t scope(profiler, profile_phase_t::video_bin);
+            compositor_reset(video.compositor);
+            image_cache_begin_frame(video.images);
+            text_cache_begin_frame(video.texts);
+            draw_list_sort(video.frame->draws);
+            draw_list_for_each(video.frame->draws, [&](const draw_command_t& command) {
+                switch (command.type) {
+                    case draw_command_type_t::image:
+                        video_bin_image(game, command);
+                        break;
+                    case draw_command_type_t::text:
+                        video_bin_text(game, command);
+                        break;
+                    default:
+                        video_bin_command(game, command);
+                        break;
+                }
+            });
+        }
+
+        {
+            profiler_scope_t scope(profiler, profile_phase_t::video_compose);
+            const auto target = video_blit_target(video.fg, video.clip);
+
+            SDL_LockSurface(video.fg);
+            compositor_run(video.compositor, [&](const compositor_band_t& band) {
+                const auto start = profiler_now();
+                video_restore_band(game, band);
+                const auto restored = profiler_now();
+                scanline_compose(video.sprite_lines, target, band.top, band.bottom);
+                const auto composed = profiler_now();
+                compositor_draw(video.compositor, band, target);
+                const auto drawn = profiler_now();
+
+                profiler_add(profiler, profile_phase_t::video_restore, restored - start);
+                profiler_add(profiler, profile_phase_t::video_scanlines, composed - restored);
+                profiler_add(profiler, profile_phase_t::video_overlays, drawn - composed);
+            });
+            SDL_UnlockSurface(video.fg);
+
+            video_end_restore(game);
+        }
+
+        if (video.headless) {
+            video.frame_hash = common::hash64(
+                video.fg->pixels,
+                static_cast<std::size_t>(video.fg->pitch) * video.fg->h);
+        } else {
+            video_present(game);
+        }
 
         return true;
     }
 
     bool video_shutdown(common::result& r, game_t& game) {
+        compositor_shutdown(game.video.compositor);
+        image_cache_clear(game.video.images);
+
         SDL_FreeSurface(game.video.bg);
         SDL_FreeSurface(game.video.fg);
 
-        for (const auto& kvp : s_fonts)
-            FC_FreeFont(kvp.second.handle);
+        text_cache_clear(game.video.texts);
 
-        for (const auto& kvp : s_images) {
-            SDL_FreeSurface(kvp.second.surface);
-            stbi_image_free(kvp.second.data);
-        }
+        asset_for_each(s_images, [](bank_id_t, image_t& image) {
+            image_free(image);
+        });
+        asset_clear(s_images);
+        asset_clear(s_fonts);
+        asset_clear(s_tile_bitmaps);
 
         return true;
     }
 
+    void video_draw_layer(game_t& game, uint8_t layer) {
+        game.video.draw_layer = layer;
+    }
+
+    void video_draw_blend(game_t& game, bool enabled) {
+        game.video.draw_blend = enabled;
+    }
+
     bool video_queue_text(
             common::result& r,
             game_t& game,
@@ -505,20 +1646,27 @@ namespace mayhem {
             color_t color,
             int32_t y,
             int32_t x,
-            const std::string& value) {
+            std::string_view value) {
         auto font = font_find(id);
         if (font == nullptr) {
             r.error("V001", fmt::format("unknown font: {}", make_bank_key(id)));
             return false;
         }
 
-        auto entity = game.registry.create();
-        auto& text = game.registry.assign<text_t>(entity);
-        text.pos.y = y;
-        text.pos.x = x;
-        text.data = value;
-        text.color = color;
-        text.font = font_t{id};
+        auto text = video_push_command(r, game, draw_command_type_t::text);
+        if (text == nullptr)
+            return false;
+
+        auto& draws = video_back_draws(game.video);
+        if (!draw_list_push_text(draws, text, value)) {
+            r.error(
+                "V006",
+                fmt::format("draw list text is full: {} bytes", draws.text_capacity));
+            return false;
+        }
+        text->id = id;
+        text->color = color;
+        text->dest.pos = point_t{x, y};
 
         return true;
     }
@@ -536,14 +1684,16 @@ namespace mayhem {
             return false;
         }
 
-        auto entity = game.registry.create();
-        auto& blit = game.registry.assign<blit_t>(entity);
-        blit.image = id;
-        blit.src_rect = rect_t{{0, 0}, {image->size.w, image->size.h}};
+        auto blit = video_push_command(r, game, draw_command_type_t::image);
+        if (blit == nullptr)
+            return false;
+
+        blit->id = id;
+        blit->src = rect_t{{0, 0}, {image->size.w, image->size.h}};
         if (size.h != 0 && size.w != 0)
-            blit.dest_rect = rect_t{{x, y}, size};
+            blit->dest = rect_t{{x, y}, size};
         else
-            blit.dest_rect = rect_t{{x, y}, {image->size.w, image->size.h}};
+            blit->dest = rect_t{{x, y}, {image->size.w, image->size.h}};
 
         return true;
     }
@@ -555,11 +1705,12 @@ namespace mayhem {
             int32_t y,
             int32_t x,
             int32_t w) {
-        auto entity = game.registry.create();
-        auto& hline = game.registry.assign<hline_t>(entity);
-        hline.w = w;
-        hline.color = color;
-        hline.pos = point_t{x, y};
+        auto hline = video_push_command(r, game, draw_command_type_t::hline);
+        if (hline == nullptr)
+            return false;
+
+        hline->color = color;
+        hline->dest = rect_t{x, y, w, 1};
 
         return true;
     }
@@ -571,11 +1722,12 @@ namespace mayhem {
             int32_t y,
             int32_t x,
             int32_t h) {
-        auto entity = game.registry.create();
-        auto& vline = game.registry.assign<vline_t>(entity);
-        vline.h = h;
-        vline.color = color;
-        vline.pos = point_t{x, y};
+        auto vline = video_push_command(r, game, draw_command_type_t::vline);
+        if (vline == nullptr)
+            return false;
+
+        vline->color = color;
+        vline->dest = rect_t{x, y, 1, h};
 
         return true;
     }
@@ -589,13 +1741,15 @@ namespace mayhem {
             int32_t w,
             int32_t h,
             bool fill) {
-        auto entity = game.registry.create();
-        auto& box = game.registry.assign<box_t>(entity);
-        box.fill = fill;
-        box.color = color;
-        box.bounds = rect_t{x, y, w, h};
+        auto box = video_push_command(r, game, draw_command_type_t::box);
+        if (box == nullptr)
+            return false;
+
+        box->fill = fill;
+        box->color = color;
+        box->dest = rect_t{x, y, w, h};
 
         return true;
     }
 
-}
\ No newline at end of file
+}
@@ -11,24 +11,25 @@
 
 #include <vector>
 #include <cstdint>
-#include <functional>
 #include <string_view>
+#include <SDL.h>
 #include <common/result.h>
-#include <SDL_FontCache.h>
+#include <common/dirty_map.h>
+#include <common/inline_function.h>
+#include <common/triple_buffer.h>
 #include "game.h"
+#include "types.h"
+#include "palette.h"
+#include "draw_list.h"
+#include "bitmap_font.h"
+#include "image_cache.h"
+#include "text_cache.h"
+#include "scanline.h"
+#include "compositor.h"
+#include "bank_manager.h"
 
 namespace mayhem {
 
-    struct size_t {
-        int32_t w = 0;
-        int32_t h = 0;
-    };
-
-    struct point_t {
-        int32_t x = 0;
-        int32_t y = 0;
-    };
-
     enum class tile_flags_t : uint8_t {
         none        = 0b00000000,
         enabled     = 0b00000001,
@@ -37,11 +38,6 @@ namespace mayhem {
         changed     = 0b00010000,
     };
 
-    struct bank_id_t {
-        uint8_t bank = 0;
-        uint16_t index = 0;
-    };
-
     struct tile_t {
         bank_id_t id{};
         uint8_t palette = 0;
@@ -79,10 +75,13 @@ namespace mayhem {
         changed     = 0b00010000,
     };
 
+    // higher priority sprites are drawn over lower ones and win the slots
+    // when a scanline is over video_t::max_sprites_per_line.
     struct sprite_t {
         point_t pos{};
         tile_t tile{};
         uint8_t flags = 0;
+        uint8_t priority = 0;
     };
 
     ///////////////////////////////////////////////////////////////////////////
@@ -112,7 +111,7 @@ namespace mayhem {
     };
 
     struct actor_t;
-    using animation_callback_t = std::function<bool (actor_t*)>;
+    using animation_callback_t = common::inline_function<bool (actor_t*)>;
 
     struct actor_t {
         point_t pos{};
@@ -124,84 +123,45 @@ namespace mayhem {
 
     ///////////////////////////////////////////////////////////////////////////
 
-    struct rect_t {
-        point_t pos{};
-        size_t size{};
-    };
-
-    struct color_t {
-        uint8_t r = 0;
-        uint8_t g = 0;
-        uint8_t b = 0;
-        uint8_t a = 0;
-    };
-
-    struct vline_t {
-        color_t color{};
-        point_t pos{};
-        int32_t h = 0;
-    };
-
-    struct hline_t {
-        color_t color{};
-        point_t pos{};
-        int32_t w = 0;
-    };
-
-    struct box_t {
-        bool fill;
-        color_t color{};
-        rect_t bounds{};
-    };
-
     struct stamp_t {
         point_t pos;
         tile_t tile;
         uint8_t flags;
     };
 
-    struct blit_t {
-        bank_id_t image{};
-        rect_t src_rect{};
-        rect_t dest_rect{};
-    };
-
-    struct text_t {
-        point_t pos;
-        font_t font;
-        color_t color;
-        std::string data;
-    };
-
     ///////////////////////////////////////////////////////////////////////////
 
     static constexpr uint8_t system_bank = 0xff;
 
     struct font_data_t {
-        uint32_t size;
-        color_t color;
-        int32_t style;
-        FC_Font* handle = nullptr;
+        uint32_t size = 0;
+        color_t color{};
+        uint8_t style = 0;
+        bitmap_font_t font{};
     };
 
     bool font_load(
         common::result& r,
         const std::string& path,
-        SDL_Renderer* renderer,
         uint32_t size,
-        int32_t style,
+        uint8_t style,
         color_t color,
         bank_id_t id);
 
     font_data_t* font_find(bank_id_t id);
 
+    // the main thread half of font_load, for fonts rasterized elsewhere
+    void font_store(bank_id_t id, font_data_t& data);
+
     ///////////////////////////////////////////////////////////////////////////
 
+    // bitmap is the blit-ready copy of the stb data held by surface
     struct image_t {
         size_t size{};
         int32_t format = 0;
         uint8_t* data = nullptr;
         SDL_Surface* surface = nullptr;
+        image_bitmap_t bitmap{};
     };
 
     bool image_load(
@@ -210,14 +170,126 @@ namespace mayhem {
         int32_t format,
         bank_id_t id);
 
+    // image_load in two halves: decode does the file read, png decoding and
+    // pixel conversion and may run on any thread; store creates the surface
+    // and replaces whatever is at id, and must run on the main thread.
+    bool image_decode(
+        common::result& r,
+        const std::string& path,
+        int32_t format,
+        image_t& image);
+
+    // as above, for an image entry written by mayhem-bankc
+    bool image_decode(common::result& r, const bank_entry& entry, image_t& image);
+
+    bool image_store(common::result& r, bank_id_t id, image_t& image);
+
+    void image_free(image_t& image);
+
     image_t* image_find(bank_id_t id);
 
     ///////////////////////////////////////////////////////////////////////////
 
+    // tile and sprite pixels: either BGRA32 to match video.bg and video.fg,
+    // or 8bpp indices into the palette named by tile_t::palette.  colors is
+    // the highest index used plus one, and zero for BGRA32 bitmaps.
+    //
+    // bitmaps built from sheets point into a shared atlas page instead: page
+    // is their first pixel, pitch the page width, and trim where the trimmed
+    // frame sits inside its untrimmed cell.
+    struct tile_bitmap_t {
+        size_t size{};
+        uint16_t colors = 0;
+        std::vector<uint8_t> indices{};
+        std::vector<uint32_t> pixels{};
+        const uint32_t* page = nullptr;
+        int32_t pitch = 0;
+        point_t trim{};
+        size_t cell{};
+    };
+
+    bool tile_bitmap_load(
+        common::result& r,
+        bank_id_t image_id,
+        const rect_t& source,
+        bank_id_t id);
+
+    // maps every pixel of the source rectangle to an exact entry of the
+    // palette at palette_index; pixels that have no match are an error.
+    bool tile_bitmap_load_indexed(
+        common::result& r,
+        bank_id_t image_id,
+        const rect_t& source,
+        uint8_t palette_index,
+        bank_id_t id);
+
+    bool tile_bitmap_create_indexed(
+        common::result& r,
+        const uint8_t* indices,
+        size_t size,
+        bank_id_t id);
+
+    // slices a sheet into frame_size cells with ids from first_id onward;
+    // they become tile bitmaps at the next tile_bitmap_build_atlas.
+    bool tile_bitmap_add_sheet(
+        common::result& r,
+        bank_id_t image_id,
+        size_t frame_size,
+        bank_id_t first_id);
+
+    // adds the frames of a tile sheet entry, as written by mayhem-bankc,
+    // with ids from first_id onward; nothing is decoded but the entry itself.
+    // they become tile bitmaps at the next tile_bitmap_build_atlas, and are
+    // cut again by video_reload_bank when the entry changes.
+    bool tile_bitmap_add_bank_sheet(
+        common::result& r,
+        const bank_file& file,
+        uint8_t bank,
+        const bank_entry& entry,
+        bank_id_t first_id);
+
+    bool tile_bitmap_build_atlas(common::result& r);
+
+    tile_bitmap_t* tile_bitmap_find(bank_id_t id);
+
+    ///////////////////////////////////////////////////////////////////////////
+
     using actor_list_t = std::vector<actor_t>;
     using sprite_list_t = std::vector<sprite_t>;
     using bg_block_list_t = std::vector<bg_block_t>;
 
+    struct video_stats_t {
+        bool full_copy = false;
+        uint32_t sprites_drawn = 0;
+        uint32_t tiles_redrawn = 0;
+        uint32_t cells_restored = 0;
+        uint32_t sprite_lines_dropped = 0;
+    };
+
+    // what the simulation hands the renderer each frame.  blocks and
+    // palettes are full copies; versions[i] is the block version at which
+    // block i last changed, and palette_versions the same for palettes, so
+    // the renderer finds changes by comparing versions rather than replaying
+    // edits, and a snapshot it never saw loses nothing.
+    //
+    // changed_blocks lists every block that changed since the frame the
+    // renderer held when this one was published, so those are all it has
+    // to compare.
+    struct video_frame_t {
+        uint32_t x_scroll = 0;
+        uint32_t y_scroll = 0;
+        uint32_t bg_generation = 0;
+        sprite_list_t sprites{};
+        bg_block_list_t blocks{};
+        std::vector<uint32_t> versions{};
+        std::vector<uint32_t> changed_blocks{};
+        std::vector<palette_t> palettes{};
+        std::vector<uint32_t> palette_versions{};
+        draw_list_t draws{};
+    };
+
+    static constexpr uint32_t video_frame_count = 3;
+
     struct video_t {
         rect_t clip{};
         size_t bg_size{};
@@ -229,9 +301,61 @@ namespace mayhem {
         actor_list_t actors{};
         uint32_t max_sprites{};
         sprite_list_t sprites{};
+        uint32_t max_sprites_per_line{};
+        scanline_buckets_t sprite_lines{};
+        compositor_t compositor{};
+        std::size_t image_cache_bytes = 0;
+        image_cache_t images{};
+        std::size_t text_cache_bytes = 0;
+        text_cache_t texts{};
         bg_block_list_t blocks{};
+        std::vector<uint32_t> block_versions{};
+        uint32_t block_version = 0;
+        uint32_t bg_generation = 0;
+
+        // changed_blocks holds each block changed since the last publish
+        // once, as ty * bg_size.w + tx like blocks; stale_blocks has a bit
+        // at each tile's (tx, ty) for blocks changed since each frame was
+        // last published into.
+        std::vector<uint32_t> changed_blocks{};
+        uint32_t published_block_version = 0;
+        common::dirty_map stale_blocks[video_frame_count]{};
         SDL_Surface* fg = nullptr;
         SDL_Surface* bg = nullptr;
+
+        // bg_dirty has one bit per tile in the bg map.  fg_damage has one bit
+        // per tile-sized screen cell touched since the last restore; at the
+        // start of composition it becomes fg_restore, the cells copied back
+        // from bg before this frame's overlays are drawn.
+        video_stats_t stats{};
+        bool bg_invalid = true;
+        uint32_t last_x_scroll = 0;
+        uint32_t last_y_scroll = 0;
+        common::dirty_map bg_dirty{};
+        common::dirty_map fg_damage{};
+        common::dirty_map fg_restore{};
+
+        // immediate-mode primitives are queued straight into the back frame;
+        // draw_layer and draw_blend apply to newly queued commands.
+        uint8_t draw_layer = 0;
+        bool draw_blend = false;
+
+        // the simulation edits scroll, sprites and blocks above, then
+        // video_publish snapshots them into the back frame.  video_update
+        // renders the newest published frame, which it reaches through
+        // frame; rendered_versions and rendered_generation are what it last
+        // drew into bg.  publish and update may run on different threads.
+        video_frame_t frames[video_frame_count]{};
+        common::triple_buffer buffers{};
+        video_frame_t* frame = nullptr;
+        uint32_t rendered_generation = 0;
+        std::vector<uint32_t> rendered_versions{};
+        std::vector<uint32_t> rendered_palette_versions{};
+
+        // headless frames are composed into fg but never uploaded or
+        // presented; frame_hash is the hash of fg after each video_update.
+        bool headless = false;
+        uint64_t frame_hash = 0;
     };
 
     struct game_t;
@@ -243,7 +367,7 @@ namespace mayhem {
         color_t color,
         int32_t y,
         int32_t x,
-        const std::string& value);
+        std::string_view value);
 
     bool video_queue_image(
         common::result& r,
@@ -279,8 +403,47 @@ namespace mayhem {
         int32_t h,
         bool fill = false);
 
+    // commands on higher layers draw over lower ones.  within a layer, images
+    // draw first, then lines and boxes, then text, in the order they were
+    // queued.
+    void video_draw_layer(game_t& game, uint8_t layer);
+
+    // when enabled, lines and boxes are alpha blended using color.a instead
+    // of replacing the pixels they cover.
+    void video_draw_blend(game_t& game, bool enabled);
+
+    bool video_set_tile(
+        common::result& r,
+        game_t& game,
+        uint32_t ty,
+        uint32_t tx,
+        uint32_t layer,
+        tile_t tile,
+        uint8_t flags = (uint8_t) tile_flags_t::enabled);
+
+    bool video_clear_tile(
+        common::result& r,
+        game_t& game,
+        uint32_t ty,
+        uint32_t tx,
+        uint32_t layer);
+
+    void video_invalidate_bg(game_t& game);
+
     bool video_init(common::result& r, game_t& game);
 
+    // after the bank file at path is remapped: decodes again only the sheets
+    // and images taken from entries whose bytes changed.  a sheet or image
+    // whose entry is gone keeps what it had.
+    bool video_reload_bank(common::result& r, game_t& game, const std::string& path);
+
+    // ends the simulation's frame: snapshots it for video_update and starts
+    // an empty draw list for the next one.
+    void video_publish(game_t& game);
+
+    // true when a frame was published since the last video_update
+    bool video_frame_ready(const game_t& game);
+
     bool video_update(common::result& r, game_t& game);
 
     bool video_shutdown(common::result& r, game_t& game);
@@ -90,10 +90,47 @@ namespace mayhem {
         return true;
     }
 
+    bool window_create_headless(common::result& r, window_t& window) {
+        log_message(log_category_t::video, "create headless SDL renderer.");
+        window.x = 0;
+        window.y = 0;
+        window.sx = 1;
+        window.sy = 1;
+        window.w = screen_width;
+        window.h = screen_height;
+        window.surface = SDL_CreateRGBSurfaceWithFormat(
+            0,
+            window.w,
+            window.h,
+            32,
+            SDL_PIXELFORMAT_ARGB8888);
+
+        if (window.surface == nullptr) {
+            r.error("G001", "unable to create headless SDL surface.");
+            return false;
+        }
+
+        window.renderer = SDL_CreateSoftwareRenderer(window.surface);
+        if (window.renderer == nullptr) {
+            r.error("G001", "unable to create SDL software renderer.");
+            return false;
+        }
+
+        window.texture = SDL_CreateTexture(
+            window.renderer,
+            SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            window.w,
+            window.h);
+
+        return true;
+    }
+
     bool window_destroy(common::result& r, window_t& window) {
         SDL_DestroyTexture(window.texture);
         SDL_DestroyRenderer(window.renderer);
         SDL_DestroyWindow(window.handle);
+        SDL_FreeSurface(window.surface);
         return true;
     }
 
@@ -36,5 +36,9 @@ namespace mayhem {
 
     bool window_create(common::result& r, window_t& window, int32_t x, int32_t y);
 
+    // no SDL window: a software renderer over an offscreen surface, so
+    // fonts and textures still have a renderer to attach to.
+    bool window_create_headless(common::result& r, window_t& window);
+
 }
 